@@ -0,0 +1,605 @@
+﻿// Includes
+#include "CompiledExpression.h"
+#include "ExpressionCounters.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#ifdef EXPRESSION_COUNTERS
+// Adds evaluations and the time until the end of the scope to counters, if there are any
+class EvaluationTimer
+{
+  public:
+    EvaluationTimer(ExpressionCounters* counters, std::size_t count)
+    {
+      this->counters_ = counters;
+      this->count_ = count;
+      if(counters != 0)
+        this->start_ = std::chrono::steady_clock::now();
+    }
+
+    ~EvaluationTimer()
+    {
+      if(this->counters_ != 0)
+        this->counters_->addEvaluations(this->count_, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start_).count());
+    }
+
+  private:
+    ExpressionCounters* counters_;
+    std::size_t count_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Counts a single evaluation and adds the time until the end of the scope for the ones selected as samples
+class EvaluationSample
+{
+  public:
+    EvaluationSample(ExpressionCounters* counters)
+    {
+      this->counters_ = (counters != 0 && counters->addEvaluation()) ? counters : 0;
+      if(this->counters_ != 0)
+        this->start_ = std::chrono::steady_clock::now();
+    }
+
+    ~EvaluationSample()
+    {
+      if(this->counters_ != 0)
+        this->counters_->addEvaluationSample(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start_).count());
+    }
+
+  private:
+    ExpressionCounters* counters_; // 0 unless the evaluation is timed
+    std::chrono::steady_clock::time_point start_;
+};
+#endif
+
+// Batch kernels
+// The same block interpreter is compiled for several instruction sets, the best one is selected once at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_KERNEL_DISPATCH
+#define BATCH_KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define BATCH_KERNEL_INLINE inline
+#endif
+#ifdef __GNUC__
+// Rows are independent, even if the result block is one of the operands
+#define BATCH_LOOP _Pragma("GCC ivdep")
+#else
+#define BATCH_LOOP
+#endif
+
+typedef void (*BatchKernel)(const Instruction*, const Instruction*, const double* const*, std::size_t, unsigned int, const double**, double*, double*, double* const*, unsigned int);
+
+// Runs the instructions on one block of rows.
+// Every stack entry is a block of values; variables are read from their columns directly instead of being copied.
+// Every operation is calculated for all BATCH_BLOCK_SIZE rows of the block, so the loops have a constant length and
+// are vectorized at -O2 as well; the last block is padded by the caller. Powers, sin and cos call the math library
+// for every row.
+// @param code The first instruction.
+// @param end The end of the instructions.
+// @param columns The variable columns in slot order, with BATCH_BLOCK_SIZE rows from the offset.
+// @param offset The first row of the block.
+// @param count The number of rows to write to the outputs.
+// @param operands Storage for max_depth_ pointers to the blocks on the stack.
+// @param stack Storage for max_depth_ blocks of BATCH_BLOCK_SIZE values.
+// @param temps Storage for temp_count_ blocks of BATCH_BLOCK_SIZE values.
+// @param outputs The output columns, one for each value remaining on the stack.
+// @param output_count The number of output columns.
+static BATCH_KERNEL_INLINE void executeBlock(const Instruction* code, const Instruction* end, const double* const* columns,
+  std::size_t offset, unsigned int count, const double** operands, double* stack, double* temps, double* const* outputs, unsigned int output_count)
+{
+  const double** top = operands - 1;
+  unsigned int depth = 0;
+
+  for(; code != end; code++) {
+    double* result = 0;
+    const double* a = 0;
+    const double* b = 0;
+    switch(code->opcode_) {
+      case OP_CONSTANT:
+        result = stack + depth * CompiledExpression::BATCH_BLOCK_SIZE;
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = code->value_;
+        *(++top) = result;
+        depth++;
+        continue;
+      case OP_VARIABLE:
+        *(++top) = columns[code->index_] + offset;
+        depth++;
+        continue;
+      case OP_LOAD:
+        *(++top) = temps + code->index_ * CompiledExpression::BATCH_BLOCK_SIZE;
+        depth++;
+        continue;
+      case OP_STORE:
+        std::memcpy(temps + code->index_ * CompiledExpression::BATCH_BLOCK_SIZE, *top, CompiledExpression::BATCH_BLOCK_SIZE * sizeof(double));
+        continue;
+      case OP_CALL:
+      case OP_CALL_IMPURE: {
+        // Registered kernels take the arguments of one row
+        unsigned int argument_count = code->index_;
+        const double** arguments = top + 1 - argument_count;
+        depth = depth + 1 - argument_count;
+        result = stack + (depth - 1) * CompiledExpression::BATCH_BLOCK_SIZE;
+        double values[CompiledExpression::MAX_CALL_ARGUMENTS];
+        for(unsigned int i = 0; i < count; i++) {
+          for(unsigned int a = 0; a < argument_count; a++)
+            values[a] = arguments[a][i];
+          result[i] = code->kernel_(values, argument_count);
+        }
+        // Registered functions are only called for the actual rows, the padding repeats the last one
+        std::fill(result + count, result + CompiledExpression::BATCH_BLOCK_SIZE, result[count - 1]);
+        top = arguments;
+        *top = result;
+        continue;
+      }
+      default:
+        break;
+    }
+
+    if(code->opcode_ == OP_NEGATE || code->opcode_ == OP_SIN || code->opcode_ == OP_COS) {
+      a = *top;
+    }
+    else {
+      b = *(top--);
+      a = *top;
+      depth--;
+    }
+    result = stack + (depth - 1) * CompiledExpression::BATCH_BLOCK_SIZE;
+
+    switch(code->opcode_) {
+      case OP_ADD:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = a[i] + b[i];
+        break;
+      case OP_SUBTRACT:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = a[i] - b[i];
+        break;
+      case OP_MULTIPLY:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = a[i] * b[i];
+        break;
+      case OP_DIVIDE:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = a[i] / b[i];
+        break;
+      case OP_POWER:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = pow(a[i], b[i]);
+        break;
+      case OP_NEGATE:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = a[i] * -1.0;
+        break;
+      case OP_SIN:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = sin(a[i]);
+        break;
+      case OP_COS:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = cos(a[i]);
+        break;
+      case OP_MAX:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = (a[i] > b[i]) ? a[i] : b[i];
+        break;
+      case OP_MIN:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = (a[i] < b[i]) ? a[i] : b[i];
+        break;
+      default:
+        break;
+    }
+    *top = result;
+  }
+
+  for(unsigned int i = 0; i < output_count; i++)
+    std::memcpy(outputs[i] + offset, operands[i], count * sizeof(double));
+}
+
+static void executeBlockScalar(const Instruction* code, const Instruction* end, const double* const* columns,
+  std::size_t offset, unsigned int count, const double** operands, double* stack, double* temps, double* const* outputs, unsigned int output_count)
+{
+  executeBlock(code, end, columns, offset, count, operands, stack, temps, outputs, output_count);
+}
+
+#ifdef BATCH_KERNEL_DISPATCH
+__attribute__((target("avx2")))
+static void executeBlockAVX2(const Instruction* code, const Instruction* end, const double* const* columns,
+  std::size_t offset, unsigned int count, const double** operands, double* stack, double* temps, double* const* outputs, unsigned int output_count)
+{
+  executeBlock(code, end, columns, offset, count, operands, stack, temps, outputs, output_count);
+}
+
+__attribute__((target("avx512f")))
+static void executeBlockAVX512(const Instruction* code, const Instruction* end, const double* const* columns,
+  std::size_t offset, unsigned int count, const double** operands, double* stack, double* temps, double* const* outputs, unsigned int output_count)
+{
+  executeBlock(code, end, columns, offset, count, operands, stack, temps, outputs, output_count);
+}
+#endif
+
+// Selects the batch kernel for the instruction set of the current CPU.
+// @param name Receives the name of the selected kernel.
+// @return The selected kernel.
+static BatchKernel selectBatchKernel(const char** name)
+{
+#ifdef BATCH_KERNEL_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")) {
+    *name = "avx512";
+    return executeBlockAVX512;
+  }
+  if(__builtin_cpu_supports("avx2")) {
+    *name = "avx2";
+    return executeBlockAVX2;
+  }
+#endif
+  *name = "scalar";
+  return executeBlockScalar;
+}
+
+static const char* batch_kernel_name = 0;
+static const BatchKernel batch_kernel = selectBatchKernel(&batch_kernel_name);
+
+// Constructor
+CompiledExpression::CompiledExpression()
+{
+  this->max_depth_ = 0;
+  this->temp_count_ = 0;
+  this->valid_ = false;
+  this->error_.kind_ = ERROR_EMPTY;
+  this->error_.position_ = 0;
+  this->counters_ = 0;
+}
+
+// Destructor
+CompiledExpression::~CompiledExpression()
+{
+
+}
+
+// Checks whether the expression was compiled successfully.
+// @return True if the expression can be evaluated.
+bool CompiledExpression::isValid() const
+{
+  return this->valid_;
+}
+
+// Returns the variables used in the expression.
+// @return The variable names, the position of a name is its slot index.
+const std::vector<std::string>& CompiledExpression::getVariables() const
+{
+  return this->variables_;
+}
+
+// Returns why the formula could not be compiled.
+// @return The error, ERROR_NONE if the expression is valid.
+const ExpressionError& CompiledExpression::getError() const
+{
+  return this->error_;
+}
+
+// Sets the counters recording the evaluations, expressions compiled by a ShuntingYard get the counters of the parser.
+// Only used if built with EXPRESSION_COUNTERS defined.
+// @param counters The counters, which have to outlive the expression, 0 to record nothing.
+void CompiledExpression::setCounters(ExpressionCounters* counters)
+{
+  this->counters_ = counters;
+}
+
+// Estimates the memory used by the compiled expression.
+// @return The memory in bytes.
+std::size_t CompiledExpression::getMemoryUsage() const
+{
+  std::size_t memory = sizeof(CompiledExpression) + this->instructions_.capacity() * sizeof(Instruction);
+  for(std::vector<std::string>::const_iterator it = this->variables_.begin(); it != this->variables_.end(); it++)
+    memory += sizeof(std::string) + ((it->capacity() > 15) ? it->capacity() : 0);
+  return memory;
+}
+
+// Evaluates the compiled expression using given variable definitions.
+// @param definitions A map containing a value for each variable.
+// @return The result of the formula or 0 if an error occured.
+double CompiledExpression::evaluate(const std::map<std::string, double>& definitions) const
+{
+  double result = 0;
+  this->evaluate(definitions, &result);
+  return result;
+}
+
+// Evaluates the compiled expression using given variable definitions, telling errors apart from results.
+// Every variable is looked up once, not once per occurrence in the formula.
+// @param definitions A map containing a value for each variable.
+// @param result Set to the result of the formula, 0 if an error occured.
+// @return The error, ERROR_NONE if the formula has been evaluated.
+ExpressionError CompiledExpression::evaluate(const std::map<std::string, double>& definitions, double* result) const
+{
+  *result = 0;
+  if(!this->valid_)
+    return this->error_;
+
+  double fixed_values[STACK_SIZE];
+  std::vector<double> dynamic_values;
+  double* values = fixed_values;
+  if(this->variables_.size() > STACK_SIZE) {
+    dynamic_values.resize(this->variables_.size());
+    values = &dynamic_values[0];
+  }
+
+  for(unsigned int i = 0; i < this->variables_.size(); i++) {
+    std::map<std::string, double>::const_iterator def_it = definitions.find(this->variables_[i]);
+    if(def_it == definitions.end()) {
+      // Error: missing variable definitions, the positions of variables are not kept
+      ExpressionError error = {ERROR_MISSING_VARIABLE, ShuntingYard::NO_POSITION};
+#ifdef EXPRESSION_COUNTERS
+      if(this->counters_ != 0)
+        this->counters_->addError(ERROR_MISSING_VARIABLE);
+#endif
+      return error;
+    }
+    values[i] = def_it->second;
+  }
+
+  *result = this->evaluate(values);
+  ExpressionError error = {ERROR_NONE, ShuntingYard::NO_POSITION};
+  return error;
+}
+
+// Evaluates the compiled expression using variable values given in slot order.
+// @param values An array containing a value for each entry of getVariables().
+// @return The result of the formula or 0 if the expression is invalid.
+double CompiledExpression::evaluate(const double* values) const
+{
+  if(!this->valid_)
+    return 0;
+#ifdef EXPRESSION_COUNTERS
+  EvaluationSample sample(this->counters_);
+#endif
+
+  // Stored values are kept behind the stack
+  if(this->max_depth_ + this->temp_count_ <= STACK_SIZE) {
+    double stack[STACK_SIZE];
+    return this->execute(values, stack, stack + this->max_depth_);
+  }
+  std::vector<double> stack(this->max_depth_ + this->temp_count_);
+  return this->execute(values, &stack[0], &stack[0] + this->max_depth_);
+}
+
+// Evaluates the compiled expression for many rows of variable values at once.
+// Every instruction is executed for a whole block of rows, using the vector instructions of the current CPU for
+// +, -, *, /, negation, max and min. Powers, sin, cos and registered functions are calculated row by row.
+// @param columns An array containing one column of row values for each entry of getVariables().
+// @param output The column receiving one result per row.
+// @param rows The number of rows.
+void CompiledExpression::evaluateBatch(const double* const* columns, double* output, std::size_t rows) const
+{
+  if(!this->valid_) {
+    std::fill(output, output + rows, 0.0);
+    return;
+  }
+#ifdef EXPRESSION_COUNTERS
+  EvaluationTimer timer(this->counters_, rows);
+#endif
+
+  this->executeBatch(columns, &output, 1, 0, rows);
+}
+
+// Evaluates the compiled expression for many rows of variable values on the threads of a pool.
+// The rows are split into chunks of BATCH_CHUNK_SIZE rows, every chunk writes its own range of the output column.
+// @param columns An array containing one column of row values for each entry of getVariables().
+// @param output The column receiving one result per row.
+// @param rows The number of rows.
+// @param pool The thread pool to use.
+void CompiledExpression::evaluateBatch(const double* const* columns, double* output, std::size_t rows, ThreadPool* pool) const
+{
+  if(!this->valid_) {
+    std::fill(output, output + rows, 0.0);
+    return;
+  }
+#ifdef EXPRESSION_COUNTERS
+  EvaluationTimer timer(this->counters_, rows);
+#endif
+
+  std::size_t chunks = (rows + BATCH_CHUNK_SIZE - 1) / BATCH_CHUNK_SIZE;
+  if(chunks <= 1 || pool->getThreadCount() <= 1) {
+    this->executeBatch(columns, &output, 1, 0, rows);
+    return;
+  }
+
+  pool->run(chunks, [this, columns, output, rows](std::size_t chunk) {
+    std::size_t begin = chunk * BATCH_CHUNK_SIZE;
+    std::size_t end = (rows - begin < BATCH_CHUNK_SIZE) ? rows : begin + BATCH_CHUNK_SIZE;
+    this->executeBatch(columns, &output, 1, begin, end);
+  });
+}
+
+// Returns the name of the batch kernel selected for the current CPU.
+// @return "avx512", "avx2" or "scalar".
+const char* CompiledExpression::getBatchKernelName()
+{
+  return batch_kernel_name;
+}
+
+// Calculates the result of an operator or function, with the same semantics as the interpreter.
+// @param opcode The opcode of the operator or function.
+// @param values The operands in their original order.
+// @return The calculated value.
+double CompiledExpression::calculate(OpCode opcode, const double* values)
+{
+  switch(opcode) {
+    case OP_ADD:
+      return values[0] + values[1];
+    case OP_SUBTRACT:
+      return values[0] - values[1];
+    case OP_MULTIPLY:
+      return values[0] * values[1];
+    case OP_DIVIDE:
+      return values[0] / values[1];
+    case OP_POWER:
+      return pow(values[0], values[1]);
+    case OP_NEGATE:
+      return values[0] * -1.0;
+    case OP_SIN:
+      return sin(values[0]);
+    case OP_COS:
+      return cos(values[0]);
+    case OP_MAX:
+      return (values[0] > values[1]) ? values[0] : values[1];
+    case OP_MIN:
+      return (values[0] < values[1]) ? values[0] : values[1];
+    default:
+      return 0;
+  }
+}
+
+// Calculates the result of an instruction, including calls of registered kernels.
+// @param instruction The instruction of the operator or function.
+// @param values The operands in their original order.
+// @return The calculated value.
+double CompiledExpression::calculate(const Instruction& instruction, const double* values)
+{
+  if(instruction.opcode_ == OP_CALL || instruction.opcode_ == OP_CALL_IMPURE)
+    return instruction.kernel_(values, instruction.index_);
+  return calculate(instruction.opcode_, values);
+}
+
+// Returns the operator or function name of an opcode as it is written in formulas.
+// @param opcode The opcode.
+// @return The name, # for the unary minus and an empty string for instructions without a fixed name.
+const char* CompiledExpression::getSymbol(OpCode opcode)
+{
+  static const char* symbols[] = {"", "", "+", "-", "*", "/", "^", "#", "sin", "cos", "max", "min", "", "", "", ""};
+  return symbols[opcode];
+}
+
+// Runs the batch kernel for a range of rows.
+// @param columns The variable columns in slot order.
+// @param outputs The output columns, one for each value remaining on the stack.
+// @param output_count The number of output columns.
+// @param begin The first row.
+// @param end The end of the rows.
+void CompiledExpression::executeBatch(const double* const* columns, double* const* outputs, unsigned int output_count, std::size_t begin, std::size_t end) const
+{
+  std::vector<const double*> operands(this->max_depth_);
+  std::vector<double> stack((this->max_depth_ + this->temp_count_) * BATCH_BLOCK_SIZE);
+  double* temps = &stack[0] + this->max_depth_ * BATCH_BLOCK_SIZE;
+  const Instruction* code = this->instructions_.data();
+  const Instruction* code_end = code + this->instructions_.size();
+  std::size_t offset = begin;
+  for(; offset + BATCH_BLOCK_SIZE <= end; offset += BATCH_BLOCK_SIZE)
+    batch_kernel(code, code_end, columns, offset, BATCH_BLOCK_SIZE, &operands[0], &stack[0], temps, outputs, output_count);
+  if(offset < end) {
+    // The last rows are copied into a full block, padded with the last row
+    unsigned int count = (unsigned int)(end - offset);
+    std::vector<double> padded(this->variables_.size() * BATCH_BLOCK_SIZE);
+    std::vector<const double*> padded_columns(this->variables_.size());
+    for(std::size_t v = 0; v < this->variables_.size(); v++) {
+      double* column = &padded[v * BATCH_BLOCK_SIZE];
+      std::copy(columns[v] + offset, columns[v] + end, column);
+      std::fill(column + count, column + BATCH_BLOCK_SIZE, columns[v][end - 1]);
+      padded_columns[v] = column;
+    }
+    // The kernel writes the outputs at the offset of the block
+    std::vector<double*> shifted_outputs(outputs, outputs + output_count);
+    for(unsigned int i = 0; i < output_count; i++)
+      shifted_outputs[i] += offset;
+    batch_kernel(code, code_end, padded_columns.data(), 0, count, &operands[0], &stack[0], temps, shifted_outputs.data(), output_count);
+  }
+}
+
+// Runs the instructions on a value stack.
+// @param values The variable values in slot order.
+// @param stack A stack with room for at least max_depth_ values.
+// @param temps Room for temp_count_ stored values.
+// @return The value remaining on the stack.
+double CompiledExpression::execute(const double* values, double* stack, double* temps) const
+{
+  const Instruction* code = this->instructions_.data();
+  return execute(code, code + this->instructions_.size(), values, stack, temps);
+}
+
+// Runs instructions on a value stack.
+// The stack effect has been verified when compiling, so no checks are needed here.
+// @param code The first instruction.
+// @param end The end of the instructions.
+// @param values The variable values in slot order.
+// @param stack A stack with room for the maximum depth of the instructions.
+// @param temps Room for the values stored by the instructions.
+// @return The value remaining on the stack.
+double CompiledExpression::execute(const Instruction* code, const Instruction* end, const double* values, double* stack, double* temps)
+{
+  double* top = stack - 1;
+  for(; code != end; code++) {
+    switch(code->opcode_) {
+      case OP_CONSTANT:
+        *(++top) = code->value_;
+        break;
+      case OP_VARIABLE:
+        *(++top) = values[code->index_];
+        break;
+      case OP_ADD:
+        top--;
+        *top = *top + *(top + 1);
+        break;
+      case OP_SUBTRACT:
+        top--;
+        *top = *top - *(top + 1);
+        break;
+      case OP_MULTIPLY:
+        top--;
+        *top = *top * *(top + 1);
+        break;
+      case OP_DIVIDE:
+        top--;
+        *top = *top / *(top + 1);
+        break;
+      case OP_POWER:
+        top--;
+        *top = pow(*top, *(top + 1));
+        break;
+      case OP_NEGATE:
+        *top = *top * -1.0;
+        break;
+      case OP_SIN:
+        *top = sin(*top);
+        break;
+      case OP_COS:
+        *top = cos(*top);
+        break;
+      case OP_MAX:
+        top--;
+        *top = (*top > *(top + 1)) ? *top : *(top + 1);
+        break;
+      case OP_MIN:
+        top--;
+        *top = (*top < *(top + 1)) ? *top : *(top + 1);
+        break;
+      case OP_LOAD:
+        *(++top) = temps[code->index_];
+        break;
+      case OP_STORE:
+        temps[code->index_] = *top;
+        break;
+      case OP_CALL:
+      case OP_CALL_IMPURE:
+        top = top + 1 - code->index_;
+        *top = code->kernel_(top, code->index_);
+        break;
+    }
+  }
+  return *top;
+}
@@ -0,0 +1,107 @@
+﻿#ifndef COMPILEDEXPRESSION_H
+#define COMPILEDEXPRESSION_H
+
+// Includes
+#include "ShuntingYard.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+// Additionals
+enum OpCode {OP_CONSTANT, OP_VARIABLE, OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_POWER, OP_NEGATE, OP_SIN, OP_COS, OP_MAX, OP_MIN, OP_LOAD, OP_STORE, OP_CALL, OP_CALL_IMPURE};
+
+// Operator or function registered at runtime, called with its arguments in their original order
+typedef double (*FunctionKernel)(const double*, unsigned int);
+
+typedef struct Instruction
+{
+  OpCode opcode_;
+  unsigned int index_; // Variable slot of OP_VARIABLE, temporary of OP_LOAD and OP_STORE, argument count of OP_CALL
+  union
+  {
+    double value_; // Pre-parsed value of OP_CONSTANT
+    FunctionKernel kernel_; // Function of OP_CALL and OP_CALL_IMPURE
+  };
+} Instruction;
+
+// Instructions are stored as they are by ExpressionFile
+static_assert(sizeof(Instruction) == 16, "Instruction has to be 16 bytes");
+
+// A formula lowered into instructions for repeated evaluation.
+// All evaluate methods are const and keep their state on the stack of the calling thread, so one instance can be
+// evaluated by any number of threads at the same time. Nothing is printed on errors.
+// evaluateBatch() vectorizes the arithmetic operators, max and min; powers, sin, cos and registered functions call
+// their scalar implementation for every row.
+class CompiledExpression
+{
+  friend class ShuntingYard;
+  friend class ExpressionOptimizer;
+  friend class ExpressionDag;
+  friend class JitExpression;
+  friend class IncrementalExpression;
+  friend class MultiExpression;
+  friend class ExpressionFile;
+  friend class GradientExpression;
+  friend class IntervalExpression;
+  template<typename T> friend class TypedExpression;
+
+  public:
+    // Constructor
+    CompiledExpression();
+
+    // Destructor
+    ~CompiledExpression();
+
+    // Methods
+    bool isValid() const;
+    const ExpressionError& getError() const;
+    const std::vector<std::string>& getVariables() const;
+    std::size_t getMemoryUsage() const;
+    void setCounters(ExpressionCounters*);
+    double evaluate(const std::map<std::string, double>&) const;
+    ExpressionError evaluate(const std::map<std::string, double>&, double*) const;
+    double evaluate(const double*) const;
+    void evaluateBatch(const double* const*, double*, std::size_t) const;
+    void evaluateBatch(const double* const*, double*, std::size_t, ThreadPool*) const;
+    static const char* getBatchKernelName();
+    static constexpr int getArity(OpCode opcode)
+    {
+      // Number of values an instruction consumes, calls consume the number of arguments given by the instruction
+      return (opcode == OP_CONSTANT || opcode == OP_VARIABLE || opcode == OP_LOAD) ? 0 :
+        (opcode == OP_STORE || opcode == OP_NEGATE || opcode == OP_SIN || opcode == OP_COS) ? 1 : 2;
+    }
+    static constexpr int getArity(const Instruction& instruction)
+    {
+      return (instruction.opcode_ == OP_CALL || instruction.opcode_ == OP_CALL_IMPURE) ? (int)instruction.index_ : getArity(instruction.opcode_);
+    }
+    static double calculate(OpCode, const double*);
+    static double calculate(const Instruction&, const double*);
+    static const char* getSymbol(OpCode);
+
+    // Expressions up to this stack depth are evaluated on a fixed-size stack without any allocation
+    static const unsigned int STACK_SIZE = 64;
+    // Number of rows evaluated together by every instruction in evaluateBatch()
+    static const unsigned int BATCH_BLOCK_SIZE = 256;
+    // Number of rows per task of the parallel evaluateBatch()
+    static const unsigned int BATCH_CHUNK_SIZE = 64 * BATCH_BLOCK_SIZE;
+    // Maximum number of arguments of OP_CALL
+    static const unsigned int MAX_CALL_ARGUMENTS = 8;
+
+  private:
+    std::vector<Instruction> instructions_;
+    std::vector<std::string> variables_;
+    unsigned int max_depth_;
+    unsigned int temp_count_; // Values shared by OP_STORE and OP_LOAD
+    bool valid_;
+    ExpressionError error_; // Why the expression is invalid
+    ExpressionCounters* counters_;
+
+    double execute(const double*, double*, double*) const;
+    static double execute(const Instruction*, const Instruction*, const double*, double*, double*);
+    void executeBatch(const double* const*, double* const*, unsigned int, std::size_t, std::size_t) const;
+
+};
+
+#endif /* COMPILEDEXPRESSION_H */
@@ -0,0 +1,210 @@
+﻿// Includes
+#include "EvaluationService.h"
+
+// Constructor
+// Starts the worker threads.
+// @param max_batch_size The number of requests for the same formula which are evaluated together at most.
+// @param max_delay_microseconds How long a request waits for further requests for the same formula at most, 0 to only
+// batch the requests arriving while the workers are busy.
+// @param thread_count The number of worker threads.
+// @param cache_capacity The number of compiled formulas kept in the cache.
+// @param registry The operators and functions to use, 0 for the built-ins only.
+EvaluationService::EvaluationService(std::size_t max_batch_size, unsigned int max_delay_microseconds, unsigned int thread_count,
+  std::size_t cache_capacity, const OperatorRegistry* registry) : cache_(cache_capacity, 0, 16, registry)
+{
+  this->max_batch_size_ = (max_batch_size > 0) ? max_batch_size : 1;
+  this->max_delay_ = std::chrono::microseconds(max_delay_microseconds);
+  this->requests_ = 0;
+  this->batches_ = 0;
+  this->stopping_ = false;
+  if(thread_count == 0)
+    thread_count = 1;
+  for(unsigned int i = 0; i < thread_count; i++)
+    this->threads_.push_back(std::thread(&EvaluationService::work, this));
+}
+
+// Destructor
+// Evaluates the queued requests and stops the worker threads.
+EvaluationService::~EvaluationService()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stopping_ = true;
+  }
+  this->condition_.notify_all();
+  for(unsigned int i = 0; i < this->threads_.size(); i++)
+    this->threads_[i].join();
+}
+
+// Queues the evaluation of a formula using given variable definitions.
+// The formula is compiled, or taken from the cache, and the variables are looked up before this returns.
+// @param formula The formula in infix notation.
+// @param definitions A map containing a value for each variable.
+// @return The future result, which is ready at once if the formula is invalid or a variable is missing.
+std::future<EvaluationResult> EvaluationService::submit(std::string_view formula, const std::map<std::string, double>& definitions)
+{
+  std::shared_ptr<const CompiledExpression> compiled = this->cache_.get(formula);
+  if(!compiled->isValid())
+    return getFailure(compiled->getError());
+
+  const std::vector<std::string>& variables = compiled->getVariables();
+  double fixed_values[CompiledExpression::STACK_SIZE];
+  std::vector<double> dynamic_values;
+  double* values = fixed_values;
+  if(variables.size() > CompiledExpression::STACK_SIZE) {
+    dynamic_values.resize(variables.size());
+    values = &dynamic_values[0];
+  }
+
+  for(unsigned int i = 0; i < variables.size(); i++) {
+    std::map<std::string, double>::const_iterator def_it = definitions.find(variables[i]);
+    if(def_it == definitions.end()) {
+      // Error: missing variable definitions, the positions of variables are not kept
+      ExpressionError error = {ERROR_MISSING_VARIABLE, ShuntingYard::NO_POSITION};
+      return getFailure(error);
+    }
+    values[i] = def_it->second;
+  }
+  return this->submit(compiled, values);
+}
+
+// Queues the evaluation of a compiled expression, e.g. one taken from an ExpressionCache of the caller.
+// Requests are batched by compiled expression, so the same formula should always be passed as the same instance.
+// @param compiled The compiled expression, it is kept until the request has been evaluated.
+// @param values An array containing a value for each entry of getVariables(), copied before this returns.
+// @return The future result, which is ready at once if the expression is invalid.
+std::future<EvaluationResult> EvaluationService::submit(const std::shared_ptr<const CompiledExpression>& compiled, const double* values)
+{
+  if(!compiled->isValid())
+    return getFailure(compiled->getError());
+
+  std::promise<EvaluationResult> promise;
+  std::future<EvaluationResult> future = promise.get_future();
+  std::size_t variable_count = compiled->getVariables().size();
+  this->requests_.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  std::unordered_map<const CompiledExpression*, Batch*>::iterator it = this->pending_.find(compiled.get());
+  Batch* batch = 0;
+  if(it != this->pending_.end()) {
+    batch = it->second;
+  }
+  else {
+    // The first request of a batch, a worker has to wake up at its deadline
+    batch = new Batch();
+    batch->compiled_ = compiled;
+    batch->deadline_ = std::chrono::steady_clock::now() + this->max_delay_;
+    this->pending_.insert(std::make_pair(compiled.get(), batch));
+    this->condition_.notify_one();
+  }
+  batch->values_.insert(batch->values_.end(), values, values + variable_count);
+  batch->promises_.push_back(std::move(promise));
+
+  if(batch->promises_.size() >= this->max_batch_size_) {
+    this->pending_.erase(compiled.get());
+    this->ready_.push_back(batch);
+    this->condition_.notify_one();
+  }
+  return future;
+}
+
+// Returns the number of requests queued so far, without the ones which failed at once.
+// @return The number of requests.
+unsigned long long EvaluationService::getRequestCount() const
+{
+  return this->requests_.load(std::memory_order_relaxed);
+}
+
+// Returns the number of batches evaluated so far; the requests divided by the batches are the average batch size.
+// @return The number of batches.
+unsigned long long EvaluationService::getBatchCount() const
+{
+  return this->batches_.load(std::memory_order_relaxed);
+}
+
+// Runs a worker thread: waits for full batches or batches whose deadline has passed and evaluates them.
+void EvaluationService::work()
+{
+  // Scratch memory of the column-wise evaluation, kept between batches
+  std::vector<double> columns;
+  std::vector<double> results;
+
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  while(true) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_deadline = now;
+    bool waiting = false;
+    for(std::unordered_map<const CompiledExpression*, Batch*>::iterator it = this->pending_.begin(); it != this->pending_.end();) {
+      if(this->stopping_ || it->second->deadline_ <= now) {
+        this->ready_.push_back(it->second);
+        it = this->pending_.erase(it);
+        continue;
+      }
+      if(!waiting || it->second->deadline_ < next_deadline)
+        next_deadline = it->second->deadline_;
+      waiting = true;
+      it++;
+    }
+
+    if(!this->ready_.empty()) {
+      Batch* batch = this->ready_.front();
+      this->ready_.pop_front();
+      lock.unlock();
+      this->evaluate(batch, &columns, &results);
+      delete batch;
+      lock.lock();
+      continue;
+    }
+
+    if(this->stopping_)
+      return;
+    if(waiting)
+      this->condition_.wait_until(lock, next_deadline);
+    else
+      this->condition_.wait(lock);
+  }
+}
+
+// Evaluates the requests of a batch and completes their futures.
+// A single request is evaluated directly, more requests are transposed into columns for evaluateBatch().
+// @param batch The batch.
+// @param columns Scratch memory for the columns.
+// @param results Scratch memory for the results.
+void EvaluationService::evaluate(Batch* batch, std::vector<double>* columns, std::vector<double>* results)
+{
+  const CompiledExpression& compiled = *batch->compiled_;
+  std::size_t rows = batch->promises_.size();
+  std::size_t variable_count = compiled.getVariables().size();
+  results->resize(rows);
+  if(rows == 1) {
+    (*results)[0] = compiled.evaluate(batch->values_.data());
+  }
+  else {
+    columns->resize(variable_count * rows);
+    std::vector<const double*> column_pointers(variable_count);
+    for(std::size_t v = 0; v < variable_count; v++) {
+      double* column = columns->data() + v * rows;
+      for(std::size_t row = 0; row < rows; row++)
+        column[row] = batch->values_[row * variable_count + v];
+      column_pointers[v] = column;
+    }
+    compiled.evaluateBatch(column_pointers.data(), results->data(), rows);
+  }
+  this->batches_.fetch_add(1, std::memory_order_relaxed);
+
+  for(std::size_t row = 0; row < rows; row++) {
+    EvaluationResult result = {(*results)[row], {ERROR_NONE, ShuntingYard::NO_POSITION}};
+    batch->promises_[row].set_value(result);
+  }
+}
+
+// Creates a future which has already failed.
+// @param error The error.
+// @return The future, with a value of 0.
+std::future<EvaluationResult> EvaluationService::getFailure(const ExpressionError& error)
+{
+  std::promise<EvaluationResult> promise;
+  EvaluationResult result = {0, error};
+  promise.set_value(result);
+  return promise.get_future();
+}
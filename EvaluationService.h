@@ -0,0 +1,83 @@
+﻿#ifndef EVALUATIONSERVICE_H
+#define EVALUATIONSERVICE_H
+
+// Includes
+#include "CompiledExpression.h"
+#include "ExpressionCache.h"
+#include "OperatorRegistry.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Additionals
+typedef struct EvaluationResult
+{
+  double value_; // 0 if an error occured
+  ExpressionError error_; // ERROR_NONE if value_ is the result of the formula
+} EvaluationResult;
+
+// Asynchronous evaluation of requests consisting of a formula and the values of its variables, e.g. behind a server.
+// submit() queues a request and returns a future at once. Requests for the same formula are collected into
+// micro-batches, which the worker threads evaluate column-wise with evaluateBatch() as soon as a batch is full or its
+// oldest request has waited for the maximum delay; then the futures of all requests of the batch are completed.
+// Formulas are compiled through an ExpressionCache, so requests with the same formula share one compiled expression.
+// submit() can be called by any number of threads. The destructor evaluates the requests still queued before it returns.
+class EvaluationService
+{
+  public:
+    // Constructor
+    EvaluationService(std::size_t max_batch_size = 256, unsigned int max_delay_microseconds = 100, unsigned int thread_count = 1,
+      std::size_t cache_capacity = 1024, const OperatorRegistry* registry = 0);
+
+    // Destructor
+    ~EvaluationService();
+
+    // Methods
+    std::future<EvaluationResult> submit(std::string_view, const std::map<std::string, double>&);
+    std::future<EvaluationResult> submit(const std::shared_ptr<const CompiledExpression>&, const double*);
+    unsigned long long getRequestCount() const;
+    unsigned long long getBatchCount() const;
+
+  private:
+    typedef struct Batch
+    {
+      std::shared_ptr<const CompiledExpression> compiled_;
+      std::vector<double> values_; // Variable values of the requests in slot order, one request after the other
+      std::vector<std::promise<EvaluationResult> > promises_;
+      std::chrono::steady_clock::time_point deadline_; // When the first request has waited for the maximum delay
+    } Batch;
+
+    ExpressionCache cache_;
+    std::size_t max_batch_size_;
+    std::chrono::microseconds max_delay_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::unordered_map<const CompiledExpression*, Batch*> pending_; // Batches still collecting requests
+    std::deque<Batch*> ready_; // Batches waiting for a worker
+    std::vector<std::thread> threads_;
+    std::atomic<unsigned long long> requests_;
+    std::atomic<unsigned long long> batches_;
+    bool stopping_;
+
+    // Copying would share the queues
+    EvaluationService(const EvaluationService&);
+    EvaluationService& operator=(const EvaluationService&);
+
+    void work();
+    void evaluate(Batch*, std::vector<double>*, std::vector<double>*);
+    static std::future<EvaluationResult> getFailure(const ExpressionError&);
+
+};
+
+#endif /* EVALUATIONSERVICE_H */
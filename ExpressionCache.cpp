@@ -0,0 +1,156 @@
+﻿// Includes
+#include "ExpressionCache.h"
+#include <functional>
+
+// Constructor
+// @param capacity The maximum number of cached formulas.
+// @param memory_budget The maximum memory used by the cached formulas in bytes, 0 = unlimited.
+// @param shard_count The number of independently locked parts of the cache, at most the capacity.
+// @param registry The operators and functions to use, 0 for the built-ins only.
+ExpressionCache::ExpressionCache(std::size_t capacity, std::size_t memory_budget, unsigned int shard_count, const OperatorRegistry* registry)
+{
+  this->registry_ = registry;
+  // Every shard keeps its most recently used formula, so more shards than formulas would exceed the capacity
+  if(shard_count > capacity)
+    shard_count = (unsigned int)capacity;
+  if(shard_count == 0)
+    shard_count = 1;
+  for(unsigned int i = 0; i < shard_count; i++) {
+    Shard* shard = new Shard();
+    shard->memory_ = 0;
+    shard->capacity_ = capacity / shard_count + ((i < capacity % shard_count) ? 1 : 0);
+    shard->memory_budget_ = memory_budget / shard_count + ((i < memory_budget % shard_count) ? 1 : 0);
+    this->shards_.push_back(shard);
+  }
+  this->hits_ = 0;
+  this->misses_ = 0;
+  this->evictions_ = 0;
+}
+
+// Destructor
+ExpressionCache::~ExpressionCache()
+{
+  for(unsigned int i = 0; i < this->shards_.size(); i++)
+    delete this->shards_[i];
+}
+
+// Returns the compiled expression of a formula, compiling it if it is not cached yet.
+// Invalid formulas are cached as well, so they are parsed only once. Their getError() refers to the formula without spaces.
+// @param formula The formula in infix notation.
+// @return The compiled expression, it stays valid after being evicted from the cache.
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(std::string_view formula)
+{
+  std::string key;
+  key.reserve(formula.size());
+  for(std::size_t i = 0; i < formula.size(); i++) {
+    if(formula[i] != ' ')
+      key.push_back(formula[i]);
+  }
+
+  Shard* shard = this->shards_[std::hash<std::string>()(key) % this->shards_.size()];
+  {
+    std::lock_guard<std::mutex> lock(shard->mutex_);
+    std::unordered_map<std::string_view, std::list<Entry>::iterator>::iterator it = shard->index_.find(key);
+    if(it != shard->index_.end()) {
+      shard->entries_.splice(shard->entries_.begin(), shard->entries_, it->second);
+      this->hits_.fetch_add(1, std::memory_order_relaxed);
+      return it->second->compiled_;
+    }
+  }
+  this->misses_.fetch_add(1, std::memory_order_relaxed);
+
+  // Compile without holding the lock, ShuntingYard keeps scratch memory so every thread has its own
+  static thread_local ShuntingYard parser;
+  parser.setRegistry(this->registry_);
+  std::shared_ptr<const CompiledExpression> compiled = std::make_shared<const CompiledExpression>(parser.compile(key));
+
+  std::lock_guard<std::mutex> lock(shard->mutex_);
+  std::unordered_map<std::string_view, std::list<Entry>::iterator>::iterator it = shard->index_.find(key);
+  if(it != shard->index_.end()) {
+    // Another thread has been faster
+    shard->entries_.splice(shard->entries_.begin(), shard->entries_, it->second);
+    return it->second->compiled_;
+  }
+
+  Entry entry;
+  entry.formula_.swap(key);
+  entry.compiled_ = compiled;
+  entry.memory_ = sizeof(Entry) + entry.formula_.capacity() + compiled->getMemoryUsage();
+  shard->entries_.push_front(entry);
+  shard->index_.insert(std::make_pair(std::string_view(shard->entries_.front().formula_), shard->entries_.begin()));
+  shard->memory_ += entry.memory_;
+  this->evict(shard);
+
+  return compiled;
+}
+
+// Removes all formulas from the cache, the counters are kept.
+void ExpressionCache::clear()
+{
+  for(unsigned int i = 0; i < this->shards_.size(); i++) {
+    std::lock_guard<std::mutex> lock(this->shards_[i]->mutex_);
+    this->shards_[i]->index_.clear();
+    this->shards_[i]->entries_.clear();
+    this->shards_[i]->memory_ = 0;
+  }
+}
+
+// Returns the number of cached formulas.
+// @return The number of formulas.
+std::size_t ExpressionCache::getSize()
+{
+  std::size_t size = 0;
+  for(unsigned int i = 0; i < this->shards_.size(); i++) {
+    std::lock_guard<std::mutex> lock(this->shards_[i]->mutex_);
+    size += this->shards_[i]->index_.size();
+  }
+  return size;
+}
+
+// Returns the estimated memory used by the cached formulas.
+// @return The memory in bytes.
+std::size_t ExpressionCache::getMemoryUsage()
+{
+  std::size_t memory = 0;
+  for(unsigned int i = 0; i < this->shards_.size(); i++) {
+    std::lock_guard<std::mutex> lock(this->shards_[i]->mutex_);
+    memory += this->shards_[i]->memory_;
+  }
+  return memory;
+}
+
+// Returns the number of lookups which found a cached formula.
+// @return The number of hits.
+unsigned long long ExpressionCache::getHits() const
+{
+  return this->hits_.load(std::memory_order_relaxed);
+}
+
+// Returns the number of lookups which had to compile the formula.
+// @return The number of misses.
+unsigned long long ExpressionCache::getMisses() const
+{
+  return this->misses_.load(std::memory_order_relaxed);
+}
+
+// Returns the number of formulas removed to stay within the capacity or memory budget.
+// @return The number of evictions.
+unsigned long long ExpressionCache::getEvictions() const
+{
+  return this->evictions_.load(std::memory_order_relaxed);
+}
+
+// Removes the least recently used formulas of a shard until it is within its limits.
+// The most recently used formula is always kept. Has to be called with the lock of the shard held.
+// @param shard The shard.
+void ExpressionCache::evict(Shard* shard)
+{
+  while(shard->entries_.size() > 1 && (shard->entries_.size() > shard->capacity_ ||
+    (shard->memory_budget_ > 0 && shard->memory_ > shard->memory_budget_))) {
+    Entry& entry = shard->entries_.back();
+    shard->index_.erase(std::string_view(entry.formula_));
+    shard->memory_ -= entry.memory_;
+    shard->entries_.pop_back();
+    this->evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
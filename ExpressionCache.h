@@ -0,0 +1,72 @@
+﻿#ifndef EXPRESSIONCACHE_H
+#define EXPRESSIONCACHE_H
+
+// Includes
+#include "CompiledExpression.h"
+#include "OperatorRegistry.h"
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bounded cache of compiled expressions keyed by formula text, safe to use from any number of threads.
+// Formulas are normalized by removing spaces. The cache is split into shards with their own lock and least recently
+// used list, so threads looking up different formulas rarely wait for each other. Formulas are compiled outside of
+// the locks with a parser per thread. Every shard keeps at least its most recently used formula, even if that alone
+// exceeds the memory budget of the shard; a capacity of 0 is treated as 1.
+class ExpressionCache
+{
+  public:
+    // Constructor
+    ExpressionCache(std::size_t capacity, std::size_t memory_budget = 0, unsigned int shard_count = 16, const OperatorRegistry* registry = 0);
+
+    // Destructor
+    ~ExpressionCache();
+
+    // Methods
+    std::shared_ptr<const CompiledExpression> get(std::string_view);
+    void clear();
+    std::size_t getSize();
+    std::size_t getMemoryUsage();
+    unsigned long long getHits() const;
+    unsigned long long getMisses() const;
+    unsigned long long getEvictions() const;
+
+  private:
+    typedef struct Entry
+    {
+      std::string formula_;
+      std::shared_ptr<const CompiledExpression> compiled_;
+      std::size_t memory_;
+    } Entry;
+
+    typedef struct Shard
+    {
+      std::mutex mutex_;
+      std::list<Entry> entries_; // Most recently used first
+      std::unordered_map<std::string_view, std::list<Entry>::iterator> index_; // Keys point into entries_
+      std::size_t memory_;
+      std::size_t capacity_; // Share of the total capacity
+      std::size_t memory_budget_; // Share of the total memory budget, 0 = unlimited
+    } Shard;
+
+    std::vector<Shard*> shards_;
+    const OperatorRegistry* registry_;
+    std::atomic<unsigned long long> hits_;
+    std::atomic<unsigned long long> misses_;
+    std::atomic<unsigned long long> evictions_;
+
+    // Copying would share the shards
+    ExpressionCache(const ExpressionCache&);
+    ExpressionCache& operator=(const ExpressionCache&);
+
+    void evict(Shard*);
+
+};
+
+#endif /* EXPRESSIONCACHE_H */
@@ -0,0 +1,141 @@
+﻿// Includes
+#include "ExpressionCounters.h"
+
+// Additionals
+// Shard of the current thread plus 1, 0 until the thread records its first evaluation
+static thread_local unsigned int thread_shard = 0;
+static std::atomic<unsigned int> next_shard(0);
+// Single evaluations of the current thread until the next one is timed
+static thread_local unsigned int sample_countdown = 0;
+
+// Constructor
+ExpressionCounters::ExpressionCounters()
+{
+  this->reset();
+}
+
+// Destructor
+ExpressionCounters::~ExpressionCounters()
+{
+
+}
+
+// Records a parsed formula.
+// @param nanoseconds The time spent parsing and compiling it.
+void ExpressionCounters::addParse(std::uint64_t nanoseconds)
+{
+  this->parses_.fetch_add(1, std::memory_order_relaxed);
+  this->parse_nanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+// Records a single evaluation.
+// @return True if the evaluation should be timed and passed to addEvaluationSample().
+bool ExpressionCounters::addEvaluation()
+{
+  getShard(this->shards_)->evaluations_.fetch_add(1, std::memory_order_relaxed);
+  if(sample_countdown == 0) {
+    sample_countdown = SAMPLE_INTERVAL - 1;
+    return true;
+  }
+  sample_countdown--;
+  return false;
+}
+
+// Records the time of a single evaluation selected by addEvaluation(), which stands for SAMPLE_INTERVAL evaluations.
+// @param nanoseconds The time spent calculating it.
+void ExpressionCounters::addEvaluationSample(std::uint64_t nanoseconds)
+{
+  getShard(this->shards_)->evaluation_nanoseconds_.fetch_add(nanoseconds * SAMPLE_INTERVAL, std::memory_order_relaxed);
+}
+
+// Records evaluations.
+// @param count The number of results calculated, e.g. the rows of a batch.
+// @param nanoseconds The time spent calculating them.
+void ExpressionCounters::addEvaluations(std::uint64_t count, std::uint64_t nanoseconds)
+{
+  Shard* shard = getShard(this->shards_);
+  shard->evaluations_.fetch_add(count, std::memory_order_relaxed);
+  shard->evaluation_nanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+// Records an error.
+// @param kind The kind of the error.
+void ExpressionCounters::addError(ErrorKind kind)
+{
+  this->errors_[kind].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Returns the number of parsed formulas, including the invalid ones.
+// @return The number of parsed formulas.
+std::uint64_t ExpressionCounters::getParses() const
+{
+  return this->parses_.load(std::memory_order_relaxed);
+}
+
+// Returns the total time spent parsing and compiling.
+// @return The time in nanoseconds.
+std::uint64_t ExpressionCounters::getParseNanoseconds() const
+{
+  return this->parse_nanoseconds_.load(std::memory_order_relaxed);
+}
+
+// Returns the number of calculated results.
+// @return The number of results.
+std::uint64_t ExpressionCounters::getEvaluations() const
+{
+  std::uint64_t evaluations = 0;
+  for(unsigned int i = 0; i < SHARD_COUNT; i++)
+    evaluations += this->shards_[i].evaluations_.load(std::memory_order_relaxed);
+  return evaluations;
+}
+
+// Returns the total time spent evaluating, estimated from samples for single evaluations.
+// @return The time in nanoseconds.
+std::uint64_t ExpressionCounters::getEvaluationNanoseconds() const
+{
+  std::uint64_t nanoseconds = 0;
+  for(unsigned int i = 0; i < SHARD_COUNT; i++)
+    nanoseconds += this->shards_[i].evaluation_nanoseconds_.load(std::memory_order_relaxed);
+  return nanoseconds;
+}
+
+// Returns the number of errors of one kind.
+// @param kind The kind of the errors.
+// @return The number of errors.
+std::uint64_t ExpressionCounters::getErrors(ErrorKind kind) const
+{
+  return this->errors_[kind].load(std::memory_order_relaxed);
+}
+
+// Returns the number of errors of all kinds.
+// @return The number of errors.
+std::uint64_t ExpressionCounters::getErrors() const
+{
+  std::uint64_t errors = 0;
+  for(unsigned int i = ERROR_NONE + 1; i < ERROR_KIND_COUNT; i++)
+    errors += this->errors_[i].load(std::memory_order_relaxed);
+  return errors;
+}
+
+// Sets all counters to 0. Recordings of other threads at the same time may be lost or kept.
+void ExpressionCounters::reset()
+{
+  this->parses_.store(0, std::memory_order_relaxed);
+  this->parse_nanoseconds_.store(0, std::memory_order_relaxed);
+  for(unsigned int i = 0; i < ERROR_KIND_COUNT; i++)
+    this->errors_[i].store(0, std::memory_order_relaxed);
+  for(unsigned int i = 0; i < SHARD_COUNT; i++) {
+    this->shards_[i].evaluations_.store(0, std::memory_order_relaxed);
+    this->shards_[i].evaluation_nanoseconds_.store(0, std::memory_order_relaxed);
+  }
+}
+
+// Returns the shard of the current thread, threads are assigned to the shards in turn.
+// @param shards The shards of the counters.
+// @return The shard.
+ExpressionCounters::Shard* ExpressionCounters::getShard(Shard* shards)
+{
+  if(thread_shard == 0)
+    thread_shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT + 1;
+  return &shards[thread_shard - 1];
+}
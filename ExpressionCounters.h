@@ -0,0 +1,74 @@
+﻿#ifndef EXPRESSIONCOUNTERS_H
+#define EXPRESSIONCOUNTERS_H
+
+// Includes
+#include "ShuntingYard.h"
+#include <atomic>
+#include <cstdint>
+
+// Usage statistics of parsers and compiled expressions.
+// A ShuntingYard or CompiledExpression records into the counters set with setCounters(); expressions compiled by a
+// parser inherit its counters. The counters are relaxed atomics, so any number of threads can record into the same
+// instance. Evaluations are counted in SHARD_COUNT shards on separate cache lines, each thread records into its own
+// shard and the getters add them up, so threads evaluating in tight loops don't contend. Single evaluations are too
+// short to read the clock twice each; only every SAMPLE_INTERVAL-th one of a thread is timed and counts for
+// SAMPLE_INTERVAL evaluations, so their time is an estimate, while batches are always timed. Nothing is recorded unless
+// the library is built with EXPRESSION_COUNTERS defined, without it the instrumentation is compiled out entirely.
+class ExpressionCounters
+{
+  public:
+    // Constructor
+    ExpressionCounters();
+
+    // Destructor
+    ~ExpressionCounters();
+
+    // Methods
+    void addParse(std::uint64_t);
+    bool addEvaluation();
+    void addEvaluationSample(std::uint64_t);
+    void addEvaluations(std::uint64_t, std::uint64_t);
+    void addError(ErrorKind);
+    std::uint64_t getParses() const;
+    std::uint64_t getParseNanoseconds() const;
+    std::uint64_t getEvaluations() const;
+    std::uint64_t getEvaluationNanoseconds() const;
+    std::uint64_t getErrors(ErrorKind) const;
+    std::uint64_t getErrors() const;
+    void reset();
+    static constexpr bool isEnabled()
+    {
+#ifdef EXPRESSION_COUNTERS
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    // Shards of the evaluation counters, threads beyond this number share them
+    static const unsigned int SHARD_COUNT = 16;
+    // One in this number of single evaluations per thread is timed
+    static const unsigned int SAMPLE_INTERVAL = 64;
+
+  private:
+    typedef struct Shard
+    {
+      alignas(64) std::atomic<std::uint64_t> evaluations_;
+      std::atomic<std::uint64_t> evaluation_nanoseconds_;
+    } Shard;
+
+    // Parsing and evaluation usually happen on different threads, so they do not share a cache line
+    alignas(64) std::atomic<std::uint64_t> parses_;
+    std::atomic<std::uint64_t> parse_nanoseconds_;
+    std::atomic<std::uint64_t> errors_[ERROR_KIND_COUNT];
+    Shard shards_[SHARD_COUNT];
+
+    static Shard* getShard(Shard*);
+
+    // Counters belong to one place
+    ExpressionCounters(const ExpressionCounters&);
+    ExpressionCounters& operator=(const ExpressionCounters&);
+
+};
+
+#endif /* EXPRESSIONCOUNTERS_H */
@@ -0,0 +1,280 @@
+﻿// Includes
+#include "ExpressionDag.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Constructor
+ExpressionDag::ExpressionDag()
+{
+  this->tree_node_count_ = 0;
+}
+
+// Destructor
+ExpressionDag::~ExpressionDag()
+{
+
+}
+
+// Builds the DAG of a compiled expression.
+// @param compiled The expression.
+// @return False if the expression is invalid or already contains shared values.
+bool ExpressionDag::build(const CompiledExpression& compiled)
+{
+  this->nodes_.clear();
+  this->index_.clear();
+  this->variables_.clear();
+  this->tree_node_count_ = 0;
+  this->roots_.clear();
+  return this->add(compiled);
+}
+
+// Adds another compiled expression to the DAG as an additional root.
+// Variables are matched by name, so the slots of the DAG may differ from the slots of the expression.
+// @param compiled The expression.
+// @return False if the expression is invalid or already contains shared values.
+bool ExpressionDag::add(const CompiledExpression& compiled)
+{
+  if(!compiled.valid_ || compiled.temp_count_ > 0)
+    return false;
+
+  std::vector<unsigned int> slots(compiled.variables_.size());
+  for(unsigned int i = 0; i < compiled.variables_.size(); i++) {
+    std::vector<std::string>::iterator var_it = std::find(this->variables_.begin(), this->variables_.end(), compiled.variables_[i]);
+    slots[i] = var_it - this->variables_.begin();
+    if(var_it == this->variables_.end())
+      this->variables_.push_back(compiled.variables_[i]);
+  }
+
+  std::vector<int> stack;
+  for(std::vector<Instruction>::const_iterator it = compiled.instructions_.begin(); it != compiled.instructions_.end(); it++) {
+    int operands[CompiledExpression::MAX_CALL_ARGUMENTS];
+    for(int i = CompiledExpression::getArity(*it) - 1; i >= 0; i--) {
+      operands[i] = stack.back();
+      stack.pop_back();
+    }
+    if(it->opcode_ == OP_VARIABLE) {
+      Instruction instruction = *it;
+      instruction.index_ = slots[it->index_];
+      stack.push_back(this->addNode(instruction, operands));
+    }
+    else {
+      stack.push_back(this->addNode(*it, operands));
+    }
+  }
+  this->tree_node_count_ += compiled.instructions_.size();
+  this->roots_.push_back(stack.back());
+  this->nodes_[stack.back()].uses_++;
+
+  return true;
+}
+
+// Replaces the instructions of an expression by the lowered DAG.
+// @param compiled The expression the DAG has been built from.
+// @return The number of eliminated instructions, 0 if the DAG does not have exactly one root.
+int ExpressionDag::eliminateCommonSubexpressions(CompiledExpression* compiled)
+{
+  if(this->roots_.size() != 1)
+    return 0;
+
+  std::vector<Instruction> instructions;
+  unsigned int temp_count = this->lower(&instructions);
+
+  int eliminated = (int)compiled->instructions_.size() - (int)instructions.size();
+  unsigned int depth = 0;
+  compiled->max_depth_ = 0;
+  for(std::vector<Instruction>::const_iterator it = instructions.begin(); it != instructions.end(); it++) {
+    depth = depth - CompiledExpression::getArity(*it) + 1;
+    if(depth > compiled->max_depth_)
+      compiled->max_depth_ = depth;
+  }
+  compiled->instructions_.swap(instructions);
+  compiled->variables_ = this->variables_;
+  compiled->temp_count_ = temp_count;
+
+  return eliminated;
+}
+
+// Lowers the DAG into instructions which leave the value of every root on the stack, in the order of the roots.
+// A shared node is calculated the first time it is needed and stored, all later uses load the stored value.
+// Variables and constants are never stored since loading them is as cheap as loading a stored value.
+// @param instructions Receives the instructions.
+// @return The number of stored values.
+unsigned int ExpressionDag::lower(std::vector<Instruction>* instructions) const
+{
+  std::vector<int> temps(this->nodes_.size(), -1);
+  unsigned int temp_count = 0;
+
+  for(std::vector<int>::const_iterator root_it = this->roots_.begin(); root_it != this->roots_.end(); root_it++) {
+    // Iterative post-order traversal, generated formulas can be nested too deeply for recursion
+    std::vector<std::pair<int, int> > stack; // Node and number of children already visited
+    stack.push_back(std::make_pair(*root_it, 0));
+    while(!stack.empty()) {
+      int current = stack.back().first;
+      const Node& node = this->nodes_[current];
+      bool shared = node.uses_ > 1 && CompiledExpression::getArity(node.instruction_) > 0;
+      if(shared && temps[current] != -1) {
+        Instruction load;
+        load.opcode_ = OP_LOAD;
+        load.index_ = temps[current];
+        load.value_ = 0;
+        instructions->push_back(load);
+        stack.pop_back();
+      }
+      else if(stack.back().second < CompiledExpression::getArity(node.instruction_)) {
+        int child = node.children_[stack.back().second];
+        stack.back().second++;
+        stack.push_back(std::make_pair(child, 0));
+      }
+      else {
+        instructions->push_back(node.instruction_);
+        if(shared) {
+          Instruction store;
+          store.opcode_ = OP_STORE;
+          store.index_ = temps[current] = temp_count++;
+          store.value_ = 0;
+          instructions->push_back(store);
+        }
+        stack.pop_back();
+      }
+    }
+  }
+
+  return temp_count;
+}
+
+// Prints the nodes of the DAG and how often they are shared.
+void ExpressionDag::printDag()
+{
+  if(this->roots_.empty()) {
+    std::cout << "[ERROR] No nodes could be found." << std::endl;
+    return;
+  }
+
+  std::cout << "------------------------------------" << std::endl;
+  std::cout << "Number of tree nodes: " << this->tree_node_count_ << std::endl;
+  std::cout << "Number of DAG nodes: " << this->nodes_.size() << std::endl;
+  std::cout << "Number of shared nodes: " << this->getSharedNodeCount() << std::endl;
+  std::cout << "------------------------------------" << std::endl;
+  for(unsigned int i = 0; i < this->nodes_.size(); i++) {
+    const Node& node = this->nodes_[i];
+    std::ostringstream line;
+    line << "n" << i << " =";
+    if(node.instruction_.opcode_ == OP_CONSTANT)
+      line << " " << node.instruction_.value_;
+    else if(node.instruction_.opcode_ == OP_VARIABLE)
+      line << " " << this->variables_[node.instruction_.index_];
+    else if(node.instruction_.opcode_ == OP_CALL || node.instruction_.opcode_ == OP_CALL_IMPURE)
+      line << " call";
+    else
+      line << " " << CompiledExpression::getSymbol(node.instruction_.opcode_);
+    for(int c = 0; c < CompiledExpression::getArity(node.instruction_); c++)
+      line << " n" << node.children_[c];
+    if(node.uses_ > 1)
+      line << " [used " << node.uses_ << "x]";
+    if(std::find(this->roots_.begin(), this->roots_.end(), (int)i) != this->roots_.end())
+      line << " [root]";
+    std::cout << line.str() << std::endl;
+  }
+}
+
+// Returns the number of nodes of the expression as a tree.
+// @return The number of instructions the DAG has been built from.
+unsigned int ExpressionDag::getTreeNodeCount() const
+{
+  return this->tree_node_count_;
+}
+
+// Returns the number of distinct nodes.
+// @return The number of nodes of the DAG.
+unsigned int ExpressionDag::getNodeCount() const
+{
+  return this->nodes_.size();
+}
+
+// Returns the number of nodes which are used more than once.
+// @return The number of shared nodes.
+unsigned int ExpressionDag::getSharedNodeCount() const
+{
+  unsigned int count = 0;
+  for(std::vector<Node>::const_iterator it = this->nodes_.begin(); it != this->nodes_.end(); it++) {
+    if(it->uses_ > 1)
+      count++;
+  }
+  return count;
+}
+
+// Returns the number of expressions added to the DAG.
+// @return The number of roots.
+unsigned int ExpressionDag::getRootCount() const
+{
+  return this->roots_.size();
+}
+
+// Returns the variables of all added expressions.
+// @return The variable names, the position of a name is its slot index in the lowered instructions.
+const std::vector<std::string>& ExpressionDag::getVariables() const
+{
+  return this->variables_;
+}
+
+// Returns the existing node for an instruction and its operands or creates a new one.
+// Calls of impure functions always get a new node, every call may give a different result.
+// @param instruction The instruction of the node.
+// @param operands The operands, as many as the arity of the instruction.
+// @return The index of the node.
+int ExpressionDag::addNode(const Instruction& instruction, const int* operands)
+{
+  int arity = CompiledExpression::getArity(instruction);
+  NodeKey key;
+  key.opcode_ = instruction.opcode_;
+  key.index_ = instruction.index_;
+  key.value_bits_ = 0;
+  std::memcpy(&key.value_bits_, &instruction.value_, sizeof(instruction.value_));
+  for(unsigned int i = 0; i < CompiledExpression::MAX_CALL_ARGUMENTS; i++)
+    key.children_[i] = ((int)i < arity) ? operands[i] : -1;
+
+  bool shareable = instruction.opcode_ != OP_CALL_IMPURE;
+  if(shareable) {
+    std::unordered_map<NodeKey, int, NodeKeyHash>::iterator it = this->index_.find(key);
+    if(it != this->index_.end())
+      return it->second;
+  }
+
+  Node node;
+  node.instruction_ = instruction;
+  std::memcpy(node.children_, key.children_, sizeof(node.children_));
+  node.uses_ = 0;
+  this->nodes_.push_back(node);
+  int node_index = this->nodes_.size() - 1;
+  if(shareable)
+    this->index_.insert(std::make_pair(key, node_index));
+  for(int i = 0; i < arity; i++)
+    this->nodes_[operands[i]].uses_++;
+
+  return node_index;
+}
+
+// Compares two node keys.
+// @param other The key to compare with.
+// @return True if both keys describe the same node.
+bool ExpressionDag::NodeKey::operator==(const NodeKey& other) const
+{
+  return this->opcode_ == other.opcode_ && this->index_ == other.index_ && this->value_bits_ == other.value_bits_ &&
+    std::memcmp(this->children_, other.children_, sizeof(this->children_)) == 0;
+}
+
+// Calculates the hash of a node key.
+// @param key The key.
+// @return The hash value.
+std::size_t ExpressionDag::NodeKeyHash::operator()(const NodeKey& key) const
+{
+  std::size_t hash = key.opcode_;
+  hash = hash * 31 + key.index_;
+  hash = hash * 31 + (std::size_t)(key.value_bits_ ^ (key.value_bits_ >> 32));
+  for(unsigned int i = 0; i < CompiledExpression::MAX_CALL_ARGUMENTS && key.children_[i] != -1; i++)
+    hash = hash * 31 + (std::size_t)key.children_[i];
+  return hash;
+}
@@ -0,0 +1,67 @@
+﻿#ifndef EXPRESSIONDAG_H
+#define EXPRESSIONDAG_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Hash-consed representation of a compiled expression, identical subexpressions are represented by a single node.
+// The DAG can be lowered back into the expression so that every shared node is calculated once per evaluation.
+// Several expressions can be added to one DAG, which then has one root per expression and shares their variables and
+// common subexpressions.
+class ExpressionDag
+{
+  public:
+    // Constructor
+    ExpressionDag();
+
+    // Destructor
+    ~ExpressionDag();
+
+    // Methods
+    bool build(const CompiledExpression&);
+    bool add(const CompiledExpression&);
+    int eliminateCommonSubexpressions(CompiledExpression*);
+    unsigned int lower(std::vector<Instruction>*) const;
+    void printDag();
+    unsigned int getTreeNodeCount() const;
+    unsigned int getNodeCount() const;
+    unsigned int getSharedNodeCount() const;
+    unsigned int getRootCount() const;
+    const std::vector<std::string>& getVariables() const;
+
+  private:
+    typedef struct Node
+    {
+      Instruction instruction_;
+      int children_[CompiledExpression::MAX_CALL_ARGUMENTS]; // -1 if not used
+      unsigned int uses_; // Number of parents, +1 for every root
+    } Node;
+
+    typedef struct NodeKey
+    {
+      OpCode opcode_;
+      unsigned int index_;
+      unsigned long long value_bits_; // Value of constants, kernel of calls
+      int children_[CompiledExpression::MAX_CALL_ARGUMENTS];
+      bool operator==(const NodeKey&) const;
+    } NodeKey;
+
+    typedef struct NodeKeyHash
+    {
+      std::size_t operator()(const NodeKey&) const;
+    } NodeKeyHash;
+
+    std::vector<Node> nodes_;
+    std::unordered_map<NodeKey, int, NodeKeyHash> index_;
+    std::vector<std::string> variables_;
+    unsigned int tree_node_count_;
+    std::vector<int> roots_;
+
+    int addNode(const Instruction&, const int*);
+
+};
+
+#endif /* EXPRESSIONDAG_H */
@@ -0,0 +1,460 @@
+﻿// Includes
+#include "ExpressionFile.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EXPRESSION_FILE_MMAP_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Additionals
+static const char MAGIC[8] = {'S', 'Y', 'E', 'X', 'P', 'R', 0, 0};
+static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Rounds an offset up to a multiple of an alignment.
+// @param offset The offset.
+// @param alignment The alignment.
+// @return The aligned offset.
+static std::uint64_t alignOffset(std::uint64_t offset, std::uint64_t alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Checks whether an array lies within a file.
+// @param offset The offset of the array.
+// @param count The number of elements.
+// @param element_size The size of an element.
+// @param alignment The required alignment of the offset.
+// @param file_size The size of the file.
+// @return True if the array is aligned and ends within the file.
+static bool isInside(std::uint64_t offset, std::uint64_t count, std::uint64_t element_size, std::uint64_t alignment, std::uint64_t file_size)
+{
+  if(offset % alignment != 0 || offset > file_size)
+    return false;
+  return count <= (file_size - offset) / element_size;
+}
+
+// Adds a name to the name table unless it is already part of it.
+// @param name The name.
+// @param indices The indices of the names added so far.
+// @param names The offsets of the names in the strings.
+// @param strings The names, each terminated by 0.
+// @return The index of the name.
+static std::uint32_t addName(const std::string& name, std::map<std::string, std::uint32_t>* indices, std::vector<std::uint32_t>* names, std::string* strings)
+{
+  std::map<std::string, std::uint32_t>::iterator it = indices->find(name);
+  if(it != indices->end())
+    return it->second;
+
+  std::uint32_t index = names->size();
+  indices->insert(std::make_pair(name, index));
+  names->push_back(strings->size());
+  strings->append(name);
+  strings->push_back('\0');
+  return index;
+}
+
+// Constructor
+ExpressionFile::ExpressionFile()
+{
+  this->data_ = 0;
+  this->size_ = 0;
+  this->mapped_ = false;
+  this->header_ = 0;
+  this->records_ = 0;
+  this->instructions_ = 0;
+  this->variables_ = 0;
+  this->names_ = 0;
+  this->strings_ = 0;
+  this->setError(ERROR_NONE, ShuntingYard::NO_POSITION);
+}
+
+// Destructor
+ExpressionFile::~ExpressionFile()
+{
+  this->close();
+}
+
+// Writes compiled expressions into a file.
+// @param path The path of the file.
+// @param expressions The expressions, all of them have to be valid.
+// @param registry The registry of the functions called by the expressions, 0 for the built-ins only.
+// @return ERROR_NONE, the error of an invalid expression, ERROR_UNREGISTERED if an expression calls a function which is
+// not part of the registry or ERROR_FILE.
+ErrorKind ExpressionFile::write(const char* path, const std::vector<CompiledExpression>& expressions, const OperatorRegistry* registry)
+{
+  if(registry == 0)
+    registry = &OperatorRegistry::getDefault();
+
+  std::vector<Record> records;
+  std::vector<Instruction> instructions;
+  std::vector<std::uint32_t> variables;
+  std::vector<std::uint32_t> names;
+  std::string strings;
+  std::map<std::string, std::uint32_t> name_indices;
+  records.reserve(expressions.size());
+  for(unsigned int i = 0; i < expressions.size(); i++) {
+    const CompiledExpression& expression = expressions[i];
+    if(!expression.isValid()) {
+      // Error: nothing to store
+      return expression.getError().kind_;
+    }
+
+    Record record = {};
+    record.instruction_begin_ = instructions.size();
+    record.instruction_count_ = expression.instructions_.size();
+    record.max_depth_ = expression.max_depth_;
+    record.temp_count_ = expression.temp_count_;
+    record.variable_begin_ = variables.size();
+    record.variable_count_ = expression.variables_.size();
+    for(unsigned int v = 0; v < expression.variables_.size(); v++)
+      variables.push_back(addName(expression.variables_[v], &name_indices, &names, &strings));
+
+    for(std::vector<Instruction>::const_iterator it = expression.instructions_.begin(); it != expression.instructions_.end(); it++) {
+      // Only the fields used by the opcode are written, the rest is 0
+      Instruction instruction;
+      std::memset(&instruction, 0, sizeof(Instruction));
+      instruction.opcode_ = it->opcode_;
+      instruction.index_ = it->index_;
+      if(it->opcode_ == OP_CONSTANT) {
+        instruction.value_ = it->value_;
+      }
+      else if(it->opcode_ == OP_CALL || it->opcode_ == OP_CALL_IMPURE) {
+        int definition = registry->findKernel(it->kernel_, it->opcode_);
+        if(definition == -1) {
+          // Error: the function has no name
+          return ERROR_UNREGISTERED;
+        }
+        std::uint64_t name = addName(registry->getDefinition(definition).name_, &name_indices, &names, &strings);
+        std::memcpy(&instruction.kernel_, &name, sizeof(name));
+        record.call_count_++;
+      }
+      instructions.push_back(instruction);
+    }
+    records.push_back(record);
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic_, MAGIC, sizeof(MAGIC));
+  header.version_ = VERSION;
+  header.byte_order_ = BYTE_ORDER_MARK;
+  header.instruction_size_ = sizeof(Instruction);
+  header.expression_count_ = records.size();
+  header.records_offset_ = sizeof(Header);
+  header.instructions_offset_ = alignOffset(header.records_offset_ + records.size() * sizeof(Record), sizeof(Instruction));
+  header.instruction_count_ = instructions.size();
+  header.variables_offset_ = header.instructions_offset_ + instructions.size() * sizeof(Instruction);
+  header.variable_count_ = variables.size();
+  header.names_offset_ = header.variables_offset_ + variables.size() * sizeof(std::uint32_t);
+  header.name_count_ = names.size();
+  header.strings_offset_ = header.names_offset_ + names.size() * sizeof(std::uint32_t);
+  header.strings_size_ = strings.size();
+  header.file_size_ = header.strings_offset_ + strings.size();
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if(!out) {
+    // Error: cannot create the file
+    return ERROR_FILE;
+  }
+  static const char padding[sizeof(Instruction)] = {};
+  out.write((const char*)&header, sizeof(Header));
+  out.write((const char*)records.data(), records.size() * sizeof(Record));
+  out.write(padding, header.instructions_offset_ - header.records_offset_ - records.size() * sizeof(Record));
+  out.write((const char*)instructions.data(), instructions.size() * sizeof(Instruction));
+  out.write((const char*)variables.data(), variables.size() * sizeof(std::uint32_t));
+  out.write((const char*)names.data(), names.size() * sizeof(std::uint32_t));
+  out.write(strings.data(), strings.size());
+  out.close();
+  if(!out) {
+    // Error: incomplete file
+    return ERROR_FILE;
+  }
+  return ERROR_NONE;
+}
+
+// Maps a file written by write() into memory.
+// The file is mapped privately, so resolving the calls of registered functions only copies the pages containing them.
+// @param path The path of the file.
+// @param registry The registry containing the functions called by the expressions, 0 for the built-ins only.
+// @return ERROR_NONE, ERROR_FILE, ERROR_INVALID_FILE, ERROR_INCOMPATIBLE_FILE or ERROR_UNREGISTERED, see also
+// getErrorExpression().
+ErrorKind ExpressionFile::open(const char* path, const OperatorRegistry* registry)
+{
+  this->close();
+  this->setError(ERROR_NONE, ShuntingYard::NO_POSITION);
+#ifdef EXPRESSION_FILE_MMAP_SUPPORTED
+  int fd = ::open(path, O_RDONLY);
+  struct stat info;
+  if(fd != -1 && fstat(fd, &info) == 0 && info.st_size > 0) {
+    void* data = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(data != MAP_FAILED) {
+      this->data_ = (char*)data;
+      this->size_ = info.st_size;
+      this->mapped_ = true;
+    }
+  }
+  if(fd != -1)
+    ::close(fd);
+#endif
+  if(this->data_ == 0) {
+    // Read the file instead, e.g. if it cannot be mapped
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    std::streamoff size = in ? (std::streamoff)in.tellg() : -1;
+    if(size > 0) {
+      this->data_ = new char[size];
+      this->size_ = size;
+      in.seekg(0);
+      if(!in.read(this->data_, size))
+        this->close();
+    }
+  }
+  if(this->data_ == 0) {
+    // Error: no such file
+    return this->setError(ERROR_FILE, ShuntingYard::NO_POSITION);
+  }
+
+  if(this->validate((registry != 0) ? registry : &OperatorRegistry::getDefault()) != ERROR_NONE) {
+    this->close();
+    return this->error_;
+  }
+  return ERROR_NONE;
+}
+
+// Unmaps the file, evaluating is no longer possible afterwards.
+void ExpressionFile::close()
+{
+  if(this->data_ != 0) {
+#ifdef EXPRESSION_FILE_MMAP_SUPPORTED
+    if(this->mapped_)
+      munmap(this->data_, this->size_);
+    else
+      delete[] this->data_;
+#else
+    delete[] this->data_;
+#endif
+  }
+  this->data_ = 0;
+  this->size_ = 0;
+  this->mapped_ = false;
+  this->header_ = 0;
+  this->records_ = 0;
+  this->instructions_ = 0;
+  this->variables_ = 0;
+  this->names_ = 0;
+  this->strings_ = 0;
+}
+
+// Checks whether a file has been opened successfully.
+// @return True if the expressions can be evaluated.
+bool ExpressionFile::isOpen() const
+{
+  return this->header_ != 0;
+}
+
+// Returns the number of expressions in the file.
+// @return The number of expressions.
+unsigned int ExpressionFile::getExpressionCount() const
+{
+  return (this->header_ != 0) ? this->header_->expression_count_ : 0;
+}
+
+// Returns the number of variables of an expression.
+// @param index The index of the expression.
+// @return The number of variables.
+unsigned int ExpressionFile::getVariableCount(unsigned int index) const
+{
+  return (index < this->getExpressionCount()) ? this->records_[index].variable_count_ : 0;
+}
+
+// Returns the name of a variable of an expression without copying it.
+// @param index The index of the expression.
+// @param slot The slot of the variable.
+// @return The name, empty if there is no such variable.
+std::string_view ExpressionFile::getVariable(unsigned int index, unsigned int slot) const
+{
+  if(slot >= this->getVariableCount(index))
+    return std::string_view();
+  return std::string_view(this->strings_ + this->names_[this->variables_[this->records_[index].variable_begin_ + slot]]);
+}
+
+// Returns the variables of an expression in slot order.
+// @param index The index of the expression.
+// @return The variable names.
+std::vector<std::string> ExpressionFile::getVariables(unsigned int index) const
+{
+  std::vector<std::string> variables;
+  for(unsigned int slot = 0; slot < this->getVariableCount(index); slot++)
+    variables.push_back(std::string(this->getVariable(index, slot)));
+  return variables;
+}
+
+// Evaluates an expression directly from the mapped file.
+// @param index The index of the expression.
+// @param values An array containing a value for each variable of the expression.
+// @return The result of the formula or 0 if there is no such expression.
+double ExpressionFile::evaluate(unsigned int index, const double* values) const
+{
+  if(index >= this->getExpressionCount())
+    return 0;
+
+  const Record& record = this->records_[index];
+  const Instruction* code = this->instructions_ + record.instruction_begin_;
+  if((std::uint64_t)record.max_depth_ + record.temp_count_ <= CompiledExpression::STACK_SIZE) {
+    double stack[CompiledExpression::STACK_SIZE];
+    return CompiledExpression::execute(code, code + record.instruction_count_, values, stack, stack + record.max_depth_);
+  }
+  std::vector<double> stack((std::size_t)record.max_depth_ + record.temp_count_);
+  return CompiledExpression::execute(code, code + record.instruction_count_, values, &stack[0], &stack[0] + record.max_depth_);
+}
+
+// Copies an expression out of the file, e.g. for the batch evaluation or a JitExpression.
+// @param index The index of the expression.
+// @return The compiled expression, invalid if there is no such expression.
+CompiledExpression ExpressionFile::getExpression(unsigned int index) const
+{
+  CompiledExpression compiled;
+  if(index >= this->getExpressionCount())
+    return compiled;
+
+  const Record& record = this->records_[index];
+  const Instruction* code = this->instructions_ + record.instruction_begin_;
+  compiled.instructions_.assign(code, code + record.instruction_count_);
+  compiled.variables_ = this->getVariables(index);
+  compiled.max_depth_ = record.max_depth_;
+  compiled.temp_count_ = record.temp_count_;
+  compiled.valid_ = true;
+  compiled.error_.kind_ = ERROR_NONE;
+  compiled.error_.position_ = ShuntingYard::NO_POSITION;
+  return compiled;
+}
+
+// Returns the error of the last call of open().
+// @return The kind of the error, ERROR_NONE if the file has been opened.
+ErrorKind ExpressionFile::getError() const
+{
+  return this->error_;
+}
+
+// Returns the expression which made the last call of open() fail, if the error belongs to one expression.
+// @return The index of the expression, ShuntingYard::NO_POSITION if there is none.
+unsigned int ExpressionFile::getErrorExpression() const
+{
+  return this->error_expression_;
+}
+
+// Checks the layout of the file and the instructions of every expression, and resolves the calls of registered
+// functions. The file may come from anywhere, so nothing is trusted.
+// @param registry The registry containing the functions called by the expressions.
+// @return The error, which is recorded as well.
+ErrorKind ExpressionFile::validate(const OperatorRegistry* registry)
+{
+  const Header* header = (const Header*)this->data_;
+  if(this->size_ < sizeof(Header) || std::memcmp(header->magic_, MAGIC, sizeof(MAGIC)) != 0) {
+    return this->setError(ERROR_INVALID_FILE, ShuntingYard::NO_POSITION);
+  }
+  if(header->version_ != VERSION || header->byte_order_ != BYTE_ORDER_MARK || header->instruction_size_ != sizeof(Instruction)) {
+    return this->setError(ERROR_INCOMPATIBLE_FILE, ShuntingYard::NO_POSITION);
+  }
+  if(header->file_size_ != this->size_ ||
+    !isInside(header->records_offset_, header->expression_count_, sizeof(Record), alignof(Record), this->size_) ||
+    !isInside(header->instructions_offset_, header->instruction_count_, sizeof(Instruction), alignof(Instruction), this->size_) ||
+    !isInside(header->variables_offset_, header->variable_count_, sizeof(std::uint32_t), alignof(std::uint32_t), this->size_) ||
+    !isInside(header->names_offset_, header->name_count_, sizeof(std::uint32_t), alignof(std::uint32_t), this->size_) ||
+    !isInside(header->strings_offset_, header->strings_size_, 1, 1, this->size_) ||
+    (header->strings_size_ > 0 && this->data_[header->strings_offset_ + header->strings_size_ - 1] != '\0')) {
+    return this->setError(ERROR_INVALID_FILE, ShuntingYard::NO_POSITION);
+  }
+
+  const Record* records = (const Record*)(this->data_ + header->records_offset_);
+  Instruction* instructions = (Instruction*)(this->data_ + header->instructions_offset_);
+  const std::uint32_t* variables = (const std::uint32_t*)(this->data_ + header->variables_offset_);
+  const std::uint32_t* names = (const std::uint32_t*)(this->data_ + header->names_offset_);
+  const char* strings = this->data_ + header->strings_offset_;
+  for(std::uint64_t i = 0; i < header->name_count_; i++) {
+    if(names[i] >= header->strings_size_) {
+      return this->setError(ERROR_INVALID_FILE, ShuntingYard::NO_POSITION);
+    }
+  }
+
+  for(unsigned int e = 0; e < header->expression_count_; e++) {
+    const Record& record = records[e];
+    if(record.instruction_begin_ > header->instruction_count_ || record.instruction_count_ == 0 ||
+      record.instruction_count_ > header->instruction_count_ - record.instruction_begin_ ||
+      (std::uint64_t)record.variable_begin_ + record.variable_count_ > header->variable_count_ ||
+      record.max_depth_ > record.instruction_count_ || record.temp_count_ > record.instruction_count_) {
+      return this->setError(ERROR_INVALID_FILE, e);
+    }
+    for(unsigned int v = 0; v < record.variable_count_; v++) {
+      if(variables[record.variable_begin_ + v] >= header->name_count_) {
+        return this->setError(ERROR_INVALID_FILE, e);
+      }
+    }
+
+    // Same stack effect check as when compiling, so the interpreter can run the instructions without checks
+    unsigned int depth = 0;
+    unsigned int max_depth = 0;
+    unsigned int call_count = 0;
+    Instruction* end = instructions + record.instruction_begin_ + record.instruction_count_;
+    for(Instruction* it = instructions + record.instruction_begin_; it != end; it++) {
+      std::uint32_t opcode;
+      std::memcpy(&opcode, &it->opcode_, sizeof(opcode));
+      bool valid = opcode <= OP_CALL_IMPURE;
+      if(opcode == OP_VARIABLE)
+        valid = it->index_ < record.variable_count_;
+      else if(opcode == OP_LOAD || opcode == OP_STORE)
+        valid = it->index_ < record.temp_count_;
+      else if(opcode == OP_CALL || opcode == OP_CALL_IMPURE) {
+        std::uint64_t name;
+        std::memcpy(&name, &it->kernel_, sizeof(name));
+        valid = it->index_ <= CompiledExpression::MAX_CALL_ARGUMENTS && name < header->name_count_;
+        if(valid) {
+          // Function names consist of letters, operators never contain any
+          const char* symbol = strings + names[name];
+          int index = isalpha((unsigned char)symbol[0]) ? registry->findFunction(symbol) : registry->findOperator(symbol);
+          if(index == -1 || registry->getDefinition(index).opcode_ != (OpCode)opcode ||
+            (registry->getDefinition(index).arity_ != OperatorRegistry::VARIADIC && registry->getDefinition(index).arity_ != (int)it->index_)) {
+            return this->setError(ERROR_UNREGISTERED, e);
+          }
+          it->kernel_ = registry->getDefinition(index).kernel_;
+          call_count++;
+        }
+      }
+      unsigned int arity = valid ? CompiledExpression::getArity(*it) : 0;
+      if(!valid || depth < arity) {
+        return this->setError(ERROR_INVALID_FILE, e);
+      }
+      depth = depth - arity + 1;
+      if(depth > max_depth)
+        max_depth = depth;
+    }
+    if(depth != 1 || max_depth > record.max_depth_ || call_count != record.call_count_) {
+      return this->setError(ERROR_INVALID_FILE, e);
+    }
+  }
+
+  this->header_ = header;
+  this->records_ = records;
+  this->instructions_ = instructions;
+  this->variables_ = variables;
+  this->names_ = names;
+  this->strings_ = strings;
+  return ERROR_NONE;
+}
+
+// Records an error of open().
+// @param kind The kind of the error.
+// @param expression The index of the expression causing it, ShuntingYard::NO_POSITION if none.
+// @return The kind of the error.
+ErrorKind ExpressionFile::setError(ErrorKind kind, unsigned int expression)
+{
+  this->error_ = kind;
+  this->error_expression_ = expression;
+  return kind;
+}
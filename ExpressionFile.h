@@ -0,0 +1,101 @@
+﻿#ifndef EXPRESSIONFILE_H
+#define EXPRESSIONFILE_H
+
+// Includes
+#include "CompiledExpression.h"
+#include "OperatorRegistry.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compiled expressions stored in a binary file, which is memory-mapped and evaluated in place.
+// The file contains a header, one record per expression, the instructions of all expressions in the layout of
+// Instruction (with constants inline), the variables of every expression as indices into a name table, and the names.
+// All references are offsets or indices, so the file does not depend on where it is mapped. Registered functions are
+// stored by name and resolved against a registry when the file is opened. Files are only portable between machines
+// with the same byte order.
+// Opening a file checks all offsets and the stack effect of every expression, but copies nothing; all evaluate
+// methods are const and can be called by any number of threads at the same time.
+// Nothing is printed on errors; write() and open() return the kind of the error, and getErrorExpression() returns the
+// expression which made open() fail.
+class ExpressionFile
+{
+  public:
+    // Constructor
+    ExpressionFile();
+
+    // Destructor
+    ~ExpressionFile();
+
+    // Methods
+    static ErrorKind write(const char*, const std::vector<CompiledExpression>&, const OperatorRegistry* registry = 0);
+    ErrorKind open(const char*, const OperatorRegistry* registry = 0);
+    void close();
+    bool isOpen() const;
+    unsigned int getExpressionCount() const;
+    unsigned int getVariableCount(unsigned int) const;
+    std::string_view getVariable(unsigned int, unsigned int) const;
+    std::vector<std::string> getVariables(unsigned int) const;
+    double evaluate(unsigned int, const double*) const;
+    CompiledExpression getExpression(unsigned int) const;
+    ErrorKind getError() const;
+    unsigned int getErrorExpression() const;
+
+    // Version of the file format written by write()
+    static const std::uint32_t VERSION = 1;
+
+  private:
+    typedef struct Header
+    {
+      char magic_[8];
+      std::uint32_t version_;
+      std::uint32_t byte_order_; // BYTE_ORDER_MARK as written by the creating machine
+      std::uint32_t instruction_size_;
+      std::uint32_t expression_count_;
+      std::uint64_t file_size_;
+      std::uint64_t records_offset_;
+      std::uint64_t instructions_offset_;
+      std::uint64_t instruction_count_;
+      std::uint64_t variables_offset_; // Name indices of the variables of all expressions
+      std::uint64_t variable_count_;
+      std::uint64_t names_offset_; // Offsets of the names in the strings
+      std::uint64_t name_count_;
+      std::uint64_t strings_offset_; // Names terminated by 0
+      std::uint64_t strings_size_;
+    } Header;
+
+    typedef struct Record
+    {
+      std::uint64_t instruction_begin_;
+      std::uint32_t instruction_count_;
+      std::uint32_t max_depth_;
+      std::uint32_t temp_count_;
+      std::uint32_t variable_begin_;
+      std::uint32_t variable_count_;
+      std::uint32_t call_count_; // Instructions calling registered functions, their value holds a name index
+    } Record;
+
+    char* data_; // Mapped file, or a copy if it cannot be mapped
+    std::size_t size_;
+    bool mapped_;
+    const Header* header_;
+    const Record* records_;
+    const Instruction* instructions_;
+    const std::uint32_t* variables_;
+    const std::uint32_t* names_;
+    const char* strings_;
+    ErrorKind error_; // Error of the last open()
+    unsigned int error_expression_; // Index of the expression causing error_, ShuntingYard::NO_POSITION if none
+
+    // The mapping is owned by the instance
+    ExpressionFile(const ExpressionFile&);
+    ExpressionFile& operator=(const ExpressionFile&);
+
+    ErrorKind validate(const OperatorRegistry*);
+    ErrorKind setError(ErrorKind, unsigned int);
+
+};
+
+#endif /* EXPRESSIONFILE_H */
@@ -0,0 +1,213 @@
+﻿// Includes
+#include "ExpressionGenerator.h"
+#include <algorithm>
+
+// Constructor
+// @param seed The seed of the random numbers.
+ExpressionGenerator::ExpressionGenerator(unsigned int seed)
+{
+  this->random_.seed(seed);
+  this->variable_count_ = 0;
+  this->next_variable_ = 0;
+  this->chain_length_ = 1;
+}
+
+// Destructor
+ExpressionGenerator::~ExpressionGenerator()
+{
+
+}
+
+// Restarts the sequence of formulas.
+// @param seed The seed of the random numbers.
+void ExpressionGenerator::setSeed(unsigned int seed)
+{
+  this->random_.seed(seed);
+}
+
+// Generates a formula with a given number of operators and functions.
+// The formula mixes all built-in operators and functions, with as few parentheses as the precedences allow.
+// @param operator_count The number of operators and functions.
+// @param variable_count The number of distinct variables, at most MAX_VARIABLES.
+// @return The formula in infix notation.
+std::string ExpressionGenerator::generate(unsigned int operator_count, unsigned int variable_count)
+{
+  std::string formula;
+  this->variable_count_ = (variable_count < MAX_VARIABLES) ? variable_count : MAX_VARIABLES;
+  this->next_variable_ = 0;
+  this->appendExpression(&formula, operator_count, 4);
+  return formula;
+}
+
+// Generates a formula whose parentheses and function calls are nested a given number of levels deep, e.g.
+// (a*max(b,sin((c-d)+...))).
+// @param depth The number of nested levels.
+// @param variable_count The number of distinct variables, at most MAX_VARIABLES.
+// @return The formula in infix notation.
+std::string ExpressionGenerator::generateNested(unsigned int depth, unsigned int variable_count)
+{
+  static const char operators[] = {'+', '-', '*', '/'};
+  this->variable_count_ = (variable_count < MAX_VARIABLES) ? variable_count : MAX_VARIABLES;
+  this->next_variable_ = 0;
+
+  // Every level adds to both ends of the formula, the innermost operand comes last. The suffix is collected back to
+  // front, so every level appends to it, and reversed at the end.
+  std::string prefix;
+  std::string suffix;
+  for(unsigned int level = 0; level < depth; level++) {
+    std::string closing;
+    switch(this->next(4)) {
+      case 0:
+        prefix.push_back('(');
+        this->appendOperand(&prefix);
+        prefix.push_back(operators[this->next(4)]);
+        closing = ")";
+        break;
+      case 1:
+        prefix += this->next(2) ? "sin(" : "cos(";
+        closing = ")";
+        break;
+      case 2:
+        prefix += this->next(2) ? "max(" : "min(";
+        this->appendOperand(&prefix);
+        prefix.push_back(',');
+        closing = ")";
+        break;
+      default:
+        prefix.push_back('(');
+        closing = ")";
+        closing.push_back(operators[this->next(4)]);
+        this->appendOperand(&closing);
+        break;
+    }
+    suffix.append(closing.rbegin(), closing.rend());
+  }
+  this->appendOperand(&prefix);
+  std::reverse(suffix.begin(), suffix.end());
+  return prefix + suffix;
+}
+
+// Generates a formula like generate() in which every binary + and - is written as a chain of signs, e.g. a+-+b for
+// a-b, which the parser has to collapse.
+// @param operator_count The number of operators and functions.
+// @param chain_length The number of signs of every chain.
+// @param variable_count The number of distinct variables, at most MAX_VARIABLES.
+// @return The formula in infix notation.
+std::string ExpressionGenerator::generateSignChains(unsigned int operator_count, unsigned int chain_length, unsigned int variable_count)
+{
+  this->chain_length_ = (chain_length > 0) ? chain_length : 1;
+  std::string formula = this->generate(operator_count, variable_count);
+  this->chain_length_ = 1;
+  return formula;
+}
+
+// Returns the name of a variable.
+// @param slot The slot of the variable, less than MAX_VARIABLES.
+// @return The letter naming the variable.
+char ExpressionGenerator::getVariable(unsigned int slot)
+{
+  return (slot < 26) ? 'a' + slot : 'A' + (slot - 26);
+}
+
+// Draws a random number.
+// The raw output of std::mt19937 is defined by the standard, unlike the distributions of the standard library.
+// @param count The number of possible values.
+// @return A number between 0 and count - 1.
+unsigned int ExpressionGenerator::next(unsigned int count)
+{
+  return this->random_() % count;
+}
+
+// Appends a random expression.
+// @param output The formula to append to.
+// @param operator_count The number of operators and functions of the expression.
+// @param max_precedence The loosest precedence which does not need parentheses at this position.
+// @return The precedence of the expression, 0 for operands, function calls and parenthesized expressions.
+int ExpressionGenerator::appendExpression(std::string* output, unsigned int operator_count, int max_precedence)
+{
+  if(operator_count == 0) {
+    this->appendOperand(output);
+    return 0;
+  }
+
+  // Weighted choice of the node, the remaining operators are split between the operands
+  static const char nodes[] = {'+', '+', '+', '-', '-', '*', '*', '*', '/', '^', '#', 's', 'c', 'm', 'n'};
+  char node = nodes[this->next(sizeof(nodes))];
+  unsigned int remaining = operator_count - 1;
+  if(node == 's' || node == 'c' || node == 'm' || node == 'n') {
+    static const char* names[] = {"sin(", "cos(", "max(", "min("};
+    *output += names[(node == 's') ? 0 : (node == 'c') ? 1 : (node == 'm') ? 2 : 3];
+    if(node == 'm' || node == 'n') {
+      unsigned int left = this->next(remaining + 1);
+      this->appendExpression(output, left, 4);
+      output->push_back(',');
+      remaining -= left;
+    }
+    this->appendExpression(output, remaining, 4);
+    output->push_back(')');
+    return 0;
+  }
+  else if(node == '#') {
+    // The unary minus is parenthesized, it is not allowed after every token
+    *output += "(-";
+    this->appendExpression(output, remaining, 0);
+    output->push_back(')');
+    return 0;
+  }
+
+  int precedence = (node == '^') ? 2 : (node == '*' || node == '/') ? 3 : 4;
+  bool parentheses = precedence > max_precedence;
+  if(parentheses)
+    output->push_back('(');
+  if(node == '^') {
+    // Small integer exponents keep the results finite and defined for negative bases
+    this->appendExpression(output, remaining, precedence - 1);
+    output->push_back('^');
+    output->push_back(this->next(2) ? '2' : '3');
+  }
+  else {
+    unsigned int left = this->next(remaining + 1);
+    this->appendExpression(output, left, precedence);
+    this->appendOperator(output, node);
+    this->appendExpression(output, remaining - left, precedence - 1);
+  }
+  if(parentheses)
+    output->push_back(')');
+  return parentheses ? 0 : precedence;
+}
+
+// Appends a variable or a constant, the variables which did not appear yet come first.
+// @param output The formula to append to.
+void ExpressionGenerator::appendOperand(std::string* output)
+{
+  static const char* constants[] = {"0.5", "1.5", "2", "3", "0.25", "10", "4.75", "100"};
+  if(this->next_variable_ < this->variable_count_) {
+    output->push_back(getVariable(this->next_variable_++));
+  }
+  else if(this->variable_count_ > 0 && this->next(3) != 0) {
+    output->push_back(getVariable(this->next(this->variable_count_)));
+  }
+  else {
+    *output += constants[this->next(sizeof(constants) / sizeof(constants[0]))];
+  }
+}
+
+// Appends a binary operator, + and - as a chain of signs if requested.
+// @param output The formula to append to.
+// @param op The operator.
+void ExpressionGenerator::appendOperator(std::string* output, char op)
+{
+  if((op != '+' && op != '-') || this->chain_length_ == 1) {
+    output->push_back(op);
+    return;
+  }
+
+  // Random signs, the last one makes the number of minus signs odd for - and even for +
+  bool negative = false;
+  for(unsigned int i = 1; i < this->chain_length_; i++) {
+    bool minus = this->next(2) != 0;
+    output->push_back(minus ? '-' : '+');
+    negative = negative != minus;
+  }
+  output->push_back((negative != (op == '-')) ? '-' : '+');
+}
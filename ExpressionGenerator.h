@@ -0,0 +1,44 @@
+﻿#ifndef EXPRESSIONGENERATOR_H
+#define EXPRESSIONGENERATOR_H
+
+// Includes
+#include <random>
+#include <string>
+
+// Generator of random valid formulas for benchmarks and stress tests.
+// The formulas only depend on the seed and the arguments, so a seed reproduces the same formulas on every platform.
+// Variables are the letters a-z and A-Z in this order; a formula with n variables uses the first n of them in order of
+// their first appearance, i.e. in slot order, as long as it has enough operands.
+class ExpressionGenerator
+{
+  public:
+    // Constructor
+    ExpressionGenerator(unsigned int seed = 1);
+
+    // Destructor
+    ~ExpressionGenerator();
+
+    // Methods
+    void setSeed(unsigned int);
+    std::string generate(unsigned int, unsigned int);
+    std::string generateNested(unsigned int, unsigned int);
+    std::string generateSignChains(unsigned int, unsigned int, unsigned int);
+    static char getVariable(unsigned int);
+
+    // Number of distinct variables, the parser only accepts single letters
+    static const unsigned int MAX_VARIABLES = 52;
+
+  private:
+    std::mt19937 random_;
+    unsigned int variable_count_; // Variables of the formula being generated
+    unsigned int next_variable_; // Next variable which has not appeared yet
+    unsigned int chain_length_; // Signs written for every binary + and -
+
+    unsigned int next(unsigned int);
+    int appendExpression(std::string*, unsigned int, int);
+    void appendOperand(std::string*);
+    void appendOperator(std::string*, char);
+
+};
+
+#endif /* EXPRESSIONGENERATOR_H */
@@ -0,0 +1,191 @@
+﻿// Includes
+#include "ExpressionOptimizer.h"
+#include <cmath>
+
+// Constructor
+ExpressionOptimizer::ExpressionOptimizer()
+{
+  this->exact_only_ = false;
+}
+
+// Destructor
+ExpressionOptimizer::~ExpressionOptimizer()
+{
+
+}
+
+// Restricts the optimizer to rewrites which give bit-identical results.
+// Without this flag x+0 is removed (wrong for x = -0) and powers are reduced to multiplications (rounding differs from pow).
+// @param exact_only True to disable all rewrites which are not IEEE-exact.
+void ExpressionOptimizer::setExactOnly(bool exact_only)
+{
+  this->exact_only_ = exact_only;
+}
+
+// Optimizes a compiled expression in place.
+// Variables are never removed, so the variable slots of the expression do not change.
+// Run it before ExpressionDag::eliminateCommonSubexpressions(), expressions with stored values are not changed.
+// @param compiled The expression to optimize.
+// @return The number of eliminated instructions, negative if reduced powers added more instructions than were removed.
+int ExpressionOptimizer::optimize(CompiledExpression* compiled)
+{
+  if(!compiled->valid_ || compiled->temp_count_ > 0)
+    return 0;
+
+  // Build the expression tree, simplifying every node as soon as its operands are known
+  this->nodes_.clear();
+  std::vector<int> stack;
+  for(std::vector<Instruction>::const_iterator it = compiled->instructions_.begin(); it != compiled->instructions_.end(); it++) {
+    int operands[CompiledExpression::MAX_CALL_ARGUMENTS];
+    for(int i = CompiledExpression::getArity(*it) - 1; i >= 0; i--) {
+      operands[i] = stack.back();
+      stack.pop_back();
+    }
+    stack.push_back(this->simplify(*it, operands));
+  }
+
+  std::vector<Instruction> instructions;
+  this->emit(stack.back(), &instructions);
+  int eliminated = (int)compiled->instructions_.size() - (int)instructions.size();
+
+  unsigned int depth = 0;
+  compiled->max_depth_ = 0;
+  for(std::vector<Instruction>::const_iterator it = instructions.begin(); it != instructions.end(); it++) {
+    depth = depth - CompiledExpression::getArity(*it) + 1;
+    if(depth > compiled->max_depth_)
+      compiled->max_depth_ = depth;
+  }
+  compiled->instructions_.swap(instructions);
+  this->nodes_.clear();
+
+  return eliminated;
+}
+
+// Adds a node to the expression tree.
+// @param instruction The instruction of the node.
+// @param operands The operands, as many as the arity of the instruction.
+// @return The index of the new node.
+int ExpressionOptimizer::addNode(const Instruction& instruction, const int* operands)
+{
+  Node node;
+  node.instruction_ = instruction;
+  for(int i = 0; i < CompiledExpression::getArity(instruction); i++)
+    node.children_[i] = operands[i];
+  this->nodes_.push_back(node);
+  return this->nodes_.size() - 1;
+}
+
+// Creates the simplest node equivalent to an instruction applied to already simplified operands.
+// @param instruction The instruction.
+// @param operands The operands, as many as the arity of the instruction.
+// @return The index of the resulting node.
+int ExpressionOptimizer::simplify(const Instruction& instruction, const int* operands)
+{
+  OpCode opcode = instruction.opcode_;
+  int arity = CompiledExpression::getArity(instruction);
+  if(opcode == OP_CONSTANT || opcode == OP_VARIABLE)
+    return this->addNode(instruction, operands);
+
+  // Constant folding, the result of impure functions may change between evaluations
+  bool constant = opcode != OP_CALL_IMPURE;
+  double values[CompiledExpression::MAX_CALL_ARGUMENTS];
+  for(int i = 0; i < arity && constant; i++) {
+    constant = this->isConstant(operands[i], NAN);
+    if(constant)
+      values[i] = this->nodes_[operands[i]].instruction_.value_;
+  }
+  if(constant) {
+    Instruction folded;
+    folded.opcode_ = OP_CONSTANT;
+    folded.index_ = 0;
+    folded.value_ = CompiledExpression::calculate(instruction, values);
+    return this->addNode(folded, 0);
+  }
+  if(arity != 1 && arity != 2)
+    return this->addNode(instruction, operands);
+
+  // Identities
+  int left = operands[0];
+  int right = (arity == 2) ? operands[1] : -1;
+  if(opcode == OP_NEGATE && this->nodes_[left].instruction_.opcode_ == OP_NEGATE)
+    return this->nodes_[left].children_[0];
+  if(opcode == OP_MULTIPLY && this->isConstant(right, 1))
+    return left;
+  if(opcode == OP_MULTIPLY && this->isConstant(left, 1))
+    return right;
+  if(opcode == OP_DIVIDE && this->isConstant(right, 1))
+    return left;
+  // x - (-0) is +0 for x = -0, only +0 can be removed exactly
+  if(opcode == OP_SUBTRACT && this->isConstant(right, 0) && (!this->exact_only_ || !std::signbit(this->nodes_[right].instruction_.value_)))
+    return left;
+  if(opcode == OP_POWER && this->isConstant(right, 1))
+    return left;
+  if(!this->exact_only_) {
+    if(opcode == OP_ADD && this->isConstant(right, 0))
+      return left;
+    if(opcode == OP_ADD && this->isConstant(left, 0))
+      return right;
+  }
+
+  // Strength reduction of powers with small integer exponents, the base is repeated so it has to be a leaf
+  if(!this->exact_only_ && opcode == OP_POWER && this->isLeaf(left) && this->nodes_[right].instruction_.opcode_ == OP_CONSTANT) {
+    double exponent = this->nodes_[right].instruction_.value_;
+    if(exponent >= 2 && exponent <= MAX_POWER_EXPONENT && exponent == floor(exponent)) {
+      Instruction multiply;
+      multiply.opcode_ = OP_MULTIPLY;
+      multiply.index_ = 0;
+      multiply.value_ = 0;
+      int factors[2] = {left, -1};
+      for(int i = 1; i < (int)exponent; i++) {
+        factors[1] = this->addNode(this->nodes_[left].instruction_, 0);
+        factors[0] = this->addNode(multiply, factors);
+      }
+      return factors[0];
+    }
+  }
+
+  return this->addNode(instruction, operands);
+}
+
+// Checks whether a node is a constant.
+// @param node The index of the node.
+// @param value The required value or NAN to accept any constant.
+// @return True if the node is a matching constant.
+bool ExpressionOptimizer::isConstant(int node, double value) const
+{
+  if(this->nodes_[node].instruction_.opcode_ != OP_CONSTANT)
+    return false;
+  return std::isnan(value) || this->nodes_[node].instruction_.value_ == value;
+}
+
+// Checks whether a node is a variable or a constant.
+// @param node The index of the node.
+// @return True if the node has no operands.
+bool ExpressionOptimizer::isLeaf(int node) const
+{
+  OpCode opcode = this->nodes_[node].instruction_.opcode_;
+  return opcode == OP_CONSTANT || opcode == OP_VARIABLE;
+}
+
+// Writes the instructions of a subtree in postfix order.
+// @param root The index of the root node.
+// @param instructions The output instructions.
+void ExpressionOptimizer::emit(int root, std::vector<Instruction>* instructions) const
+{
+  // Iterative post-order traversal, generated formulas can be nested too deeply for recursion
+  std::vector<std::pair<int, int> > stack; // Node and number of children already visited
+  stack.push_back(std::make_pair(root, 0));
+  while(!stack.empty()) {
+    std::pair<int, int>& top = stack.back();
+    const Node& node = this->nodes_[top.first];
+    if(top.second < CompiledExpression::getArity(node.instruction_)) {
+      int child = node.children_[top.second];
+      top.second++;
+      stack.push_back(std::make_pair(child, 0));
+    }
+    else {
+      instructions->push_back(node.instruction_);
+      stack.pop_back();
+    }
+  }
+}
@@ -0,0 +1,46 @@
+﻿#ifndef EXPRESSIONOPTIMIZER_H
+#define EXPRESSIONOPTIMIZER_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <vector>
+
+// Simplifies the instructions of a compiled expression.
+// Constant subexpressions are folded and identities like x*1, x+0, #(#x) and x^1 are removed. Powers with a small
+// integer exponent of a variable or constant are reduced to multiplications. Calls of registered functions with
+// constant arguments are folded if the function is pure.
+class ExpressionOptimizer
+{
+  public:
+    // Constructor
+    ExpressionOptimizer();
+
+    // Destructor
+    ~ExpressionOptimizer();
+
+    // Methods
+    void setExactOnly(bool);
+    int optimize(CompiledExpression*);
+
+    // Largest exponent which is reduced to multiplications
+    static const int MAX_POWER_EXPONENT = 4;
+
+  private:
+    typedef struct Node
+    {
+      Instruction instruction_;
+      int children_[CompiledExpression::MAX_CALL_ARGUMENTS]; // Operands, as many as the arity of the instruction
+    } Node;
+
+    std::vector<Node> nodes_;
+    bool exact_only_;
+
+    int addNode(const Instruction&, const int*);
+    int simplify(const Instruction&, const int*);
+    bool isConstant(int, double) const;
+    bool isLeaf(int) const;
+    void emit(int, std::vector<Instruction>*) const;
+
+};
+
+#endif /* EXPRESSIONOPTIMIZER_H */
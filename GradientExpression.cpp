@@ -0,0 +1,260 @@
+﻿// Includes
+#include "GradientExpression.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Constructor
+// Converts the instructions into the nodes of the tape and allocates the buffers of both modes.
+// @param expression The compiled expression, values stored with OP_STORE become nodes used by several nodes.
+GradientExpression::GradientExpression(const CompiledExpression& expression)
+{
+  this->root_ = 0;
+  this->max_depth_ = 0;
+  this->valid_ = expression.isValid();
+  if(!this->valid_)
+    return;
+
+  this->variables_ = expression.getVariables();
+  this->variable_nodes_.resize(this->variables_.size(), (unsigned int)-1);
+  this->instructions_ = expression.instructions_;
+  this->max_depth_ = expression.max_depth_;
+  this->stack_.resize((std::size_t)(expression.max_depth_ + expression.temp_count_) * (this->variables_.size() + 1));
+
+  std::vector<unsigned int> stack;
+  std::vector<unsigned int> temps;
+  for(std::vector<Instruction>::const_iterator it = expression.instructions_.begin(); it != expression.instructions_.end(); it++) {
+    if(it->opcode_ == OP_LOAD) {
+      stack.push_back(temps[it->index_]);
+      continue;
+    }
+    else if(it->opcode_ == OP_STORE) {
+      if(temps.size() <= it->index_)
+        temps.resize(it->index_ + 1);
+      temps[it->index_] = stack.back();
+      continue;
+    }
+    else if(it->opcode_ == OP_VARIABLE) {
+      // Every variable is a single node, which collects the derivative of all of its uses
+      if(this->variable_nodes_[it->index_] != (unsigned int)-1) {
+        stack.push_back(this->variable_nodes_[it->index_]);
+        continue;
+      }
+      this->variable_nodes_[it->index_] = this->nodes_.size();
+    }
+
+    Node node;
+    node.instruction_ = *it;
+    node.operand_begin_ = this->operands_.size();
+    node.operand_count_ = CompiledExpression::getArity(*it);
+    this->operands_.insert(this->operands_.end(), stack.end() - node.operand_count_, stack.end());
+    stack.resize(stack.size() - node.operand_count_);
+    stack.push_back(this->nodes_.size());
+    this->nodes_.push_back(node);
+  }
+  this->root_ = stack.back();
+  this->node_values_.resize(this->nodes_.size());
+  this->adjoints_.resize(this->nodes_.size());
+}
+
+// Destructor
+GradientExpression::~GradientExpression()
+{
+
+}
+
+// Checks whether the expression can be evaluated.
+// @return True if the compiled expression has been valid.
+bool GradientExpression::isValid() const
+{
+  return this->valid_;
+}
+
+// Returns the variables in slot order.
+// @return The variable names.
+const std::vector<std::string>& GradientExpression::getVariables() const
+{
+  return this->variables_;
+}
+
+// Calculates the value and the gradient in reverse mode.
+// The first sweep calculates the value of every node, the second one goes back from the result and adds the
+// derivative of the result with respect to every node to its operands, weighted with the partial derivatives.
+// @param values An array containing a value for each entry of getVariables().
+// @param gradient An array receiving the derivative with respect to each entry of getVariables().
+// @return The result of the formula or 0 if the expression is invalid.
+double GradientExpression::evaluateReverse(const double* values, double* gradient)
+{
+  if(!this->valid_)
+    return 0;
+
+  double operand_values[CompiledExpression::MAX_CALL_ARGUMENTS];
+  for(unsigned int i = 0; i <= this->root_; i++) {
+    const Node& node = this->nodes_[i];
+    if(node.instruction_.opcode_ == OP_CONSTANT) {
+      this->node_values_[i] = node.instruction_.value_;
+    }
+    else if(node.instruction_.opcode_ == OP_VARIABLE) {
+      this->node_values_[i] = values[node.instruction_.index_];
+    }
+    else {
+      for(unsigned int k = 0; k < node.operand_count_; k++)
+        operand_values[k] = this->node_values_[this->operands_[node.operand_begin_ + k]];
+      this->node_values_[i] = CompiledExpression::calculate(node.instruction_, operand_values);
+    }
+  }
+
+  std::fill(this->adjoints_.begin(), this->adjoints_.begin() + this->root_, 0.0);
+  this->adjoints_[this->root_] = 1;
+  double partials[CompiledExpression::MAX_CALL_ARGUMENTS];
+  for(unsigned int i = this->root_ + 1; i-- > 0;) {
+    // Nodes the result does not depend on, e.g. the other operand of max(), pass nothing on; like every contribution
+    // with a zero factor, even if the other factor is not finite
+    const Node& node = this->nodes_[i];
+    double adjoint = this->adjoints_[i];
+    if(adjoint == 0 || node.operand_count_ == 0)
+      continue;
+    for(unsigned int k = 0; k < node.operand_count_; k++)
+      operand_values[k] = this->node_values_[this->operands_[node.operand_begin_ + k]];
+    getPartials(node.instruction_, operand_values, this->node_values_[i], partials);
+    for(unsigned int k = 0; k < node.operand_count_; k++) {
+      if(partials[k] != 0)
+        this->adjoints_[this->operands_[node.operand_begin_ + k]] += adjoint * partials[k];
+    }
+  }
+
+  for(unsigned int slot = 0; slot < this->variable_nodes_.size(); slot++)
+    gradient[slot] = (this->variable_nodes_[slot] != (unsigned int)-1) ? this->adjoints_[this->variable_nodes_[slot]] : 0;
+  return this->node_values_[this->root_];
+}
+
+// Calculates the value and the gradient in forward mode.
+// Every stack entry holds a value followed by its derivatives with respect to all variables in slot order.
+// @param values An array containing a value for each entry of getVariables().
+// @param gradient An array receiving the derivative with respect to each entry of getVariables().
+// @return The result of the formula or 0 if the expression is invalid.
+double GradientExpression::evaluateForward(const double* values, double* gradient)
+{
+  if(!this->valid_)
+    return 0;
+
+  std::ptrdiff_t width = this->variables_.size() + 1;
+  double* temps = this->stack_.data() + this->max_depth_ * width;
+  double* top = this->stack_.data() - width;
+  double operand_values[CompiledExpression::MAX_CALL_ARGUMENTS];
+  double partials[CompiledExpression::MAX_CALL_ARGUMENTS];
+  for(std::vector<Instruction>::const_iterator it = this->instructions_.begin(); it != this->instructions_.end(); it++) {
+    switch(it->opcode_) {
+      case OP_CONSTANT:
+        top += width;
+        top[0] = it->value_;
+        std::fill(top + 1, top + width, 0.0);
+        break;
+      case OP_VARIABLE:
+        top += width;
+        top[0] = values[it->index_];
+        std::fill(top + 1, top + width, 0.0);
+        top[1 + it->index_] = 1;
+        break;
+      case OP_LOAD:
+        top += width;
+        std::copy(temps + it->index_ * width, temps + (it->index_ + 1) * width, top);
+        break;
+      case OP_STORE:
+        std::copy(top, top + width, temps + it->index_ * width);
+        break;
+      default: {
+        // The result replaces the first operand, calls without arguments push a new entry
+        int arity = CompiledExpression::getArity(*it);
+        double* first = top - (arity - 1) * width;
+        for(int k = 0; k < arity; k++)
+          operand_values[k] = first[k * width];
+        double value = CompiledExpression::calculate(*it, operand_values);
+        getPartials(*it, operand_values, value, partials);
+        for(std::ptrdiff_t j = 1; j < width; j++) {
+          // A zero factor makes a contribution 0 even if the other one is not finite, as in the reverse mode
+          double derivative = 0;
+          for(int k = 0; k < arity; k++) {
+            if(partials[k] != 0 && first[k * width + j] != 0)
+              derivative += partials[k] * first[k * width + j];
+          }
+          first[j] = derivative;
+        }
+        first[0] = value;
+        top = first;
+        break;
+      }
+    }
+  }
+
+  std::copy(top + 1, top + width, gradient);
+  return top[0];
+}
+
+// Calculates the partial derivatives of an operator or function with respect to its operands.
+// @param instruction The instruction of the operator or function.
+// @param operands The operands in their original order, only modified temporarily.
+// @param value The result of the instruction for these operands.
+// @param partials An array receiving the partial derivative with respect to each operand.
+void GradientExpression::getPartials(const Instruction& instruction, double* operands, double value, double* partials)
+{
+  switch(instruction.opcode_) {
+    case OP_ADD:
+      partials[0] = 1;
+      partials[1] = 1;
+      break;
+    case OP_SUBTRACT:
+      partials[0] = 1;
+      partials[1] = -1;
+      break;
+    case OP_MULTIPLY:
+      partials[0] = operands[1];
+      partials[1] = operands[0];
+      break;
+    case OP_DIVIDE:
+      partials[0] = 1 / operands[1];
+      partials[1] = -value / operands[1];
+      break;
+    case OP_POWER:
+      // x^0 is constant, and 0^y stays 0 for positive y
+      partials[0] = (operands[1] == 0) ? 0 : operands[1] * pow(operands[0], operands[1] - 1);
+      partials[1] = (value == 0) ? 0 : value * log(operands[0]);
+      break;
+    case OP_NEGATE:
+      partials[0] = -1;
+      break;
+    case OP_SIN:
+      partials[0] = cos(operands[0]);
+      break;
+    case OP_COS:
+      partials[0] = -sin(operands[0]);
+      break;
+    case OP_MAX:
+      partials[0] = (operands[0] > operands[1]) ? 1 : 0;
+      partials[1] = 1 - partials[0];
+      break;
+    case OP_MIN:
+      partials[0] = (operands[0] < operands[1]) ? 1 : 0;
+      partials[1] = 1 - partials[0];
+      break;
+    case OP_CALL:
+      // Central differences, the step balances the truncation error against the rounding error
+      for(unsigned int k = 0; k < instruction.index_; k++) {
+        double operand = operands[k];
+        double step = cbrt(DBL_EPSILON) * std::max(fabs(operand), 1.0);
+        double upper = operand + step;
+        double lower = operand - step;
+        operands[k] = upper;
+        double upper_value = instruction.kernel_(operands, instruction.index_);
+        operands[k] = lower;
+        double lower_value = instruction.kernel_(operands, instruction.index_);
+        operands[k] = operand;
+        partials[k] = (upper_value - lower_value) / (upper - lower);
+      }
+      break;
+    default:
+      // Impure functions
+      std::fill(partials, partials + instruction.index_, 0.0);
+      break;
+  }
+}
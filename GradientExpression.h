@@ -0,0 +1,61 @@
+﻿#ifndef GRADIENTEXPRESSION_H
+#define GRADIENTEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Evaluator which calculates the partial derivatives of a formula with respect to all of its variables together with
+// its value, by automatic differentiation instead of finite differences.
+// evaluateReverse() records the value of every subexpression on a tape and propagates the derivative back from the
+// result, which costs about two evaluations regardless of the number of variables. evaluateForward() carries the
+// derivatives with respect to every variable along with each value (dual numbers), which costs one evaluation per
+// variable but needs no tape. Both work on buffers allocated by the constructor, so an instance must only be used by
+// one thread at a time.
+// Derivatives of registered functions are approximated by central differences of their kernel; impure functions are
+// treated as constants. Where a formula is not differentiable (e.g. max(x,y) with x = y), the derivative of the
+// operand selected by the evaluation is used.
+class GradientExpression
+{
+  public:
+    // Constructor
+    GradientExpression(const CompiledExpression&);
+
+    // Destructor
+    ~GradientExpression();
+
+    // Methods
+    bool isValid() const;
+    const std::vector<std::string>& getVariables() const;
+    double evaluateReverse(const double*, double*);
+    double evaluateForward(const double*, double*);
+
+  private:
+    typedef struct Node
+    {
+      Instruction instruction_;
+      unsigned int operand_begin_; // Range of the operands in operands_
+      unsigned int operand_count_;
+    } Node;
+
+    // Tape of the reverse mode, nodes in postfix order so operands always have a lower index than the nodes using them
+    std::vector<Node> nodes_;
+    std::vector<unsigned int> operands_;
+    std::vector<double> node_values_;
+    std::vector<double> adjoints_;
+    std::vector<unsigned int> variable_nodes_; // Node of every variable slot, (unsigned int)-1 if unused
+    unsigned int root_;
+    // Stack of the forward mode, every entry is a value followed by its derivatives
+    std::vector<Instruction> instructions_;
+    std::vector<double> stack_;
+    unsigned int max_depth_;
+    std::vector<std::string> variables_;
+    bool valid_;
+
+    static void getPartials(const Instruction&, double*, double, double*);
+
+};
+
+#endif /* GRADIENTEXPRESSION_H */
@@ -0,0 +1,187 @@
+﻿// Includes
+#include "IncrementalExpression.h"
+#include <algorithm>
+#include <cstring>
+
+// Constructor
+// Converts the instructions into a graph of nodes and evaluates it once with all variables set to 0.
+// @param expression The compiled expression, values stored with OP_STORE become nodes with several parents.
+IncrementalExpression::IncrementalExpression(const CompiledExpression& expression)
+{
+  this->root_ = 0;
+  this->first_dirty_ = 0;
+  this->recalculated_ = 0;
+  this->valid_ = expression.isValid();
+  if(!this->valid_)
+    return;
+
+  this->variables_ = expression.getVariables();
+  this->variable_nodes_.resize(this->variables_.size(), (unsigned int)-1);
+
+  std::vector<unsigned int> stack;
+  std::vector<unsigned int> temps;
+  std::vector<unsigned int> parent_counts;
+  for(std::vector<Instruction>::const_iterator it = expression.instructions_.begin(); it != expression.instructions_.end(); it++) {
+    if(it->opcode_ == OP_LOAD) {
+      stack.push_back(temps[it->index_]);
+      continue;
+    }
+    else if(it->opcode_ == OP_STORE) {
+      if(temps.size() <= it->index_)
+        temps.resize(it->index_ + 1);
+      temps[it->index_] = stack.back();
+      continue;
+    }
+    else if(it->opcode_ == OP_VARIABLE && this->variable_nodes_[it->index_] != (unsigned int)-1) {
+      // Every variable is a single node
+      stack.push_back(this->variable_nodes_[it->index_]);
+      continue;
+    }
+
+    Node node;
+    node.instruction_ = *it;
+    node.operand_begin_ = this->operands_.size();
+    node.operand_count_ = CompiledExpression::getArity(*it);
+    node.dirty_ = false;
+    double value = 0;
+    if(it->opcode_ == OP_CONSTANT) {
+      value = it->value_;
+    }
+    else if(it->opcode_ == OP_VARIABLE) {
+      this->variable_nodes_[it->index_] = this->nodes_.size();
+    }
+    else {
+      double operand_values[CompiledExpression::MAX_CALL_ARGUMENTS];
+      for(unsigned int i = 0; i < node.operand_count_; i++) {
+        unsigned int operand = stack[stack.size() - node.operand_count_ + i];
+        this->operands_.push_back(operand);
+        operand_values[i] = this->node_values_[operand];
+        parent_counts[operand]++;
+      }
+      stack.resize(stack.size() - node.operand_count_);
+      value = CompiledExpression::calculate(*it, operand_values);
+    }
+    stack.push_back(this->nodes_.size());
+    this->nodes_.push_back(node);
+    this->node_values_.push_back(value);
+    parent_counts.push_back(0);
+  }
+  this->root_ = stack.back();
+  this->first_dirty_ = this->nodes_.size();
+
+  // Store the parents of all nodes in one array
+  unsigned int offset = 0;
+  for(unsigned int i = 0; i < this->nodes_.size(); i++) {
+    this->nodes_[i].parent_begin_ = offset;
+    this->nodes_[i].parent_end_ = offset;
+    offset += parent_counts[i];
+  }
+  this->parents_.resize(offset);
+  for(unsigned int i = 0; i < this->nodes_.size(); i++) {
+    for(unsigned int j = 0; j < this->nodes_[i].operand_count_; j++) {
+      Node& operand = this->nodes_[this->operands_[this->nodes_[i].operand_begin_ + j]];
+      if(operand.parent_end_ == operand.parent_begin_ || this->parents_[operand.parent_end_ - 1] != i)
+        this->parents_[operand.parent_end_++] = i;
+    }
+  }
+}
+
+// Destructor
+IncrementalExpression::~IncrementalExpression()
+{
+
+}
+
+// Checks whether the expression can be evaluated.
+// @return True if the compiled expression has been valid.
+bool IncrementalExpression::isValid() const
+{
+  return this->valid_;
+}
+
+// Returns the variables in slot order.
+// @return The variable names.
+const std::vector<std::string>& IncrementalExpression::getVariables() const
+{
+  return this->variables_;
+}
+
+// Changes the value of a variable, the result is recalculated by the next evaluate().
+// @param slot The slot of the variable.
+// @param value The new value.
+void IncrementalExpression::set(unsigned int slot, double value)
+{
+  if(!this->valid_)
+    return;
+
+  unsigned int node = this->variable_nodes_[slot];
+  if(node == (unsigned int)-1 || std::memcmp(&this->node_values_[node], &value, sizeof(double)) == 0)
+    return;
+  this->node_values_[node] = value;
+  this->markParents(node);
+}
+
+// Changes the values of all variables, only the values which differ from the previous ones are recalculated.
+// @param values An array containing a value for each entry of getVariables().
+void IncrementalExpression::update(const double* values)
+{
+  for(unsigned int i = 0; i < this->variable_nodes_.size(); i++)
+    this->set(i, values[i]);
+}
+
+// Recalculates the subexpressions affected by the changed variables.
+// Parents always come after their operands, so a single sweep from the first changed node calculates every affected
+// node once with up-to-date operands.
+// @return The result of the formula or 0 if the expression is invalid.
+double IncrementalExpression::evaluate()
+{
+  if(!this->valid_)
+    return 0;
+
+  this->recalculated_ = 0;
+  for(unsigned int index = this->first_dirty_; index < this->nodes_.size(); index++) {
+    Node& node = this->nodes_[index];
+    if(!node.dirty_)
+      continue;
+
+    node.dirty_ = false;
+    const unsigned int* operands = this->operands_.data() + node.operand_begin_;
+    double operand_values[CompiledExpression::MAX_CALL_ARGUMENTS];
+    for(unsigned int i = 0; i < node.operand_count_; i++)
+      operand_values[i] = this->node_values_[operands[i]];
+    double value = CompiledExpression::calculate(node.instruction_, operand_values);
+    this->recalculated_++;
+    if(std::memcmp(&this->node_values_[index], &value, sizeof(double)) != 0) {
+      this->node_values_[index] = value;
+      this->markParents(index);
+    }
+  }
+  this->first_dirty_ = this->nodes_.size();
+  return this->node_values_[this->root_];
+}
+
+// Returns the number of nodes, the upper limit of recalculations per evaluation.
+// @return The number of nodes.
+std::size_t IncrementalExpression::getNodeCount() const
+{
+  return this->nodes_.size();
+}
+
+// Returns the number of nodes recalculated by the last evaluate().
+// @return The number of recalculated nodes.
+std::size_t IncrementalExpression::getRecalculatedCount() const
+{
+  return this->recalculated_;
+}
+
+// Marks the nodes using a changed node for recalculation.
+// @param index The changed node.
+void IncrementalExpression::markParents(unsigned int index)
+{
+  for(unsigned int i = this->nodes_[index].parent_begin_; i < this->nodes_[index].parent_end_; i++) {
+    unsigned int parent = this->parents_[i];
+    this->nodes_[parent].dirty_ = true;
+    if(parent < this->first_dirty_)
+      this->first_dirty_ = parent;
+  }
+}
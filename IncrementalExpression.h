@@ -0,0 +1,59 @@
+﻿#ifndef INCREMENTALEXPRESSION_H
+#define INCREMENTALEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Stateful evaluator which keeps the value of every subexpression between evaluations.
+// Changing a variable only recalculates the subexpressions depending on it, from the variable up to the root, and
+// stops early where a recalculated value did not change. Intended for inputs which change a few variables at a time.
+// Impure functions are called again only when one of their arguments changes.
+class IncrementalExpression
+{
+  public:
+    // Constructor
+    IncrementalExpression(const CompiledExpression&);
+
+    // Destructor
+    ~IncrementalExpression();
+
+    // Methods
+    bool isValid() const;
+    const std::vector<std::string>& getVariables() const;
+    void set(unsigned int, double);
+    void update(const double*);
+    double evaluate();
+    std::size_t getNodeCount() const;
+    std::size_t getRecalculatedCount() const;
+
+  private:
+    typedef struct Node
+    {
+      Instruction instruction_;
+      unsigned int operand_begin_; // Range of the operands in operands_
+      unsigned int parent_begin_; // Range of the parents in parents_
+      unsigned int parent_end_;
+      unsigned char operand_count_;
+      bool dirty_;
+    } Node;
+
+    // Nodes in postfix order, so operands always have a lower index than the nodes using them
+    std::vector<Node> nodes_;
+    std::vector<double> node_values_;
+    std::vector<unsigned int> operands_;
+    std::vector<unsigned int> parents_;
+    std::vector<unsigned int> variable_nodes_; // Node of every variable slot
+    unsigned int first_dirty_; // Lowest node to recalculate, size of nodes_ if none
+    std::vector<std::string> variables_;
+    unsigned int root_;
+    std::size_t recalculated_;
+    bool valid_;
+
+    void markParents(unsigned int);
+
+};
+
+#endif /* INCREMENTALEXPRESSION_H */
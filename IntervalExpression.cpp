@@ -0,0 +1,349 @@
+﻿// Includes
+#include "IntervalExpression.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Additionals
+static const double INF = std::numeric_limits<double>::infinity();
+static const double PI = 3.14159265358979323846;
+// Magnitude from which sin and cos are no longer narrowed, and the distance within which an extremum counts as inside
+// the range; both keep the rounding of k*2*PI from dropping an extremum
+static const double PERIODIC_LIMIT = 1e9;
+static const double PERIODIC_TOLERANCE = 1e-6;
+
+// Creates an interval, rounding its bounds outwards.
+// A NaN bound comes from values outside the domain of the operation at the ends of the operand ranges.
+// @param lower The lower bound as calculated.
+// @param upper The upper bound as calculated.
+// @param undefined Whether the result may be NaN.
+// @param ulps The number of units in the last place to widen each bound by, 0 for exact operations.
+// @return The interval.
+static Interval makeInterval(double lower, double upper, bool undefined, unsigned int ulps)
+{
+  if(std::isnan(lower)) {
+    lower = -INF;
+    undefined = true;
+  }
+  if(std::isnan(upper)) {
+    upper = INF;
+    undefined = true;
+  }
+  for(unsigned int i = 0; i < ulps; i++) {
+    lower = std::nextafter(lower, -INF);
+    upper = std::nextafter(upper, INF);
+  }
+  return Interval{lower, upper, undefined};
+}
+
+// Checks whether an interval contains 0.
+// @param interval The interval.
+// @return True if 0 is within the bounds.
+static bool containsZero(const Interval& interval)
+{
+  return interval.lower_ <= 0 && interval.upper_ >= 0;
+}
+
+// Adds two intervals.
+// @param a The left operand.
+// @param b The right operand.
+// @return The range of the sums.
+static Interval add(const Interval& a, const Interval& b)
+{
+  // Infinities of opposite signs give NaN
+  bool undefined = a.undefined_ || b.undefined_ || (a.upper_ == INF && b.lower_ == -INF) || (a.lower_ == -INF && b.upper_ == INF);
+  return makeInterval(a.lower_ + b.lower_, a.upper_ + b.upper_, undefined, 1);
+}
+
+// Multiplies two intervals.
+// @param a The left operand.
+// @param b The right operand.
+// @return The range of the products.
+static Interval multiply(const Interval& a, const Interval& b)
+{
+  double products[4] = {a.lower_ * b.lower_, a.lower_ * b.upper_, a.upper_ * b.lower_, a.upper_ * b.upper_};
+  // 0 * infinity gives NaN, and 0 can be anywhere within the range
+  bool undefined = a.undefined_ || b.undefined_ || (containsZero(a) && (std::isinf(b.lower_) || std::isinf(b.upper_))) ||
+    (containsZero(b) && (std::isinf(a.lower_) || std::isinf(a.upper_)));
+  double lower = INF;
+  double upper = -INF;
+  for(double product : products) {
+    if(std::isnan(product)) {
+      // 0 * infinity, the products of the values next to it tend to 0
+      product = 0;
+    }
+    lower = std::min(lower, product);
+    upper = std::max(upper, product);
+  }
+  return makeInterval(lower, upper, undefined, 1);
+}
+
+// Divides two intervals.
+// @param a The dividend.
+// @param b The divisor.
+// @return The range of the quotients.
+static Interval divide(const Interval& a, const Interval& b)
+{
+  // 0/0 is NaN, any other division by 0 infinite, with a sign depending on the sign of the zero. Signed zeros are not
+  // tracked, so even a divisor which is only 0 at one end gives both infinities.
+  bool undefined = a.undefined_ || b.undefined_ || (containsZero(a) && containsZero(b));
+  if(containsZero(b))
+    return makeInterval(-INF, INF, undefined, 0);
+
+  double quotients[4] = {a.lower_ / b.lower_, a.lower_ / b.upper_, a.upper_ / b.lower_, a.upper_ / b.upper_};
+  double lower = INF;
+  double upper = -INF;
+  for(double quotient : quotients) {
+    if(std::isnan(quotient)) {
+      // Infinity / infinity
+      return makeInterval(-INF, INF, true, 0);
+    }
+    lower = std::min(lower, quotient);
+    upper = std::max(upper, quotient);
+  }
+  return makeInterval(lower, upper, undefined, 1);
+}
+
+// Raises an interval to the power of an interval like pow().
+// @param a The base.
+// @param b The exponent.
+// @return The range of the powers.
+static Interval power(const Interval& a, const Interval& b)
+{
+  bool undefined = a.undefined_ || b.undefined_;
+  double exponent = b.lower_;
+  if(exponent == b.upper_ && std::floor(exponent) == exponent && std::fabs(exponent) < 9007199254740992.0) {
+    // Integer exponents are defined for negative bases
+    if(exponent == 0)
+      return Interval{1, 1, false};
+    if(exponent < 0) {
+      // Even powers of both zeros are +0, so their reciprocal is +infinity
+      Interval magnitude = power(a, Interval{-exponent, -exponent, false});
+      if(std::fmod(exponent, 2) != 0 || magnitude.lower_ < 0) {
+        Interval reciprocal = divide(Interval{1, 1, false}, magnitude);
+        return makeInterval(reciprocal.lower_, reciprocal.upper_, reciprocal.undefined_, 1);
+      }
+      return makeInterval(1 / magnitude.upper_, (magnitude.lower_ == 0) ? INF : 1 / magnitude.lower_, magnitude.undefined_, 2);
+    }
+    double lower = pow(a.lower_, exponent);
+    double upper = pow(a.upper_, exponent);
+    if(std::fmod(exponent, 2) != 0)
+      return makeInterval(lower, upper, undefined, 2);
+    // Even powers are never negative, so rounding must not move a bound of 0 below it
+    Interval range = (a.lower_ >= 0) ? makeInterval(lower, upper, undefined, 2) :
+      (a.upper_ <= 0) ? makeInterval(upper, lower, undefined, 2) : makeInterval(0, std::max(lower, upper), undefined, 2);
+    range.lower_ = std::max(range.lower_, 0.0);
+    return range;
+  }
+
+  // Negative bases only have real powers for the integers among the exponents
+  if(a.lower_ < 0)
+    return makeInterval(-INF, INF, true, 0);
+
+  // pow(x, y) = exp(y * log(x)) is monotonic in both x and y, so the extrema lie at the corners
+  double corners[4] = {pow(a.lower_, b.lower_), pow(a.lower_, b.upper_), pow(a.upper_, b.lower_), pow(a.upper_, b.upper_)};
+  Interval range = makeInterval(*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4), undefined, 2);
+  range.lower_ = std::max(range.lower_, 0.0);
+  // Negative odd integer powers of -0 are -infinity
+  if(a.lower_ == 0 && b.lower_ <= -1)
+    range.lower_ = -INF;
+  return range;
+}
+
+// Checks whether a range contains one of the points offset + k * 2 * PI, with some tolerance.
+// @param lower The lower bound of the range.
+// @param upper The upper bound of the range.
+// @param offset The point within the first period.
+// @return True if a point may be inside the range.
+static bool containsPeriodicPoint(double lower, double upper, double offset)
+{
+  double point = offset + std::ceil((lower - PERIODIC_TOLERANCE - offset) / (2 * PI)) * 2 * PI;
+  return point <= upper + PERIODIC_TOLERANCE;
+}
+
+// Calculates the range of sin or cos over an interval.
+// @param a The interval.
+// @param cosine True for cos, false for sin.
+// @return The range of the function.
+static Interval periodic(const Interval& a, bool cosine)
+{
+  // sin and cos of infinity are NaN
+  bool undefined = a.undefined_ || std::isinf(a.lower_) || std::isinf(a.upper_);
+  if(a.upper_ - a.lower_ >= 2 * PI || std::max(std::fabs(a.lower_), std::fabs(a.upper_)) > PERIODIC_LIMIT)
+    return Interval{-1, 1, undefined};
+
+  double at_lower = cosine ? cos(a.lower_) : sin(a.lower_);
+  double at_upper = cosine ? cos(a.upper_) : sin(a.upper_);
+  Interval range = makeInterval(std::min(at_lower, at_upper), std::max(at_lower, at_upper), undefined, 2);
+  double maximum = cosine ? 0 : PI / 2;
+  if(containsPeriodicPoint(a.lower_, a.upper_, maximum))
+    range.upper_ = 1;
+  if(containsPeriodicPoint(a.lower_, a.upper_, maximum + PI))
+    range.lower_ = -1;
+  range.lower_ = std::max(range.lower_, -1.0);
+  range.upper_ = std::min(range.upper_, 1.0);
+  return range;
+}
+
+// Constructor
+// @param expression The compiled expression.
+IntervalExpression::IntervalExpression(const CompiledExpression& expression)
+{
+  this->valid_ = expression.isValid();
+  this->variables_ = expression.getVariables();
+  this->instructions_ = expression.instructions_;
+  this->max_depth_ = expression.max_depth_;
+  this->temp_count_ = expression.temp_count_;
+}
+
+// Destructor
+IntervalExpression::~IntervalExpression()
+{
+
+}
+
+// Checks whether the expression can be evaluated.
+// @return True if the compiled expression has been valid.
+bool IntervalExpression::isValid() const
+{
+  return this->valid_;
+}
+
+// Returns the variables in slot order.
+// @return The variable names.
+const std::vector<std::string>& IntervalExpression::getVariables() const
+{
+  return this->variables_;
+}
+
+// Calculates the range of the results over ranges of the variables.
+// @param ranges An array containing a range for each entry of getVariables().
+// @return An interval containing every possible result, unbounded if the expression is invalid.
+Interval IntervalExpression::evaluate(const Interval* ranges) const
+{
+  if(!this->valid_)
+    return Interval{-INF, INF, true};
+
+  if(this->max_depth_ + this->temp_count_ <= CompiledExpression::STACK_SIZE) {
+    Interval stack[CompiledExpression::STACK_SIZE];
+    return this->execute(ranges, stack, stack + this->max_depth_);
+  }
+  std::vector<Interval> stack(this->max_depth_ + this->temp_count_);
+  return this->execute(ranges, &stack[0], &stack[0] + this->max_depth_);
+}
+
+// Calculates the range of the results of a batch of rows without evaluating them, e.g. to skip batches which cannot
+// exceed some limits (see isWithin()).
+// @param columns An array with one column of values for each entry of getVariables().
+// @param rows The number of rows.
+// @return An interval containing the result of every row, unbounded if the expression is invalid.
+Interval IntervalExpression::evaluateBatch(const double* const* columns, std::size_t rows) const
+{
+  if(this->variables_.size() <= CompiledExpression::STACK_SIZE) {
+    Interval ranges[CompiledExpression::STACK_SIZE];
+    for(unsigned int v = 0; v < this->variables_.size(); v++)
+      ranges[v] = getRange(columns[v], rows);
+    return this->evaluate(ranges);
+  }
+  std::vector<Interval> ranges(this->variables_.size());
+  for(unsigned int v = 0; v < this->variables_.size(); v++)
+    ranges[v] = getRange(columns[v], rows);
+  return this->evaluate(&ranges[0]);
+}
+
+// Returns the smallest interval containing some values.
+// @param values The values.
+// @param count The number of values.
+// @return The interval, unbounded if there are no values other than NaN.
+Interval IntervalExpression::getRange(const double* values, std::size_t count)
+{
+  double lower = INF;
+  double upper = -INF;
+  bool undefined = false;
+  for(std::size_t i = 0; i < count; i++) {
+    // NaN fails both comparisons
+    lower = (values[i] < lower) ? values[i] : lower;
+    upper = (values[i] > upper) ? values[i] : upper;
+    undefined |= values[i] != values[i];
+  }
+  if(lower > upper)
+    return Interval{-INF, INF, undefined};
+  return Interval{lower, upper, undefined};
+}
+
+// Checks whether all values of an interval lie within limits.
+// @param interval The interval.
+// @param lower The lower limit.
+// @param upper The upper limit.
+// @return True if no value of the interval is below the lower or above the upper limit, or NaN.
+bool IntervalExpression::isWithin(const Interval& interval, double lower, double upper)
+{
+  return !interval.undefined_ && interval.lower_ >= lower && interval.upper_ <= upper;
+}
+
+// Executes the instructions on intervals.
+// @param ranges The ranges of the variables.
+// @param stack The stack with at least max_depth_ entries.
+// @param temps The stored values with at least temp_count_ entries.
+// @return The range of the result.
+Interval IntervalExpression::execute(const Interval* ranges, Interval* stack, Interval* temps) const
+{
+  Interval* top = stack - 1;
+  for(std::vector<Instruction>::const_iterator it = this->instructions_.begin(); it != this->instructions_.end(); it++) {
+    switch(it->opcode_) {
+      case OP_CONSTANT:
+        *(++top) = Interval{it->value_, it->value_, std::isnan(it->value_)};
+        break;
+      case OP_VARIABLE:
+        *(++top) = ranges[it->index_];
+        break;
+      case OP_LOAD:
+        *(++top) = temps[it->index_];
+        break;
+      case OP_STORE:
+        temps[it->index_] = *top;
+        break;
+      default: {
+        int arity = CompiledExpression::getArity(*it);
+        top = top + 1 - arity;
+        *top = calculate(*it, top);
+        break;
+      }
+    }
+  }
+  return *top;
+}
+
+// Calculates the range of the result of an operator or function.
+// @param instruction The instruction of the operator or function.
+// @param operands The ranges of the operands in their original order.
+// @return The range of the result.
+Interval IntervalExpression::calculate(const Instruction& instruction, const Interval* operands)
+{
+  switch(instruction.opcode_) {
+    case OP_ADD:
+      return add(operands[0], operands[1]);
+    case OP_SUBTRACT:
+      return add(operands[0], Interval{-operands[1].upper_, -operands[1].lower_, operands[1].undefined_});
+    case OP_MULTIPLY:
+      return multiply(operands[0], operands[1]);
+    case OP_DIVIDE:
+      return divide(operands[0], operands[1]);
+    case OP_POWER:
+      return power(operands[0], operands[1]);
+    case OP_NEGATE:
+      return Interval{-operands[0].upper_, -operands[0].lower_, operands[0].undefined_};
+    case OP_SIN:
+      return periodic(operands[0], false);
+    case OP_COS:
+      return periodic(operands[0], true);
+    case OP_MAX:
+      // A NaN left operand selects the right one, a NaN right operand is the result
+      return Interval{operands[0].undefined_ ? operands[1].lower_ : std::max(operands[0].lower_, operands[1].lower_), std::max(operands[0].upper_, operands[1].upper_), operands[1].undefined_};
+    case OP_MIN:
+      return Interval{std::min(operands[0].lower_, operands[1].lower_), operands[0].undefined_ ? operands[1].upper_ : std::min(operands[0].upper_, operands[1].upper_), operands[1].undefined_};
+    default:
+      // Registered functions
+      return Interval{-INF, INF, true};
+  }
+}
@@ -0,0 +1,56 @@
+﻿#ifndef INTERVALEXPRESSION_H
+#define INTERVALEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Additionals
+// Closed range of values, the bounds may be infinite
+typedef struct Interval
+{
+  double lower_;
+  double upper_;
+  bool undefined_; // Whether the value may also be NaN
+} Interval;
+
+// Evaluator which calculates the range of the results of a formula over ranges of its variables (interval arithmetic).
+// The returned interval is guaranteed to contain the result for every combination of values within the ranges: the
+// bounds are rounded outwards, division by intervals containing 0 and powers of negative bases are handled, and sin
+// and cos account for the extrema inside the ranges. The enclosure is not always tight, e.g. x-x over [0, 1] gives
+// [-1, 1], because every occurrence of a variable is treated independently, and dividing by a range containing 0
+// gives an unbounded interval.
+// Registered functions are unknown to the evaluator, their results can be anything.
+// All evaluate methods are const, so one instance can be used by any number of threads at the same time.
+class IntervalExpression
+{
+  public:
+    // Constructor
+    IntervalExpression(const CompiledExpression&);
+
+    // Destructor
+    ~IntervalExpression();
+
+    // Methods
+    bool isValid() const;
+    const std::vector<std::string>& getVariables() const;
+    Interval evaluate(const Interval*) const;
+    Interval evaluateBatch(const double* const*, std::size_t) const;
+    static Interval getRange(const double*, std::size_t);
+    static bool isWithin(const Interval&, double, double);
+
+  private:
+    std::vector<Instruction> instructions_;
+    std::vector<std::string> variables_;
+    unsigned int max_depth_;
+    unsigned int temp_count_;
+    bool valid_;
+
+    Interval execute(const Interval*, Interval*, Interval*) const;
+    static Interval calculate(const Instruction&, const Interval*);
+
+};
+
+#endif /* INTERVALEXPRESSION_H */
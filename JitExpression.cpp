@@ -0,0 +1,309 @@
+﻿// Includes
+#include "JitExpression.h"
+#include <cstring>
+#include <math.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__))
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Code generation helpers
+// The value stack lives in the stack frame of the generated function: entry k is at [rbp - 16 - 8 * k], stored values
+// follow the stack entries, then the argument array of registered kernels. rbx keeps the pointer to the variable values
+// across calls into libm and the kernels.
+
+static void emitBytes(std::vector<unsigned char>* code, const unsigned char* bytes, std::size_t count)
+{
+  code->insert(code->end(), bytes, bytes + count);
+}
+
+static void emitInt32(std::vector<unsigned char>* code, int value)
+{
+  unsigned char bytes[4];
+  std::memcpy(bytes, &value, 4);
+  emitBytes(code, bytes, 4);
+}
+
+static void emitInt64(std::vector<unsigned char>* code, const void* value)
+{
+  unsigned char bytes[8];
+  std::memcpy(bytes, value, 8);
+  emitBytes(code, bytes, 8);
+}
+
+static int slotOffset(unsigned int slot)
+{
+  return -16 - 8 * (int)slot;
+}
+
+// movsd xmm0/xmm1, [rbp + disp32]
+static void emitLoadSlot(std::vector<unsigned char>* code, int xmm, unsigned int slot)
+{
+  const unsigned char bytes[] = {0xF2, 0x0F, 0x10, (unsigned char)(xmm == 0 ? 0x85 : 0x8D)};
+  emitBytes(code, bytes, 4);
+  emitInt32(code, slotOffset(slot));
+}
+
+// movsd [rbp + disp32], xmm0
+static void emitStoreSlot(std::vector<unsigned char>* code, unsigned int slot)
+{
+  const unsigned char bytes[] = {0xF2, 0x0F, 0x11, 0x85};
+  emitBytes(code, bytes, 4);
+  emitInt32(code, slotOffset(slot));
+}
+
+// <op>sd xmm0, [rbp + disp32]
+static void emitArithmetic(std::vector<unsigned char>* code, unsigned char op, unsigned int slot)
+{
+  const unsigned char bytes[] = {0xF2, 0x0F, op, 0x85};
+  emitBytes(code, bytes, 4);
+  emitInt32(code, slotOffset(slot));
+}
+
+// mov rax, imm64
+static void emitLoadRax(std::vector<unsigned char>* code, const void* value)
+{
+  const unsigned char bytes[] = {0x48, 0xB8};
+  emitBytes(code, bytes, 2);
+  emitInt64(code, value);
+}
+
+// mov rax, function; call rax
+static void emitCall(std::vector<unsigned char>* code, double (*function)(double))
+{
+  emitLoadRax(code, &function);
+  const unsigned char bytes[] = {0xFF, 0xD0};
+  emitBytes(code, bytes, 2);
+}
+
+static void emitCall(std::vector<unsigned char>* code, double (*function)(double, double))
+{
+  emitLoadRax(code, &function);
+  const unsigned char bytes[] = {0xFF, 0xD0};
+  emitBytes(code, bytes, 2);
+}
+
+static void emitCall(std::vector<unsigned char>* code, FunctionKernel function)
+{
+  emitLoadRax(code, &function);
+  const unsigned char bytes[] = {0xFF, 0xD0};
+  emitBytes(code, bytes, 2);
+}
+
+// Constructor
+// @param compiled The expression to translate, it is copied for the fallback.
+JitExpression::JitExpression(const CompiledExpression& compiled) : compiled_(compiled)
+{
+  this->code_ = 0;
+  this->code_size_ = 0;
+  this->function_ = 0;
+
+  std::vector<unsigned char> code;
+  if(this->compiled_.isValid() && this->generate(&code))
+    this->install(code);
+}
+
+// Destructor
+JitExpression::~JitExpression()
+{
+#ifdef JIT_SUPPORTED
+  if(this->code_ != 0)
+    munmap(this->code_, this->code_size_);
+#endif
+}
+
+// Checks whether native code has been generated.
+// @return True if evaluate() runs native code, false if it falls back to the interpreter.
+bool JitExpression::isNative() const
+{
+  return this->function_ != 0;
+}
+
+// Returns the generated function.
+// @return The function or 0 if no native code could be generated.
+JitFunction JitExpression::getFunction() const
+{
+  return this->function_;
+}
+
+// Evaluates the expression using variable values given in slot order.
+// @param values An array containing a value for each variable of the compiled expression.
+// @return The result of the formula.
+double JitExpression::evaluate(const double* values) const
+{
+  if(this->function_ != 0)
+    return this->function_(values);
+  return this->compiled_.evaluate(values);
+}
+
+// Translates the instructions into x86-64 machine code (System V calling convention, SSE2 scalar doubles).
+// @param code The output machine code.
+// @return False if the expression contains an instruction which cannot be translated.
+bool JitExpression::generate(std::vector<unsigned char>* code) const
+{
+#ifdef JIT_SUPPORTED
+  const CompiledExpression& compiled = this->compiled_;
+  unsigned int slots = compiled.max_depth_ + compiled.temp_count_;
+  unsigned int arguments = slots; // First slot of the argument array
+  for(std::vector<Instruction>::const_iterator it = compiled.instructions_.begin(); it != compiled.instructions_.end(); it++) {
+    if(it->opcode_ == OP_CALL || it->opcode_ == OP_CALL_IMPURE) {
+      slots += CompiledExpression::MAX_CALL_ARGUMENTS;
+      break;
+    }
+  }
+  int frame_size = 8 * slots;
+  if(frame_size % 16 == 0)
+    frame_size += 8; // Keep rsp 16-byte aligned for calls after pushing rbp and rbx
+
+  // push rbp; mov rbp, rsp; push rbx; sub rsp, frame_size; mov rbx, rdi
+  const unsigned char prologue[] = {0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x81, 0xEC};
+  emitBytes(code, prologue, sizeof(prologue));
+  emitInt32(code, frame_size);
+  const unsigned char move_values[] = {0x48, 0x89, 0xFB};
+  emitBytes(code, move_values, sizeof(move_values));
+
+  const double minus_one = -1.0;
+  unsigned int depth = 0;
+  for(std::vector<Instruction>::const_iterator it = compiled.instructions_.begin(); it != compiled.instructions_.end(); it++) {
+    switch(it->opcode_) {
+      case OP_CONSTANT: {
+        // mov rax, value; mov [rbp + disp32], rax
+        emitLoadRax(code, &it->value_);
+        const unsigned char store[] = {0x48, 0x89, 0x85};
+        emitBytes(code, store, sizeof(store));
+        emitInt32(code, slotOffset(depth));
+        depth++;
+        break;
+      }
+      case OP_VARIABLE: {
+        // movsd xmm0, [rbx + disp32]
+        const unsigned char load[] = {0xF2, 0x0F, 0x10, 0x83};
+        emitBytes(code, load, sizeof(load));
+        emitInt32(code, 8 * (int)it->index_);
+        emitStoreSlot(code, depth);
+        depth++;
+        break;
+      }
+      case OP_LOAD:
+        emitLoadSlot(code, 0, compiled.max_depth_ + it->index_);
+        emitStoreSlot(code, depth);
+        depth++;
+        break;
+      case OP_STORE:
+        emitLoadSlot(code, 0, depth - 1);
+        emitStoreSlot(code, compiled.max_depth_ + it->index_);
+        break;
+      case OP_ADD:
+      case OP_SUBTRACT:
+      case OP_MULTIPLY:
+      case OP_DIVIDE:
+      case OP_MAX:
+      case OP_MIN: {
+        // maxsd and minsd return the second operand unless the first one is greater (smaller), like the interpreter
+        unsigned char op = 0;
+        if(it->opcode_ == OP_ADD)
+          op = 0x58;
+        else if(it->opcode_ == OP_SUBTRACT)
+          op = 0x5C;
+        else if(it->opcode_ == OP_MULTIPLY)
+          op = 0x59;
+        else if(it->opcode_ == OP_DIVIDE)
+          op = 0x5E;
+        else if(it->opcode_ == OP_MAX)
+          op = 0x5F;
+        else
+          op = 0x5D;
+        depth--;
+        emitLoadSlot(code, 0, depth - 1);
+        emitArithmetic(code, op, depth);
+        emitStoreSlot(code, depth - 1);
+        break;
+      }
+      case OP_NEGATE: {
+        // movq xmm1, rax; mulsd xmm0, xmm1
+        emitLoadSlot(code, 0, depth - 1);
+        emitLoadRax(code, &minus_one);
+        const unsigned char multiply[] = {0x66, 0x48, 0x0F, 0x6E, 0xC8, 0xF2, 0x0F, 0x59, 0xC1};
+        emitBytes(code, multiply, sizeof(multiply));
+        emitStoreSlot(code, depth - 1);
+        break;
+      }
+      case OP_POWER:
+        depth--;
+        emitLoadSlot(code, 0, depth - 1);
+        emitLoadSlot(code, 1, depth);
+        emitCall(code, static_cast<double (*)(double, double)>(::pow));
+        emitStoreSlot(code, depth - 1);
+        break;
+      case OP_SIN:
+      case OP_COS:
+        emitLoadSlot(code, 0, depth - 1);
+        emitCall(code, it->opcode_ == OP_SIN ? static_cast<double (*)(double)>(::sin) : static_cast<double (*)(double)>(::cos));
+        emitStoreSlot(code, depth - 1);
+        break;
+      case OP_CALL:
+      case OP_CALL_IMPURE: {
+        // Stack entries grow downwards, the kernel expects the arguments in ascending order: argument k is copied to
+        // slot arguments + MAX_CALL_ARGUMENTS - 1 - k, so the array starts at the last slot
+        unsigned int last = arguments + CompiledExpression::MAX_CALL_ARGUMENTS - 1;
+        depth -= it->index_;
+        for(unsigned int k = 0; k < it->index_; k++) {
+          emitLoadSlot(code, 0, depth + k);
+          emitStoreSlot(code, last - k);
+        }
+        // lea rdi, [rbp + disp32]; mov esi, imm32
+        const unsigned char array[] = {0x48, 0x8D, 0xBD};
+        emitBytes(code, array, sizeof(array));
+        emitInt32(code, slotOffset(last));
+        const unsigned char count[] = {0xBE};
+        emitBytes(code, count, sizeof(count));
+        emitInt32(code, (int)it->index_);
+        emitCall(code, it->kernel_);
+        emitStoreSlot(code, depth);
+        depth++;
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+
+  // movsd xmm0, [rbp - 16]; mov rbx, [rbp - 8]; leave; ret
+  emitLoadSlot(code, 0, 0);
+  const unsigned char epilogue[] = {0x48, 0x8B, 0x5D, 0xF8, 0xC9, 0xC3};
+  emitBytes(code, epilogue, sizeof(epilogue));
+  return true;
+#else
+  (void)code;
+  return false;
+#endif
+}
+
+// Copies machine code into executable memory.
+// The memory is made executable only after the code has been written, it is never writable and executable at once.
+// @param code The machine code.
+// @return True if the code can be executed.
+bool JitExpression::install(const std::vector<unsigned char>& code)
+{
+#ifdef JIT_SUPPORTED
+  void* memory = mmap(0, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(memory == MAP_FAILED)
+    return false;
+  std::memcpy(memory, &code[0], code.size());
+  if(mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, code.size());
+    return false;
+  }
+
+  this->code_ = memory;
+  this->code_size_ = code.size();
+  JitFunction function;
+  std::memcpy(&function, &memory, sizeof(function));
+  this->function_ = function;
+  return true;
+#else
+  (void)code;
+  return false;
+#endif
+}
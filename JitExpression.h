@@ -0,0 +1,44 @@
+﻿#ifndef JITEXPRESSION_H
+#define JITEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <vector>
+
+// Additionals
+typedef double (*JitFunction)(const double*);
+
+// Native x86-64 code generated from a compiled expression.
+// The function takes the variable values in slot order and returns the result of the formula. If native code cannot
+// be generated (other architecture, unsupported instruction, no executable memory) the interpreter is used instead.
+class JitExpression
+{
+  public:
+    // Constructor
+    JitExpression(const CompiledExpression&);
+
+    // Destructor
+    ~JitExpression();
+
+    // Methods
+    bool isNative() const;
+    JitFunction getFunction() const;
+    double evaluate(const double*) const;
+
+  private:
+    CompiledExpression compiled_;
+    void* code_;
+    std::size_t code_size_;
+    JitFunction function_;
+
+    // Executable memory is owned by the instance
+    JitExpression(const JitExpression&);
+    JitExpression& operator=(const JitExpression&);
+
+    bool generate(std::vector<unsigned char>*) const;
+    bool install(const std::vector<unsigned char>&);
+
+};
+
+#endif /* JITEXPRESSION_H */
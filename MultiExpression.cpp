@@ -0,0 +1,194 @@
+﻿// Includes
+#include "MultiExpression.h"
+#include "ExpressionDag.h"
+#include "ShuntingYard.h"
+#include <algorithm>
+
+// Constructor
+MultiExpression::MultiExpression()
+{
+  this->output_count_ = 0;
+  ExpressionError error = {ERROR_NONE, ShuntingYard::NO_POSITION};
+  this->setError(error, ShuntingYard::NO_POSITION);
+}
+
+// Destructor
+MultiExpression::~MultiExpression()
+{
+
+}
+
+// Parses formulas and merges them into one program.
+// @param formulas The formulas in infix notation, their results are returned in the same order.
+// @param registry The operators and functions to use, 0 for the built-ins only.
+// @return False if any of the formulas is invalid, see getError().
+bool MultiExpression::compile(const std::vector<std::string>& formulas, const OperatorRegistry* registry)
+{
+  ShuntingYard parser(registry);
+  std::vector<CompiledExpression> expressions;
+  expressions.reserve(formulas.size());
+  for(unsigned int i = 0; i < formulas.size(); i++) {
+    expressions.push_back(parser.compile(formulas[i]));
+    if(!expressions.back().isValid()) {
+      // Error: faulty input string
+      this->setError(parser.getError(), i);
+      this->program_ = CompiledExpression();
+      this->output_count_ = 0;
+      return false;
+    }
+  }
+  return this->build(expressions);
+}
+
+// Merges compiled expressions into one program.
+// Run the ExpressionOptimizer on the expressions first, but not the common-subexpression elimination.
+// @param expressions The expressions, their results are returned in the same order.
+// @return False if there are no expressions (ERROR_EMPTY) or any of them is invalid (its own error) or already contains
+// shared values (ERROR_UNSUPPORTED), see getError().
+bool MultiExpression::build(const std::vector<CompiledExpression>& expressions)
+{
+  this->program_ = CompiledExpression();
+  this->output_count_ = 0;
+  ExpressionError error = {ERROR_NONE, ShuntingYard::NO_POSITION};
+  this->setError(error, ShuntingYard::NO_POSITION);
+  if(expressions.empty()) {
+    // Error: nothing to evaluate
+    error.kind_ = ERROR_EMPTY;
+    this->setError(error, ShuntingYard::NO_POSITION);
+    return false;
+  }
+
+  ExpressionDag dag;
+  for(unsigned int i = 0; i < expressions.size(); i++) {
+    if(!dag.add(expressions[i])) {
+      // Error: faulty expression, or one whose stored values can't be merged
+      if(expressions[i].isValid())
+        error.kind_ = ERROR_UNSUPPORTED;
+      this->setError(expressions[i].isValid() ? error : expressions[i].getError(), i);
+      return false;
+    }
+  }
+
+  this->program_.temp_count_ = dag.lower(&this->program_.instructions_);
+  unsigned int depth = 0;
+  for(std::vector<Instruction>::const_iterator it = this->program_.instructions_.begin(); it != this->program_.instructions_.end(); it++) {
+    depth = depth - CompiledExpression::getArity(*it) + 1;
+    if(depth > this->program_.max_depth_)
+      this->program_.max_depth_ = depth;
+  }
+  this->program_.variables_ = dag.getVariables();
+  this->program_.valid_ = true;
+  this->program_.error_.kind_ = ERROR_NONE;
+  this->program_.error_.position_ = ShuntingYard::NO_POSITION;
+  this->output_count_ = expressions.size();
+  return true;
+}
+
+// Checks whether the formulas were merged successfully.
+// @return True if the formulas can be evaluated.
+bool MultiExpression::isValid() const
+{
+  return this->program_.valid_;
+}
+
+// Returns why the last compile() or build() failed.
+// @return The error, its position refers to the formula returned by getErrorFormula().
+const ExpressionError& MultiExpression::getError() const
+{
+  return this->error_;
+}
+
+// Returns the formula which made the last compile() or build() fail.
+// @return The index of the formula, ShuntingYard::NO_POSITION if there is none.
+unsigned int MultiExpression::getErrorFormula() const
+{
+  return this->error_formula_;
+}
+
+// Returns the number of formulas.
+// @return The number of results of every evaluation.
+unsigned int MultiExpression::getOutputCount() const
+{
+  return this->output_count_;
+}
+
+// Returns the variables used by any of the formulas.
+// @return The variable names, the position of a name is its slot index.
+const std::vector<std::string>& MultiExpression::getVariables() const
+{
+  return this->program_.variables_;
+}
+
+// Returns the size of the merged program.
+// @return The number of instructions.
+unsigned int MultiExpression::getInstructionCount() const
+{
+  return this->program_.instructions_.size();
+}
+
+// Evaluates all formulas using variable values given in slot order.
+// @param values An array containing a value for each entry of getVariables().
+// @param outputs Receives the result of every formula, 0 if the formulas are invalid.
+void MultiExpression::evaluate(const double* values, double* outputs) const
+{
+  if(!this->program_.valid_) {
+    std::fill(outputs, outputs + this->output_count_, 0.0);
+    return;
+  }
+
+  // The results are the bottom of the stack once the program has run
+  const CompiledExpression& program = this->program_;
+  if(program.max_depth_ + program.temp_count_ <= CompiledExpression::STACK_SIZE) {
+    double stack[CompiledExpression::STACK_SIZE];
+    program.execute(values, stack, stack + program.max_depth_);
+    std::copy(stack, stack + this->output_count_, outputs);
+    return;
+  }
+  std::vector<double> stack(program.max_depth_ + program.temp_count_);
+  program.execute(values, &stack[0], &stack[0] + program.max_depth_);
+  std::copy(stack.begin(), stack.begin() + this->output_count_, outputs);
+}
+
+// Evaluates all formulas for many rows of variable values at once.
+// @param columns An array containing one column of row values for each entry of getVariables().
+// @param outputs An array containing one column per formula, each receiving one result per row.
+// @param rows The number of rows.
+void MultiExpression::evaluateBatch(const double* const* columns, double* const* outputs, std::size_t rows) const
+{
+  if(!this->program_.valid_) {
+    for(unsigned int i = 0; i < this->output_count_; i++)
+      std::fill(outputs[i], outputs[i] + rows, 0.0);
+    return;
+  }
+
+  this->program_.executeBatch(columns, outputs, this->output_count_, 0, rows);
+}
+
+// Evaluates all formulas for many rows of variable values on the threads of a pool.
+// @param columns An array containing one column of row values for each entry of getVariables().
+// @param outputs An array containing one column per formula, each receiving one result per row.
+// @param rows The number of rows.
+// @param pool The thread pool to use.
+void MultiExpression::evaluateBatch(const double* const* columns, double* const* outputs, std::size_t rows, ThreadPool* pool) const
+{
+  std::size_t chunks = (rows + CompiledExpression::BATCH_CHUNK_SIZE - 1) / CompiledExpression::BATCH_CHUNK_SIZE;
+  if(!this->program_.valid_ || chunks <= 1 || pool->getThreadCount() <= 1) {
+    this->evaluateBatch(columns, outputs, rows);
+    return;
+  }
+
+  pool->run(chunks, [this, columns, outputs, rows](std::size_t chunk) {
+    std::size_t begin = chunk * CompiledExpression::BATCH_CHUNK_SIZE;
+    std::size_t end = (rows - begin < CompiledExpression::BATCH_CHUNK_SIZE) ? rows : begin + CompiledExpression::BATCH_CHUNK_SIZE;
+    this->program_.executeBatch(columns, outputs, this->output_count_, begin, end);
+  });
+}
+
+// Records why merging the formulas failed.
+// @param error The error.
+// @param formula The index of the formula causing it, ShuntingYard::NO_POSITION if none.
+void MultiExpression::setError(const ExpressionError& error, unsigned int formula)
+{
+  this->error_ = error;
+  this->error_formula_ = formula;
+}
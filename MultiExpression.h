@@ -0,0 +1,48 @@
+﻿#ifndef MULTIEXPRESSION_H
+#define MULTIEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include "OperatorRegistry.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Several formulas merged into one program which calculates all of their results in one pass.
+// The formulas share their variables, and subexpressions common to several formulas are calculated only once.
+// Like CompiledExpression, all evaluate methods are const and can be called by any number of threads at the same time.
+// Nothing is printed on errors; getError() and getErrorFormula() return why and for which formula merging failed.
+class MultiExpression
+{
+  public:
+    // Constructor
+    MultiExpression();
+
+    // Destructor
+    ~MultiExpression();
+
+    // Methods
+    bool compile(const std::vector<std::string>&, const OperatorRegistry* registry = 0);
+    bool build(const std::vector<CompiledExpression>&);
+    bool isValid() const;
+    const ExpressionError& getError() const;
+    unsigned int getErrorFormula() const;
+    unsigned int getOutputCount() const;
+    const std::vector<std::string>& getVariables() const;
+    unsigned int getInstructionCount() const;
+    void evaluate(const double*, double*) const;
+    void evaluateBatch(const double* const*, double* const*, std::size_t) const;
+    void evaluateBatch(const double* const*, double* const*, std::size_t, ThreadPool*) const;
+
+  private:
+    CompiledExpression program_; // Leaves one value per formula on the stack
+    unsigned int output_count_;
+    ExpressionError error_; // Why the last compile() or build() failed
+    unsigned int error_formula_; // Index of the formula causing error_, ShuntingYard::NO_POSITION if none
+
+    void setError(const ExpressionError&, unsigned int);
+
+};
+
+#endif /* MULTIEXPRESSION_H */
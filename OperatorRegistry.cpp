@@ -0,0 +1,214 @@
+﻿// Includes
+#include "OperatorRegistry.h"
+#include <ctype.h>
+
+// Kernels of the built-ins, used when they are called through a definition instead of their opcode
+static double addKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_ADD, values);
+}
+
+static double subtractKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_SUBTRACT, values);
+}
+
+static double multiplyKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_MULTIPLY, values);
+}
+
+static double divideKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_DIVIDE, values);
+}
+
+static double powerKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_POWER, values);
+}
+
+static double negateKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_NEGATE, values);
+}
+
+static double sinKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_SIN, values);
+}
+
+static double cosKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_COS, values);
+}
+
+static double maxKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_MAX, values);
+}
+
+static double minKernel(const double* values, unsigned int)
+{
+  return CompiledExpression::calculate(OP_MIN, values);
+}
+
+// Constructor
+OperatorRegistry::OperatorRegistry()
+{
+  const OperatorDefinition builtins[] = {
+    {"+", 2, 4, 1, true, OP_ADD, addKernel},
+    {"-", 2, 4, 1, true, OP_SUBTRACT, subtractKernel},
+    {"*", 2, 3, 1, true, OP_MULTIPLY, multiplyKernel},
+    {"/", 2, 3, 1, true, OP_DIVIDE, divideKernel},
+    {"^", 2, 2, 2, true, OP_POWER, powerKernel},
+    {"#", 1, 1, 1, true, OP_NEGATE, negateKernel}, // Replacement for unary minus sign
+    {"sin", 1, 1, 0, true, OP_SIN, sinKernel},
+    {"cos", 1, 1, 0, true, OP_COS, cosKernel},
+    {"max", 2, 1, 0, true, OP_MAX, maxKernel},
+    {"min", 2, 1, 0, true, OP_MIN, minKernel}
+  };
+  for(unsigned int i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    this->addDefinition(builtins[i], builtins[i].associativity_ == 0);
+  this->setError(ERROR_NONE, ShuntingYard::NO_POSITION);
+}
+
+// Destructor
+OperatorRegistry::~OperatorRegistry()
+{
+
+}
+
+// Registers an operator.
+// @param name The symbol, e.g. % or <=. It may not contain letters, digits, spaces, parentheses, commas or points.
+// @param arity 1 for a prefix operator, 2 for a binary operator.
+// @param precedence The precedence between 1 and 255, lower values bind tighter (see the built-ins).
+// @param associativity 1 = left, 2 = right.
+// @param pure Whether the result only depends on the operands.
+// @param kernel The function calculating the result from the operands.
+// @return The index of the definition or <0 if an error occured.
+int OperatorRegistry::registerOperator(const std::string& name, unsigned int arity, unsigned int precedence, unsigned int associativity, bool pure, FunctionKernel kernel)
+{
+  this->setError(ERROR_NONE, ShuntingYard::NO_POSITION);
+  for(unsigned int i = 0; i < name.size(); i++) {
+    if(isalnum(name[i]) || name[i] == ' ' || name[i] == '(' || name[i] == ')' || name[i] == ',' || name[i] == '.') {
+      // Error: the parser could not read this operator
+      this->setError(ERROR_INVALID_DEFINITION, i);
+      return -1;
+    }
+  }
+  if(name.empty() || arity < 1 || arity > 2 || precedence < 1 || precedence > 255 || associativity < 1 || associativity > 2 || kernel == 0) {
+    // Error: invalid definition
+    this->setError(ERROR_INVALID_DEFINITION, ShuntingYard::NO_POSITION);
+    return -1;
+  }
+
+  OperatorDefinition definition = {name, (int)arity, precedence, associativity, pure, pure ? OP_CALL : OP_CALL_IMPURE, kernel};
+  return this->addDefinition(definition, false);
+}
+
+// Registers a function.
+// @param name The name, consisting of at least two letters since single letters are variables.
+// @param arity The number of arguments up to CompiledExpression::MAX_CALL_ARGUMENTS or VARIADIC.
+// @param pure Whether the result only depends on the arguments.
+// @param kernel The function calculating the result from the arguments.
+// @return The index of the definition or <0 if an error occured.
+int OperatorRegistry::registerFunction(const std::string& name, int arity, bool pure, FunctionKernel kernel)
+{
+  this->setError(ERROR_NONE, ShuntingYard::NO_POSITION);
+  for(unsigned int i = 0; i < name.size(); i++) {
+    if(!isalpha(name[i])) {
+      // Error: the parser could not read this function
+      this->setError(ERROR_INVALID_DEFINITION, i);
+      return -1;
+    }
+  }
+  if(name.size() < 2 || arity < VARIADIC || arity > (int)CompiledExpression::MAX_CALL_ARGUMENTS || kernel == 0) {
+    // Error: invalid definition
+    this->setError(ERROR_INVALID_DEFINITION, ShuntingYard::NO_POSITION);
+    return -1;
+  }
+
+  OperatorDefinition definition = {name, arity, 1, 0, pure, pure ? OP_CALL : OP_CALL_IMPURE, kernel};
+  return this->addDefinition(definition, true);
+}
+
+// Looks up an operator.
+// @param name The symbol.
+// @return The index of the definition or -1 if there is no such operator.
+int OperatorRegistry::findOperator(std::string_view name) const
+{
+  std::map<std::string, unsigned int, std::less<> >::const_iterator it = this->operators_.find(name);
+  return (it == this->operators_.end()) ? -1 : (int)it->second;
+}
+
+// Looks up a function.
+// @param name The name.
+// @return The index of the definition or -1 if there is no such function.
+int OperatorRegistry::findFunction(std::string_view name) const
+{
+  std::map<std::string, unsigned int, std::less<> >::const_iterator it = this->functions_.find(name);
+  return (it == this->functions_.end()) ? -1 : (int)it->second;
+}
+
+// Looks up the operator or function of a compiled call, e.g. to store it by name.
+// @param kernel The kernel of the call.
+// @param opcode OP_CALL or OP_CALL_IMPURE.
+// @return The index of the first definition with this kernel and purity or -1 if there is none.
+int OperatorRegistry::findKernel(FunctionKernel kernel, OpCode opcode) const
+{
+  for(unsigned int i = 0; i < this->definitions_.size(); i++) {
+    if(this->definitions_[i].kernel_ == kernel && this->definitions_[i].opcode_ == opcode)
+      return i;
+  }
+  return -1;
+}
+
+// Returns a definition.
+// @param index The index as returned by findOperator() or findFunction().
+// @return The definition.
+const OperatorDefinition& OperatorRegistry::getDefinition(unsigned int index) const
+{
+  return this->definitions_[index];
+}
+
+// Returns the error of the last call of registerOperator() or registerFunction().
+// @return The error, ERROR_NONE if the call succeeded. The position is the invalid character of the name, if any.
+const ExpressionError& OperatorRegistry::getError() const
+{
+  return this->error_;
+}
+
+// Returns the registry used by parsers without a registry of their own.
+// @return A registry containing only the built-ins.
+const OperatorRegistry& OperatorRegistry::getDefault()
+{
+  static const OperatorRegistry registry;
+  return registry;
+}
+
+// Stores a definition unless its name is taken.
+// @param definition The definition.
+// @param function Whether it is a function or an operator.
+// @return The index of the definition or <0 if an error occured.
+int OperatorRegistry::addDefinition(const OperatorDefinition& definition, bool function)
+{
+  std::map<std::string, unsigned int, std::less<> >& names = function ? this->functions_ : this->operators_;
+  if(names.find(definition.name_) != names.end()) {
+    // Error: already defined
+    this->setError(ERROR_ALREADY_DEFINED, ShuntingYard::NO_POSITION);
+    return -1;
+  }
+  names.insert(std::pair<std::string, unsigned int>(definition.name_, this->definitions_.size()));
+  this->definitions_.push_back(definition);
+  return this->definitions_.size() - 1;
+}
+
+// Records an error of the current registration.
+// @param kind The kind of the error.
+// @param position The position of the error in the name.
+void OperatorRegistry::setError(ErrorKind kind, unsigned int position)
+{
+  this->error_.kind_ = kind;
+  this->error_.position_ = position;
+}
@@ -0,0 +1,63 @@
+﻿#ifndef OPERATORREGISTRY_H
+#define OPERATORREGISTRY_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Additionals
+typedef struct OperatorDefinition
+{
+  std::string name_;
+  int arity_; // Number of operands, OperatorRegistry::VARIADIC for functions taking any number of arguments
+  unsigned int precedence_; // Operators only, lower values bind tighter
+  unsigned int associativity_; // Operators only, 1 = left, 2 = right
+  bool pure_; // The result only depends on the arguments, so calls with constant arguments can be folded
+  OpCode opcode_; // Dedicated opcode of the built-ins, OP_CALL or OP_CALL_IMPURE for registered kernels
+  FunctionKernel kernel_;
+} OperatorDefinition;
+
+// Operators and functions known to the parser.
+// Every registry starts with the built-in operators (+, -, *, /, ^, # with the precedences 4, 4, 3, 3, 2, 1) and
+// functions (sin, cos, max, min), which keep their dedicated opcodes. Registered operators and functions are compiled
+// into calls of their kernel, without any lookup at evaluation time. Unary operators are prefix operators.
+// Register everything before the registry is used by a parser; a registry can then be shared by any number of threads.
+// Nothing is printed on errors; getError() returns the kind of the error of the last registration.
+class OperatorRegistry
+{
+  public:
+    // Constructor
+    OperatorRegistry();
+
+    // Destructor
+    ~OperatorRegistry();
+
+    // Methods
+    int registerOperator(const std::string&, unsigned int, unsigned int, unsigned int, bool, FunctionKernel);
+    int registerFunction(const std::string&, int, bool, FunctionKernel);
+    int findOperator(std::string_view) const;
+    int findFunction(std::string_view) const;
+    int findKernel(FunctionKernel, OpCode) const;
+    const OperatorDefinition& getDefinition(unsigned int) const;
+    const ExpressionError& getError() const;
+    static const OperatorRegistry& getDefault();
+
+    // Arity of functions taking between 0 and CompiledExpression::MAX_CALL_ARGUMENTS arguments
+    static const int VARIADIC = -1;
+
+  private:
+    std::vector<OperatorDefinition> definitions_;
+    std::map<std::string, unsigned int, std::less<> > operators_;
+    std::map<std::string, unsigned int, std::less<> > functions_;
+    ExpressionError error_; // Error of the last registration, the position is a character of the name
+
+    int addDefinition(const OperatorDefinition&, bool);
+    void setError(ErrorKind, unsigned int);
+
+};
+
+#endif /* OPERATORREGISTRY_H */
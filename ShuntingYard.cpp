@@ -1,545 +1,705 @@
-﻿// Includes
-#include "ShuntingYard.h"
-#include <algorithm>
-#include <cmath>
-#include <iostream>
-#include <deque>
-#include <string>
-#include <ctype.h>
-#include <stdio.h>
-#include <stdlib.h>
-
-// Constructor
-ShuntingYard::ShuntingYard()
-{
-  this->operators_.insert(std::pair<std::string, unsigned int>("+", 2));
-  this->operators_.insert(std::pair<std::string, unsigned int>("-", 2));
-  this->operators_.insert(std::pair<std::string, unsigned int>("*", 2));
-  this->operators_.insert(std::pair<std::string, unsigned int>("/", 2));
-  this->operators_.insert(std::pair<std::string, unsigned int>("^", 2));
-  this->operators_.insert(std::pair<std::string, unsigned int>("#", 1)); // Replacement for unary minus sign
-
-  this->functions_.insert(std::pair<std::string, unsigned int>("sin", 1));
-  this->functions_.insert(std::pair<std::string, unsigned int>("cos", 1));
-  this->functions_.insert(std::pair<std::string, unsigned int>("max", 2));
-  this->functions_.insert(std::pair<std::string, unsigned int>("min", 2));
-}
-
-// Destructor
-ShuntingYard::~ShuntingYard()
-{
-
-}
-
-// Reads an input string in infix notation and converts it to postfix notation.
-// @param infix_string The string to convert.
-// @return Deque containing postfix notation of input string.
-std::deque<Token> ShuntingYard::getPostfix(std::string infix_string)
-{
-  std::deque<Token> output;
-  std::stack<Token> opstack;
-  char current;
-  std::string input_sanitized = infix_string;
-  input_sanitized.erase(std::remove(input_sanitized.begin(), input_sanitized.end(), ' '), input_sanitized.end());
-  input_sanitized = this->fixOperators(input_sanitized);
-
-  // Start parsing the string in infix notation
-  for(unsigned int i = 0; i < input_sanitized.size(); i++) {
-    current = input_sanitized.at(i);
-    // Number
-    if(isdigit(current)) {
-      int size = this->handleNumber(input_sanitized, i, &output);
-      if(size == -1) {
-        this->reportError("Infix notation contains invalid numbers. Please use only digits and at most one decimal point (.).");
-        return std::deque<Token>();
-      }
-      i += (size - 1);
-    }
-    // Parentheses
-    else if(current == '(' || current == ')') {
-      int ret = this->handleParentheses(current, &output, &opstack);
-      if(ret == -1) {
-        this->reportError("There seems to be an error with the parentheses.");
-        return std::deque<Token>();
-      }
-    }
-    // Function argument separator (,)
-    else if(current == ',') {
-      int ret = this->handleFunctionArgumentSeparator(&output, &opstack);
-      if(ret == -1) {
-        this->reportError("There seems to be an error with the function separator or the parentheses.");
-        return std::deque<Token>();
-      }
-    }
-    // Operator
-    else if(!isalnum(current)) {
-      if(current == '-' && (i + 1) < input_sanitized.size() && input_sanitized.at(i + 1) == '-') {
-        // Skip double minus (--)
-        i++;
-        continue;
-      }
-      int size = this->handleOperator(input_sanitized, i, &output, &opstack);
-      if(size == -1) {
-        this->reportError("There was an error while trying to parse an operator.");
-        return std::deque<Token>();
-      }
-      i += (size - 1);
-    }
-    // Function or variable
-    else if(isalpha(current)) {
-      int size = this->handleFunctionOrVariable(input_sanitized, i, &output, &opstack);
-      if(size == -1) {
-        this->reportError("There was an error reading a function or variable (alphabetic letter is not part of a function or variable).");
-        return std::deque<Token>();
-      }
-      i += (size - 1);
-    }
-    else {
-      // Error: Unknown input
-      this->reportError("There was an error while reading the input (unknown symbols).");
-      return std::deque<Token>();
-    }
-  }
-
-  // No more tokens
-  Token token_top;
-  while(opstack.size() > 0) {
-    token_top = opstack.top();
-    if(token_top.type_ == LPARENTHESIS || token_top.type_ == RPARENTHESIS) {
-      // Error: Mismatched parentheses
-      this->reportError("There seems to be an error with the parentheses.");
-      return std::deque<Token>();
-    }
-    output.push_back(token_top);
-    opstack.pop();
-  }
-
-  return output;
-}
-
-// Prints a deque containing tokens in postfix notation.
-// @param postfix_deque The deque containing tokens in postfix notation.
-void ShuntingYard::printPostfix(std::deque<Token> postfix_deque)
-{
-  if(postfix_deque.empty()) {
-    this->reportError("No tokens could be found.");
-    return;
-  }
-
-  std::cout << "------------------------------------" << std::endl;
-  std::cout << "Number of tokens: " << postfix_deque.size() << std::endl;
-  std::cout << "[0] = Number (int or double)" << std::endl;
-  std::cout << "[1] = Operator (+, -, *, /, ^)" << std::endl;
-  std::cout << "[2] = Variable (x, y, z, ...)" << std::endl;
-  std::cout << "[3] = Function (sin, cos, ...)" << std::endl;
-  std::cout << "------------------------------------" << std::endl;
-  std::string postfix_string = "Simple:";
-  for(std::deque<Token>::iterator it = postfix_deque.begin(); it != postfix_deque.end(); it++) {
-    postfix_string += (" " + it->content_ );
-  }
-  postfix_string += "\nDetailed:";
-  for(std::deque<Token>::iterator it = postfix_deque.begin(); it != postfix_deque.end(); it++) {
-    postfix_string += (" " + it->content_ + "[" + std::to_string(it->type_) + "]");
-  }
-  std::cout << postfix_string << std::endl;
-}
-
-// Evaluates a formula using given variable definitions.
-// @param infix_string The deque containing tokens in postfix notation.
-// @param definitions A map containing a value for each variable.
-double ShuntingYard::evaluate(std::string infix_string, std::map<std::string, double> definitions)
-{
-  std::deque<Token> postfix_deque = this->getPostfix(infix_string);
-  if(postfix_deque.empty()) {
-    // Error: faulty input string
-    this->reportError("There was an error while trying to evaluate the formula.");
-    return 0;
-  }
-
-  std::stack<double> valstack;
-
-  Token token;
-  for(std::deque<Token>::iterator it = postfix_deque.begin(); it != postfix_deque.end(); it++) {
-    token = (*it);
-    if(token.type_ == NUMBER) {
-      valstack.push(std::stod(token.content_));
-    }
-    else if(token.type_ == VARIABLE) {
-      std::map<std::string, double>::iterator def_it = definitions.find(token.content_);
-      if(def_it == definitions.end()) {
-        // Error: missing variable definitions
-        this->reportError("Missing variable definition for \"" + token.content_ + "\".");
-        return 0;
-      }
-      valstack.push(def_it->second);
-    }
-    else if(token.type_ == OPERATOR || token.type_ == FUNCTION) {
-      int ret = this->calculateFunctionOrOperator(&token, &valstack);
-      if(ret == 1 || ret == 2) {
-        // Error: not enough values on stack for this operator
-        this->reportError("There are not enough values available for this operator.");
-        return 0;
-      }
-    }
-    else {
-      // Error: invalid token type
-      this->reportError("An invalid token type was encountered while trying to evaluate the formula.");
-      return 0;
-    }
-  }
-
-  if(valstack.size() == 1) {
-    double result = valstack.top();
-    return result;
-  }
-  else {
-    // Error: user input has too many values
-    this->reportError("The input contains too many values.");
-    return 0;
-  }
-
-  return 0;
-}
-
-// Replaces substrings in a string until no more occurrences of this substring are found.
-// @param input The input string.
-// @param str_old The substring to replace.
-// @param str_new The new substring.
-// @return The new string with all occurrences of the specified substring removed.
-std::string ShuntingYard::replaceAllRepeated(std::string input, std::string str_old, std::string str_new) {
-  std::string input_new = input;
-  std::string input_old = "";
-  int old_length = str_old.size();
-  int new_length = str_new.size();
-  while(input_new.compare(input_old) != 0) {
-    input_old = input_new;
-    int index = 0;
-    while(true) {
-      index = input_new.find(str_old, index);
-      if(index == std::string::npos)
-        break;
-      input_new.replace(index, old_length, str_new);
-      index += new_length;
-    }
-  }
-  return input_new;
-}
-
-// Tries to fix operators chains.
-// @param input The input string.
-// @return The new string with the operators fixed.
-std::string ShuntingYard::fixOperators(std::string input) {
-  std::string input_new = input;
-  bool end_condition = ((input_new.find("++", 0) == std::string::npos) && (input_new.find("--", 0) == std::string::npos) &&
-    (input_new.find("+-", 0) == std::string::npos) && (input_new.find("-+", 0) == std::string::npos));
-  while(end_condition == false) {
-    input_new = replaceAllRepeated(input_new, "++", "+");
-    input_new = replaceAllRepeated(input_new, "--", "+");
-    input_new = replaceAllRepeated(input_new, "+-", "-");
-    input_new = replaceAllRepeated(input_new, "-+", "-");
-    end_condition = ((input_new.find("++", 0) == std::string::npos) && (input_new.find("--", 0) == std::string::npos) &&
-      (input_new.find("+-", 0) == std::string::npos) && (input_new.find("-+", 0) == std::string::npos));
-  }
-  return input_new;
-}
-
-// Handles a number in the original input string.
-// @param output The final output queue.
-// @return The length of the resulting number or <0 if an error occured.
-int ShuntingYard::handleNumber(std::string input, unsigned int start_index, std::deque<Token>* output)
-{
-  std::string number;
-  int decimal_point_count = 0;
-  for(unsigned int i = start_index; i < input.size(); i++) {
-    if(isdigit(input.at(i))) {
-      number.push_back(input.at(i));
-    }
-    else if(input.at(i) == '.') {
-      number.push_back(input.at(i));
-      decimal_point_count++;
-    }
-    else {
-      // Break if number is finished
-      break;
-    }
-  }
-
-  if(decimal_point_count == 0 || (decimal_point_count == 1 && number.front() != '.' && number.back() != '.')) {
-    Token token;
-    token.type_ = NUMBER;
-    token.content_ = number;
-    token.precedence_ = 0;
-    token.associativity_ = 0;
-    output->push_back(token);
-    return number.size();
-  }
-  else {
-    // Error: invalid number
-    return -1;
-  }
-}
-
-// Handles a parenthesis in the original input string.
-// @param parentheses The parenthesis.
-// @param output The final output queue.
-// @param opstack The operator stack.
-// @return An error code, 0 = no error.
-int ShuntingYard::handleParentheses(char parentheses, std::deque<Token>* output, std::stack<Token>* opstack)
-{
-  Token token;
-  if(parentheses ==  '(')
-    token.type_ = LPARENTHESIS;
-  else if(parentheses == ')')
-    token.type_ = RPARENTHESIS;
-  token.content_ = parentheses;
-  token.precedence_ = 0;
-  token.associativity_ = 0;
-
-  if(token.type_ == LPARENTHESIS) {
-    opstack->push(token);
-    return 0;
-  }
-  else if(token.type_ == RPARENTHESIS) {
-    // Push all stack tokens to the deque until left parenthesis is found
-    Token token_top;
-    while(!opstack->empty() && (token_top = opstack->top()).type_ != LPARENTHESIS) {
-      output->push_back(token_top);
-      opstack->pop();
-    }
-
-    if(opstack->empty()) {
-      // Error: Mismatched parentheses
-      return -1;
-    }
-
-    // Remove left parenthesis from stack now
-    opstack->pop();
-
-    // If top token is now function, push it to the deque
-    if(!opstack->empty() && (token_top = opstack->top()).type_ == FUNCTION) {
-      output->push_back(token_top);
-      opstack->pop();
-    }
-
-  }
-
-  return 0;
-}
-
-// Handles a function argument separator in the original input string.
-// @param output The final output queue.
-// @param opstack The operator stack.
-// @return An error code, 0 = no error.
-int ShuntingYard::handleFunctionArgumentSeparator(std::deque<Token>* output, std::stack<Token>* opstack)
-{
-  // Push all stack tokens to the deque until left parenthesis is found
-  if(opstack->empty()) {
-    // Error: Mismatched parentheses
-    return -1;
-  }
-  Token token_top = opstack->top();
-  while(token_top.type_ != LPARENTHESIS) {
-    output->push_back(token_top);
-    opstack->pop();
-    if(opstack->empty()) {
-      // Error: Mismatched parentheses
-      return -1;
-    }
-    token_top = opstack->top();
-  }
-  if(token_top.type_ != LPARENTHESIS) {
-    // Error: Mismatched parentheses
-    return -1;
-  }
-  return 0;
-}
-
-// Handles an operator in the original input string.
-// @param input The input string.
-// @param start_index The starting index of this operation.
-// @param output The final output queue.
-// @param opstack The operator stack.
-// @return The length of the resulting operator or <0 if an error occured.
-int ShuntingYard::handleOperator(std::string input, unsigned int start_index, std::deque<Token>* output, std::stack<Token>* opstack)
-{
-  std::string op;
-  for(unsigned int i = start_index; i < input.size(); i++) {
-    if(input.at(i) == '(' || isalnum(input.at(i))) {
-      break;
-    }
-    op.push_back(input.at(i));
-  }
-
-  if(this->operators_.find(op) == this->operators_.end()) {
-    // Error: no such operator
-    std::cout << "op: " << op << std::endl;
-    return -1;
-  }
-
-  Token token;
-  token.type_ = OPERATOR;
-  token.content_ = op;
-  if(op == "+" || op == "-") {
-    token.precedence_ = 4;
-    // TODO: Adapt for multi-character operators
-    std::string predecessor(1, input.at(start_index - 1));
-    if(op == "-" && start_index == 0 || this->operators_.find(predecessor) != this->operators_.end() || input.at(start_index - 1) == '(') {
-      // Unary minus operator
-      token.content_ = "#";
-      token.precedence_ = 1;
-    }
-  }
-  else if(op == "*" || op == "/")
-    token.precedence_ = 3;
-  else if(op == "^")
-    token.precedence_ = 2;
-  if(op == "+" || op == "-" || op == "*" || op == "/")
-    token.associativity_ = 1;
-  else if(op == "^")
-    token.associativity_ = 2;
-  
-  Token token_top;
-  while((!opstack->empty() && (token_top = opstack->top()).type_ == OPERATOR) &&
-    ((token_top.associativity_ == 1 && token_top.precedence_ <= token.precedence_) ||
-    (token_top.associativity_ == 2 && token_top.precedence_ < token.precedence_))) {
-    // Left-associative and precedence less then or equal to that of op OR right-associative and precedence less than that of op
-    output->push_back(token_top);
-    opstack->pop();
-  }
-
-  opstack->push(token);
-
-  return op.size();
-}
-
-// Handles a function or variable in the original input string.
-// @param input The input string.
-// @param start_index The starting index of this operation.
-// @param output The final output queue.
-// @param opstack The operator stack.
-// @return The length of the resulting function or variable or <0 if an error occured.
-int ShuntingYard::handleFunctionOrVariable(std::string input, unsigned int start_index, std::deque<Token>* output, std::stack<Token>* opstack)
-{
-  std::string thing;
-  unsigned int i = start_index;
-  for(; i < input.size(); i++) {
-    if(isalpha(input.at(i))) {
-      thing.push_back(input.at(i));
-    }
-    else {
-      // Break on first occurrence of non-alpha character
-      break;
-    }
-  }
-
-  Token token;
-  if(this->functions_.find(thing) != this->functions_.end() && input.at(i) == '(') {
-    token.type_ = FUNCTION;
-    token.precedence_ = 1;
-  }
-  else if(thing.size() == 1) {
-    token.type_ = VARIABLE;
-    token.precedence_ = 0;
-  }
-  else {
-    // Error: alphabetic letter is not part of a function or variable
-    return -1;
-  }
-  token.content_ = thing;
-  token.associativity_ = 0;
-
-  if(token.type_ == FUNCTION)
-    opstack->push(token);
-  else if(token.type_ == VARIABLE)
-    output->push_back(token);
-  
-  return thing.size();
-}
-
-// Calculates a new value using an operator or a function and pushes the new value to the stack.
-// @param token The token to use as an operator or function.
-// @param valstack A stack containing all previous values.
-// @return An error code, 0 = no error.
-int ShuntingYard::calculateFunctionOrOperator(Token* token, std::stack<double>* valstack)
-{
-  unsigned int val_count;
-  if(token->type_ == OPERATOR && (valstack->size() < (val_count = ((this->operators_.find(token->content_))->second)))) {
-    // Error: not enough values on stack for this operator
-    return 1;
-  }
-  if(token->type_ == FUNCTION && (valstack->size() < (val_count = ((this->functions_.find(token->content_))->second)))) {
-    // Error: not enough values on stack for this function
-    return 2;
-  }
-
-  std::vector<double> values = this->popValuesFromStack(valstack, val_count);
-
-  // Remark: Values are on stack in reverse order
-  if(token->type_ == OPERATOR) {
-    if(token->content_ == "+") {
-      double result = values.at(1) + values.at(0);
-      valstack->push(result);
-    }
-    else if(token->content_ == "-") {
-      double result = values.at(1) - values.at(0);
-      valstack->push(result);
-    }
-    else if(token->content_ == "*") {
-      double result = values.at(1) * values.at(0);
-      valstack->push(result);
-    }
-    else if(token->content_ == "/") {
-      double result = values.at(1) / values.at(0);
-      valstack->push(result);
-    }
-    else if(token->content_ == "^") {
-      double result = pow(values.at(1), values.at(0));
-      valstack->push(result);
-    }
-    else if(token->content_ == "#") {
-      double result = values.at(0) * -1.0;
-      valstack->push(result);
-    }
-  }
-  else if(token->type_ == FUNCTION) {
-    if(token->content_ == "sin") {
-      double result = sin(values.at(0));
-      valstack->push(result);
-    }
-    else if(token->content_ == "cos") {
-      double result = cos(values.at(0));
-      valstack->push(result);
-    }
-    else if(token->content_ == "max") {
-      double result = (values.at(1) > values.at(0)) ? values.at(1) : values.at(0);
-      valstack->push(result);
-    }
-    else if(token->content_ == "min") {
-      double result = (values.at(1) < values.at(0)) ? values.at(1) : values.at(0);
-      valstack->push(result);
-    }
-  }
-
-  return 0;
-}
-
-// Removes values from the stack and stores them into a vector.
-// @param valstack The stack to remove values from.
-// @param val_count A number indicating how many values to remove.
-// @return A vector containing the removed values.
-std::vector<double> ShuntingYard::popValuesFromStack(std::stack<double>* valstack, unsigned int val_count)
-{
-  std::vector<double> values;
-  while(val_count-- > 0) {
-    values.push_back(valstack->top());
-    valstack->pop();
-  }
-  return values;
-}
-
-// Helper function to print errors.
-// @param message The error message.
-void ShuntingYard::reportError(std::string message)
-{
-  std::cout << "[ERROR] " << message << std::endl;
-}
+﻿// Includes
+#include "ShuntingYard.h"
+#include "CompiledExpression.h"
+#include "ExpressionCounters.h"
+#include "OperatorRegistry.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <deque>
+#include <string>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Constructor
+// @param registry The operators and functions to use, 0 for the built-ins only.
+ShuntingYard::ShuntingYard(const OperatorRegistry* registry)
+{
+  this->setRegistry(registry);
+  this->counters_ = 0;
+  this->setLimits(0, 0);
+  this->error_.kind_ = ERROR_NONE;
+  this->error_.position_ = NO_POSITION;
+}
+
+// Destructor
+ShuntingYard::~ShuntingYard()
+{
+
+}
+
+// Changes the operators and functions used by later calls.
+// @param registry The operators and functions to use, 0 for the built-ins only.
+void ShuntingYard::setRegistry(const OperatorRegistry* registry)
+{
+  this->registry_ = (registry != 0) ? registry : &OperatorRegistry::getDefault();
+}
+
+// Sets the counters recording the parses and errors of this parser and the evaluations of the expressions it compiles.
+// Only used if built with EXPRESSION_COUNTERS defined.
+// @param counters The counters, which have to outlive the parser and the compiled expressions, 0 to record nothing.
+void ShuntingYard::setCounters(ExpressionCounters* counters)
+{
+  this->counters_ = counters;
+}
+
+// Sets the limits on formulas, e.g. for services parsing untrusted input. Formulas exceeding them fail with
+// ERROR_TOO_LONG or ERROR_TOO_DEEP.
+// @param max_length The maximum number of characters, 0 or values above MAX_LENGTH for MAX_LENGTH.
+// @param max_depth The maximum nesting depth, counted as the parentheses, functions and operators waiting for their
+// operands at the same time (e.g. 3 for sin(2^x)), 0 for no limit.
+void ShuntingYard::setLimits(std::size_t max_length, std::size_t max_depth)
+{
+  this->max_length_ = max_length;
+  if(max_length == 0 || max_length > MAX_LENGTH)
+    this->max_length_ = MAX_LENGTH;
+  this->max_depth_ = (max_depth != 0) ? max_depth : (std::size_t)-1;
+}
+
+// Reads an input string in infix notation and converts it to postfix notation.
+// @param input The string to convert.
+// @return Deque containing postfix notation of input string, empty if an error occured.
+std::deque<Token> ShuntingYard::getPostfix(std::string_view input)
+{
+#ifdef EXPRESSION_COUNTERS
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+  std::deque<Token> output;
+  bool parsed = this->parse(input);
+#ifdef EXPRESSION_COUNTERS
+  if(this->counters_ != 0)
+    this->counters_->addParse(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+#endif
+  if(!parsed)
+    return output;
+
+  for(std::vector<CompactToken>::const_iterator it = this->output_.begin(); it != this->output_.end(); it++) {
+    Token token;
+    token.type_ = (TokenType)it->type_;
+    token.content_ = this->getTokenContent(input, *it);
+    token.precedence_ = it->precedence_;
+    token.associativity_ = it->associativity_;
+    output.push_back(token);
+  }
+  return output;
+}
+
+// Runs the shunting-yard algorithm on an input string in infix notation.
+// The input is read in a single pass without copying it; spaces are skipped and chains of signs (e.g. +-) are
+// collapsed while reading the operators. The tokens in postfix notation are stored in output_, the variable names in
+// variables_. Both keep their memory between calls, so parsing many formulas does not allocate per token.
+// Every character is read a bounded number of times (the look-backs only skip the spaces before the current token), so
+// the time is linear in the length; besides the output, memory is only needed for the operator stack, whose size is
+// the nesting depth checked against the limit.
+// @param input The string to convert.
+// @return False if an error occured, see getError().
+bool ShuntingYard::parse(std::string_view input)
+{
+  std::vector<CompactToken>& output = this->output_;
+  std::vector<CompactToken>& opstack = this->opstack_;
+  output.clear();
+  opstack.clear();
+  this->variables_.clear();
+  this->error_.kind_ = ERROR_NONE;
+  this->error_.position_ = NO_POSITION;
+  char current;
+
+  if(input.size() > this->max_length_) {
+    // Error: rejected before reading it, the position is the first character beyond the limit
+    this->setError(ERROR_TOO_LONG, (unsigned int)this->max_length_);
+    return false;
+  }
+
+  // Start parsing the string in infix notation
+  for(unsigned int i = 0; i < input.size(); i++) {
+    current = input[i];
+    // Spaces
+    if(current == ' ') {
+      continue;
+    }
+    // Number
+    else if(isdigit(current)) {
+      int size = this->handleNumber(input, i, &output);
+      if(size == -1) {
+        this->setError(ERROR_INVALID_NUMBER, i);
+        return false;
+      }
+      i += (size - 1);
+    }
+    // Parentheses
+    else if(current == '(' || current == ')') {
+      // Empty argument lists, e.g. f()
+      bool empty = false;
+      for(unsigned int p = i; current == ')' && p > 0; p--) {
+        if(input[p - 1] != ' ') {
+          empty = input[p - 1] == '(';
+          break;
+        }
+      }
+      int ret = this->handleParentheses(current, i, empty, &output, &opstack);
+      if(ret == -1) {
+        this->setError(ERROR_PARENTHESES, i);
+        return false;
+      }
+      else if(ret == -2) {
+        // The function is still on the operator stack
+        this->setError(ERROR_ARGUMENT_COUNT, opstack.back().position_);
+        return false;
+      }
+    }
+    // Function argument separator (,)
+    else if(current == ',') {
+      int ret = this->handleFunctionArgumentSeparator(&output, &opstack);
+      if(ret == -1) {
+        this->setError(ERROR_SEPARATOR, i);
+        return false;
+      }
+    }
+    // Operator
+    else if(!isalnum(current)) {
+      int size = this->handleOperator(input, i, &output, &opstack);
+      if(size == -1) {
+        this->setError(ERROR_UNKNOWN_OPERATOR, i);
+        return false;
+      }
+      i += (size - 1);
+    }
+    // Function or variable
+    else if(isalpha(current)) {
+      int size = this->handleFunctionOrVariable(input, i, &output, &opstack);
+      if(size == -1) {
+        this->setError(ERROR_UNKNOWN_IDENTIFIER, i);
+        return false;
+      }
+      i += (size - 1);
+    }
+    else {
+      // Error: Unknown input
+      this->setError(ERROR_UNKNOWN_SYMBOL, i);
+      return false;
+    }
+
+    if(opstack.size() > this->max_depth_) {
+      // Error: the token opening one level too many
+      this->setError(ERROR_TOO_DEEP, opstack.back().position_);
+      return false;
+    }
+  }
+
+  // No more tokens
+  while(opstack.size() > 0) {
+    const CompactToken& token_top = opstack.back();
+    if(token_top.type_ == LPARENTHESIS || token_top.type_ == RPARENTHESIS) {
+      // Error: Mismatched parentheses
+      this->setError(ERROR_PARENTHESES, token_top.position_);
+      return false;
+    }
+    output.push_back(token_top);
+    opstack.pop_back();
+  }
+
+  return true;
+}
+
+// Converts a formula into a compiled expression which can be evaluated repeatedly without parsing it again.
+// The postfix tokens are lowered into instructions with pre-parsed constants and variable slots.
+// @param infix_string The formula in infix notation.
+// @return The compiled expression, check isValid() before using it; getError() tells why it is invalid.
+CompiledExpression ShuntingYard::compile(std::string_view infix_string)
+{
+#ifdef EXPRESSION_COUNTERS
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+  CompiledExpression compiled;
+  if(this->parse(infix_string))
+    this->lower(&compiled);
+  compiled.error_ = this->error_;
+  compiled.counters_ = this->counters_;
+#ifdef EXPRESSION_COUNTERS
+  if(this->counters_ != 0)
+    this->counters_->addParse(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+#endif
+  return compiled;
+}
+
+// Lowers the postfix tokens of the last parse into instructions.
+// @param compiled The compiled expression to fill.
+// @return False if the tokens do not form a valid formula, see getError().
+bool ShuntingYard::lower(CompiledExpression* compiled)
+{
+  if(this->output_.empty()) {
+    // Error: no tokens
+    this->setError(ERROR_EMPTY, 0);
+    return false;
+  }
+
+  unsigned int depth = 0;
+  compiled->instructions_.reserve(this->output_.size());
+  for(std::vector<CompactToken>::const_iterator it = this->output_.begin(); it != this->output_.end(); it++) {
+    Instruction instruction;
+    instruction.index_ = 0;
+    instruction.value_ = 0;
+    if(it->type_ == NUMBER) {
+      instruction.opcode_ = OP_CONSTANT;
+      instruction.value_ = it->value_;
+    }
+    else if(it->type_ == VARIABLE) {
+      instruction.opcode_ = OP_VARIABLE;
+      instruction.index_ = it->index_;
+    }
+    else {
+      const OperatorDefinition& definition = this->registry_->getDefinition(it->call_.definition_);
+      instruction.opcode_ = definition.opcode_;
+      if(instruction.opcode_ == OP_CALL || instruction.opcode_ == OP_CALL_IMPURE) {
+        instruction.index_ = (it->type_ == FUNCTION) ? it->call_.count_ : definition.arity_;
+        instruction.kernel_ = definition.kernel_;
+      }
+    }
+
+    unsigned int val_count = CompiledExpression::getArity(instruction);
+    if(depth < val_count) {
+      // Error: not enough values on stack for this operator
+      this->setError(ERROR_MISSING_OPERAND, it->position_);
+      compiled->instructions_.clear();
+      return false;
+    }
+    depth = depth - val_count + 1;
+    if(depth > compiled->max_depth_)
+      compiled->max_depth_ = depth;
+    compiled->instructions_.push_back(instruction);
+  }
+
+  if(depth != 1) {
+    // Error: user input has too many values, the second value left over is the one missing an operator
+    std::vector<unsigned int> positions;
+    for(unsigned int i = 0; i < this->output_.size(); i++) {
+      unsigned int val_count = CompiledExpression::getArity(compiled->instructions_[i]);
+      unsigned int position = (val_count > 0) ? positions[positions.size() - val_count] : this->output_[i].position_;
+      positions.resize(positions.size() - val_count);
+      positions.push_back(position);
+    }
+    this->setError(ERROR_MISSING_OPERATOR, positions[1]);
+    compiled->instructions_.clear();
+    return false;
+  }
+
+  compiled->variables_ = this->variables_;
+  compiled->valid_ = true;
+  return true;
+}
+
+// Converts a formula into a compiled expression whose variable slots follow a given list of variables.
+// Variables which are not part of the list are reported once here instead of on every evaluation, and the values of
+// all expressions compiled against the same list can be passed as the same array.
+// @param infix_string The formula in infix notation.
+// @param variables The names of all variables which may be used, in slot order.
+// @return The compiled expression, check isValid() before using it.
+CompiledExpression ShuntingYard::compile(std::string_view infix_string, const std::vector<std::string>& variables)
+{
+  CompiledExpression compiled = this->compile(infix_string);
+  if(!compiled.valid_)
+    return compiled;
+
+  std::vector<unsigned int> slots(compiled.variables_.size());
+  for(unsigned int i = 0; i < compiled.variables_.size(); i++) {
+    std::vector<std::string>::const_iterator var_it = std::find(variables.begin(), variables.end(), compiled.variables_[i]);
+    if(var_it == variables.end()) {
+      // Error: unknown variable, reported at its first occurrence
+      unsigned int position = NO_POSITION;
+      for(unsigned int t = 0; t < this->output_.size() && position == NO_POSITION; t++) {
+        if(this->output_[t].type_ == VARIABLE && this->output_[t].index_ == i)
+          position = this->output_[t].position_;
+      }
+      this->setError(ERROR_MISSING_VARIABLE, position);
+      compiled.instructions_.clear();
+      compiled.valid_ = false;
+      compiled.error_ = this->error_;
+      return compiled;
+    }
+    slots[i] = var_it - variables.begin();
+  }
+
+  for(std::vector<Instruction>::iterator it = compiled.instructions_.begin(); it != compiled.instructions_.end(); it++) {
+    if(it->opcode_ == OP_VARIABLE)
+      it->index_ = slots[it->index_];
+  }
+  compiled.variables_ = variables;
+  return compiled;
+}
+
+// Prints a deque containing tokens in postfix notation.
+// @param postfix_deque The deque containing tokens in postfix notation.
+void ShuntingYard::printPostfix(std::deque<Token> postfix_deque)
+{
+  if(postfix_deque.empty()) {
+    std::cout << "[ERROR] No tokens could be found." << std::endl;
+    return;
+  }
+
+  std::cout << "------------------------------------" << std::endl;
+  std::cout << "Number of tokens: " << postfix_deque.size() << std::endl;
+  std::cout << "[0] = Number (int or double)" << std::endl;
+  std::cout << "[1] = Operator (+, -, *, /, ^)" << std::endl;
+  std::cout << "[2] = Variable (x, y, z, ...)" << std::endl;
+  std::cout << "[3] = Function (sin, cos, ...)" << std::endl;
+  std::cout << "------------------------------------" << std::endl;
+  std::string postfix_string = "Simple:";
+  for(std::deque<Token>::iterator it = postfix_deque.begin(); it != postfix_deque.end(); it++) {
+    postfix_string += (" " + it->content_ );
+  }
+  postfix_string += "\nDetailed:";
+  for(std::deque<Token>::iterator it = postfix_deque.begin(); it != postfix_deque.end(); it++) {
+    postfix_string += (" " + it->content_ + "[" + std::to_string(it->type_) + "]");
+  }
+  std::cout << postfix_string << std::endl;
+}
+
+// Evaluates a formula using given variable definitions.
+// @param infix_string The formula in infix notation.
+// @param definitions A map containing a value for each variable.
+// @return The result of the formula or 0 if an error occured, see getError().
+double ShuntingYard::evaluate(std::string_view infix_string, const std::map<std::string, double>& definitions)
+{
+  double result = 0;
+  this->evaluate(infix_string, definitions, &result);
+  return result;
+}
+
+// Evaluates a formula using given variable definitions, telling errors apart from results.
+// @param infix_string The formula in infix notation.
+// @param definitions A map containing a value for each variable.
+// @param result Set to the result of the formula, 0 if an error occured.
+// @return The error, ERROR_NONE if the formula has been evaluated.
+ExpressionError ShuntingYard::evaluate(std::string_view infix_string, const std::map<std::string, double>& definitions, double* result)
+{
+  *result = 0;
+  CompiledExpression compiled = this->compile(infix_string);
+  if(!compiled.isValid())
+    return this->error_;
+
+  this->error_ = compiled.evaluate(definitions, result);
+  return this->error_;
+}
+
+// Returns the error of the last call of getPostfix(), compile() or evaluate().
+// @return The error, ERROR_NONE if the call succeeded.
+const ExpressionError& ShuntingYard::getError() const
+{
+  return this->error_;
+}
+
+// Describes a kind of error.
+// @param kind The kind of the error.
+// @return The description.
+const char* ShuntingYard::getErrorMessage(ErrorKind kind)
+{
+  static const char* messages[] = {
+    "No error.",
+    "The formula is empty.",
+    "Infix notation contains invalid numbers. Please use only digits and at most one decimal point (.), within the range of a double.",
+    "There seems to be an error with the parentheses.",
+    "There seems to be an error with the function separator or the parentheses.",
+    "A function has been called with the wrong number of arguments.",
+    "There was an error while trying to parse an operator.",
+    "There was an error reading a function or variable (alphabetic letter is not part of a function or variable).",
+    "There was an error while reading the input (unknown symbols).",
+    "There are not enough values available for this operator.",
+    "The input contains too many values, an operator is missing.",
+    "Missing variable definition.",
+    "The formula is longer than the limit.",
+    "The formula is nested deeper than the limit.",
+    "The formula contains an operation or constant which is not supported (by the numeric type or the evaluator).",
+    "A result does not fit into the numeric type.",
+    "A result is undefined (division by zero or not a real number).",
+    "The definition of an operator or function is invalid.",
+    "An operator or function of this name is already defined.",
+    "A file could not be opened, read or written.",
+    "The input data is invalid (not a number, too few values or an incomplete row).",
+    "The file does not contain compiled expressions or is damaged.",
+    "The file has been written by an incompatible version or machine.",
+    "An expression calls a function which is not registered (the same way)."
+  };
+  return (kind < ERROR_KIND_COUNT) ? messages[kind] : "Unknown error.";
+}
+
+// Handles a number in the original input string.
+// Numbers which can't be represented by a double, i.e. which would be rounded to infinity or 0, are invalid.
+// @param input The input string.
+// @param start_index The starting index of this number.
+// @param output The final output queue.
+// @return The length of the resulting number (including skipped spaces) or <0 if an error occured.
+int ShuntingYard::handleNumber(std::string_view input, unsigned int start_index, std::vector<CompactToken>* output)
+{
+  int decimal_point_count = 0;
+  bool spaces = false;
+  unsigned int end = start_index; // End of the last digit or decimal point
+  unsigned int i = start_index;
+  for(; i < input.size(); i++) {
+    if(isdigit(input[i])) {
+      end = i + 1;
+    }
+    else if(input[i] == '.') {
+      end = i + 1;
+      decimal_point_count++;
+    }
+    else if(input[i] == ' ') {
+      spaces = true;
+    }
+    else {
+      // Break if number is finished
+      break;
+    }
+  }
+
+  if(decimal_point_count > 1 || input[end - 1] == '.') {
+    // Error: invalid number
+    return -1;
+  }
+
+  CompactToken token = {};
+  token.type_ = NUMBER;
+  token.position_ = start_index;
+  std::string_view number = input.substr(start_index, end - start_index);
+  std::from_chars_result result;
+  if(spaces) {
+    // Rare case of spaces within a number, which are ignored
+    std::string digits;
+    for(unsigned int c = 0; c < number.size(); c++) {
+      if(number[c] != ' ')
+        digits.push_back(number[c]);
+    }
+    result = std::from_chars(digits.data(), digits.data() + digits.size(), token.value_);
+  }
+  else {
+    result = std::from_chars(number.data(), number.data() + number.size(), token.value_);
+  }
+  if(result.ec != std::errc()) {
+    // Error: the number is too large (or too small) for a double, std::errc::result_out_of_range
+    return -1;
+  }
+  output->push_back(token);
+  return i - start_index;
+}
+
+// Handles a parenthesis in the original input string.
+// The arguments of functions are counted by the separators after their left parenthesis.
+// @param parentheses The parenthesis.
+// @param position The position of the parenthesis in the input.
+// @param empty Whether a right parenthesis directly follows the left one.
+// @param output The final output queue.
+// @param opstack The operator stack.
+// @return An error code, 0 = no error, -2 = wrong number of function arguments.
+int ShuntingYard::handleParentheses(char parentheses, unsigned int position, bool empty, std::vector<CompactToken>* output, std::vector<CompactToken>* opstack)
+{
+  if(parentheses == '(') {
+    CompactToken token = {};
+    token.type_ = LPARENTHESIS;
+    token.position_ = position;
+    opstack->push_back(token);
+    return 0;
+  }
+
+  // Push all stack tokens to the output until left parenthesis is found
+  while(!opstack->empty() && opstack->back().type_ != LPARENTHESIS) {
+    output->push_back(opstack->back());
+    opstack->pop_back();
+  }
+
+  if(opstack->empty()) {
+    // Error: Mismatched parentheses
+    return -1;
+  }
+
+  // Remove left parenthesis from stack now
+  unsigned int separators = opstack->back().call_.count_;
+  opstack->pop_back();
+
+  // If top token is now function, push it to the output
+  if(!opstack->empty() && opstack->back().type_ == FUNCTION) {
+    CompactToken& function = opstack->back();
+    function.call_.count_ = empty ? 0 : separators + 1;
+    int arity = this->registry_->getDefinition(function.call_.definition_).arity_;
+    if((arity == OperatorRegistry::VARIADIC && function.call_.count_ > CompiledExpression::MAX_CALL_ARGUMENTS) ||
+      (arity != OperatorRegistry::VARIADIC && function.call_.count_ != (unsigned int)arity)) {
+      // Error: wrong number of arguments
+      return -2;
+    }
+    output->push_back(function);
+    opstack->pop_back();
+  }
+
+  return 0;
+}
+
+// Handles a function argument separator in the original input string.
+// @param output The final output queue.
+// @param opstack The operator stack.
+// @return An error code, 0 = no error.
+int ShuntingYard::handleFunctionArgumentSeparator(std::vector<CompactToken>* output, std::vector<CompactToken>* opstack)
+{
+  // Push all stack tokens to the output until left parenthesis is found
+  while(!opstack->empty() && opstack->back().type_ != LPARENTHESIS) {
+    output->push_back(opstack->back());
+    opstack->pop_back();
+  }
+  if(opstack->empty()) {
+    // Error: Mismatched parentheses
+    return -1;
+  }
+  opstack->back().call_.count_++;
+  return 0;
+}
+
+// Handles an operator in the original input string.
+// Chains of signs are collapsed, e.g. +- to - and -- to +.
+// @param input The input string.
+// @param start_index The starting index of this operation.
+// @param output The final output queue.
+// @param opstack The operator stack.
+// @return The length of the resulting operator (including skipped spaces and signs) or <0 if an error occured.
+int ShuntingYard::handleOperator(std::string_view input, unsigned int start_index, std::vector<CompactToken>* output, std::vector<CompactToken>* opstack)
+{
+  std::string op;
+  unsigned int i = start_index;
+  for(; i < input.size(); i++) {
+    char current = input[i];
+    if(current == '(' || isalnum(current)) {
+      break;
+    }
+    else if(current == ' ') {
+      continue;
+    }
+    else if((current == '+' || current == '-') && !op.empty() && (op.back() == '+' || op.back() == '-')) {
+      op.back() = ((current == '-') != (op.back() == '-')) ? '-' : '+';
+    }
+    else {
+      op.push_back(current);
+    }
+  }
+
+  int definition = this->registry_->findOperator(op);
+  if(definition == -1) {
+    // Error: no such operator
+    return -1;
+  }
+
+  // Last character before the operator, 0 at the start of the input
+  char predecessor = 0;
+  for(unsigned int p = start_index; p > 0; p--) {
+    if(input[p - 1] != ' ') {
+      predecessor = input[p - 1];
+      break;
+    }
+  }
+
+  // TODO: Adapt for multi-character operators
+  if((op == "+" || op == "-") &&
+    ((op == "-" && predecessor == 0) || this->registry_->findOperator(std::string_view(&predecessor, 1)) != -1 || predecessor == '(')) {
+    // Unary minus operator
+    definition = this->registry_->findOperator("#");
+  }
+
+  const OperatorDefinition& operator_definition = this->registry_->getDefinition(definition);
+  CompactToken token = {};
+  token.type_ = OPERATOR;
+  token.opcode_ = operator_definition.opcode_;
+  token.precedence_ = operator_definition.precedence_;
+  token.associativity_ = operator_definition.associativity_;
+  token.position_ = start_index;
+  token.call_.definition_ = definition;
+
+  while(!opstack->empty() && opstack->back().type_ == OPERATOR &&
+    ((opstack->back().associativity_ == 1 && opstack->back().precedence_ <= token.precedence_) ||
+    (opstack->back().associativity_ == 2 && opstack->back().precedence_ < token.precedence_))) {
+    // Left-associative and precedence less then or equal to that of op OR right-associative and precedence less than that of op
+    output->push_back(opstack->back());
+    opstack->pop_back();
+  }
+
+  opstack->push_back(token);
+
+  return i - start_index;
+}
+
+// Handles a function or variable in the original input string.
+// Variables get a slot in order of their first appearance in the output.
+// @param input The input string.
+// @param start_index The starting index of this operation.
+// @param output The final output queue.
+// @param opstack The operator stack.
+// @return The length of the resulting function or variable or <0 if an error occured.
+int ShuntingYard::handleFunctionOrVariable(std::string_view input, unsigned int start_index, std::vector<CompactToken>* output, std::vector<CompactToken>* opstack)
+{
+  std::string thing;
+  unsigned int i = start_index;
+  for(; i < input.size(); i++) {
+    if(isalpha(input[i])) {
+      thing.push_back(input[i]);
+    }
+    else if(input[i] != ' ') {
+      // Break on first occurrence of non-alpha character
+      break;
+    }
+  }
+
+  CompactToken token = {};
+  token.position_ = start_index;
+  int definition = this->registry_->findFunction(thing);
+  if(definition != -1 && i < input.size() && input[i] == '(') {
+    token.type_ = FUNCTION;
+    token.opcode_ = this->registry_->getDefinition(definition).opcode_;
+    token.precedence_ = 1;
+    token.call_.definition_ = definition;
+    opstack->push_back(token);
+  }
+  else if(thing.size() == 1) {
+    token.type_ = VARIABLE;
+    std::vector<std::string>::iterator var_it = std::find(this->variables_.begin(), this->variables_.end(), thing);
+    token.index_ = var_it - this->variables_.begin();
+    if(var_it == this->variables_.end())
+      this->variables_.push_back(thing);
+    output->push_back(token);
+  }
+  else {
+    // Error: alphabetic letter is not part of a function or variable
+    return -1;
+  }
+
+  return i - start_index;
+}
+
+// Reconstructs the content of a token for the string-based Token representation.
+// @param input The input string the token has been read from.
+// @param token The token.
+// @return The content as it appeared in the input, without spaces.
+std::string ShuntingYard::getTokenContent(std::string_view input, const CompactToken& token)
+{
+  if(token.type_ == NUMBER) {
+    std::string number;
+    for(unsigned int i = token.position_; i < input.size() && (isdigit(input[i]) || input[i] == '.' || input[i] == ' '); i++) {
+      if(input[i] != ' ')
+        number.push_back(input[i]);
+    }
+    return number;
+  }
+  else if(token.type_ == VARIABLE) {
+    return this->variables_[token.index_];
+  }
+  return this->registry_->getDefinition(token.call_.definition_).name_;
+}
+
+// Records an error of the current call.
+// @param kind The kind of the error.
+// @param position The position of the error in the input.
+void ShuntingYard::setError(ErrorKind kind, unsigned int position)
+{
+  this->error_.kind_ = kind;
+  this->error_.position_ = position;
+#ifdef EXPRESSION_COUNTERS
+  if(this->counters_ != 0)
+    this->counters_->addError(kind);
+#endif
+}
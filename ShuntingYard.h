@@ -1,52 +1,115 @@
-﻿#ifndef SHUNTINGYARD_H
-#define SHUNTINGYARD_H
-
-// Includes
-#include <map>
-#include <queue>
-#include <stack>
-#include <string>
-
-// Additionals
-enum TokenType {NUMBER, OPERATOR, VARIABLE, FUNCTION, LPARENTHESIS, RPARENTHESIS};
-
-typedef struct Token
-{
-  TokenType type_;
-  std::string content_;
-  int precedence_; // >0 if relevant
-  int associativity_; // >0 if relevant, 1 = left, 2 = right
-} Token;
-
-class ShuntingYard
-{
-  public:
-    // Constructor
-    ShuntingYard();
-
-    // Destructor
-    ~ShuntingYard();
-
-    // Methods
-    std::deque<Token> getPostfix(std::string);
-    void printPostfix(std::deque<Token>);
-    double evaluate(std::string, std::map<std::string, double>);
-
-  private:
-    std::map<std::string, unsigned int> operators_;
-    std::map<std::string, unsigned int> functions_;
-
-    std::string replaceAllRepeated(std::string, std::string, std::string);
-    std::string fixOperators(std::string);
-    int handleNumber(std::string, unsigned int, std::deque<Token>*);
-    int handleParentheses(char, std::deque<Token>*, std::stack<Token>*);
-    int handleFunctionArgumentSeparator(std::deque<Token>*, std::stack<Token>*);
-    int handleOperator(std::string, unsigned int, std::deque<Token>*, std::stack<Token>*);
-    int handleFunctionOrVariable(std::string, unsigned int, std::deque<Token>*, std::stack<Token>*);
-    int calculateFunctionOrOperator(Token*, std::stack<double>*);
-    std::vector<double> popValuesFromStack(std::stack<double>*, unsigned int);
-    void reportError(std::string);
-    
-};
-
-#endif /* SHUNTINGYARD_H */
+﻿#ifndef SHUNTINGYARD_H
+#define SHUNTINGYARD_H
+
+// Includes
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Additionals
+enum TokenType {NUMBER, OPERATOR, VARIABLE, FUNCTION, LPARENTHESIS, RPARENTHESIS};
+enum ErrorKind {ERROR_NONE, ERROR_EMPTY, ERROR_INVALID_NUMBER, ERROR_PARENTHESES, ERROR_SEPARATOR, ERROR_ARGUMENT_COUNT, ERROR_UNKNOWN_OPERATOR,
+  ERROR_UNKNOWN_IDENTIFIER, ERROR_UNKNOWN_SYMBOL, ERROR_MISSING_OPERAND, ERROR_MISSING_OPERATOR, ERROR_MISSING_VARIABLE, ERROR_TOO_LONG, ERROR_TOO_DEEP,
+  ERROR_UNSUPPORTED, ERROR_OVERFLOW, ERROR_UNDEFINED, ERROR_INVALID_DEFINITION, ERROR_ALREADY_DEFINED, ERROR_FILE, ERROR_INVALID_INPUT,
+  ERROR_INVALID_FILE, ERROR_INCOMPATIBLE_FILE, ERROR_UNREGISTERED, ERROR_KIND_COUNT};
+
+class CompiledExpression;
+class ExpressionCounters;
+class OperatorRegistry;
+struct Instruction;
+
+typedef struct ExpressionError
+{
+  ErrorKind kind_;
+  unsigned int position_; // Position in the formula, NO_POSITION for errors without a position (e.g. missing values)
+} ExpressionError;
+
+typedef struct Token
+{
+  TokenType type_;
+  std::string content_;
+  int precedence_; // >0 if relevant
+  int associativity_; // >0 if relevant, 1 = left, 2 = right
+} Token;
+
+// Token as produced by the parser, without any heap-allocated content
+typedef struct CompactToken
+{
+  unsigned char type_; // TokenType
+  unsigned char opcode_; // OpCode of OPERATOR and FUNCTION tokens
+  unsigned char precedence_;
+  unsigned char associativity_;
+  unsigned int position_; // Position in the input
+  union
+  {
+    double value_; // Value of a NUMBER
+    unsigned int index_; // Slot of a VARIABLE
+    struct
+    {
+      unsigned int definition_; // Registry entry of an OPERATOR or FUNCTION
+      unsigned int count_; // Number of arguments of a FUNCTION, number of argument separators after a LPARENTHESIS
+    } call_;
+  };
+} CompactToken;
+
+// Parser for formulas in infix notation.
+// An instance is not meant to be shared between threads; use one instance per thread and share the compiled expressions.
+// The operators and functions are taken from an OperatorRegistry, which has to outlive the parser.
+// Nothing is printed on errors; getError() returns the kind and position of the error of the last call.
+// Parsing takes time linear in the length of the formula and memory linear in its nesting depth besides the output;
+// setLimits() rejects formulas which are too long or too deeply nested before they are parsed further.
+class ShuntingYard
+{
+  public:
+    // Constructor
+    ShuntingYard(const OperatorRegistry* registry = 0);
+
+    // Destructor
+    ~ShuntingYard();
+
+    // Methods
+    void setRegistry(const OperatorRegistry*);
+    void setCounters(ExpressionCounters*);
+    void setLimits(std::size_t, std::size_t);
+    std::deque<Token> getPostfix(std::string_view);
+    CompiledExpression compile(std::string_view);
+    CompiledExpression compile(std::string_view, const std::vector<std::string>&);
+    void printPostfix(std::deque<Token>);
+    double evaluate(std::string_view, const std::map<std::string, double>&);
+    ExpressionError evaluate(std::string_view, const std::map<std::string, double>&, double*);
+    const ExpressionError& getError() const;
+    static const char* getErrorMessage(ErrorKind);
+
+    // Position of errors which cannot be located in the formula
+    static const unsigned int NO_POSITION = (unsigned int)-1;
+    // Longest formula which can be parsed at all, positions and token lengths have to fit into an int
+    static const std::size_t MAX_LENGTH = 0x7fffffff;
+
+  private:
+    const OperatorRegistry* registry_;
+    ExpressionCounters* counters_;
+    ExpressionError error_;
+    std::size_t max_length_;
+    std::size_t max_depth_; // Entries of the operator stack
+
+    // Scratch memory of the last parse, kept to avoid allocations when parsing many formulas
+    std::vector<CompactToken> output_;
+    std::vector<CompactToken> opstack_;
+    std::vector<std::string> variables_;
+
+    bool parse(std::string_view);
+    bool lower(CompiledExpression*);
+    int handleNumber(std::string_view, unsigned int, std::vector<CompactToken>*);
+    int handleParentheses(char, unsigned int, bool, std::vector<CompactToken>*, std::vector<CompactToken>*);
+    int handleFunctionArgumentSeparator(std::vector<CompactToken>*, std::vector<CompactToken>*);
+    int handleOperator(std::string_view, unsigned int, std::vector<CompactToken>*, std::vector<CompactToken>*);
+    int handleFunctionOrVariable(std::string_view, unsigned int, std::vector<CompactToken>*, std::vector<CompactToken>*);
+    std::string getTokenContent(std::string_view, const CompactToken&);
+    void setError(ErrorKind, unsigned int);
+    
+};
+
+#endif /* SHUNTINGYARD_H */
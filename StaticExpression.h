@@ -0,0 +1,387 @@
+﻿#ifndef STATICEXPRESSION_H
+#define STATICEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cmath>
+#include <cstddef>
+
+// Formulas known at build time, parsed and lowered by the compiler.
+// The formula has to be a constant character array with static storage duration:
+//
+//   static constexpr char price[] = "sin(x)*y+2";
+//   double result = evaluateStatic<price>(values);
+//
+// The grammar and the postfix order are the same as for ShuntingYard::getPostfix(), and variables get the same slots
+// as in ShuntingYard::compile(), so both can be evaluated with the same values. Invalid formulas fail to compile, as do
+// numbers whose digits, read without the decimal point, exceed 2^53 = 9007199254740992 or which have more than 22
+// decimals, since their value could differ from the runtime parser.
+
+// Result of the compile-time shunting-yard algorithm
+template <std::size_t N>
+struct StaticProgram
+{
+  Instruction instructions_[N] = {};
+  std::size_t size_ = 0;
+  char variables_[N] = {};
+  std::size_t variable_count_ = 0;
+  bool valid_ = false;
+};
+
+// Operator or function waiting on the operator stack
+struct StaticOperator
+{
+  char symbol_ = 0; // '(' for parentheses
+  OpCode opcode_ = OP_CONSTANT;
+  int precedence_ = 0;
+  int associativity_ = 0;
+  bool function_ = false;
+  std::size_t separators_ = 0; // Argument separators after a '('
+};
+
+constexpr std::size_t staticLength(const char* formula)
+{
+  std::size_t length = 0;
+  while(formula[length] != '\0')
+    length++;
+  return length;
+}
+
+constexpr bool staticIsDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+constexpr bool staticIsAlpha(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool staticIsAlnum(char c)
+{
+  return staticIsDigit(c) || staticIsAlpha(c);
+}
+
+// Appends an operator or function taken from the operator stack to the output.
+template <std::size_t N>
+constexpr void staticEmit(StaticProgram<N>& program, const StaticOperator& op)
+{
+  Instruction instruction = {op.opcode_, 0, 0};
+  program.instructions_[program.size_++] = instruction;
+}
+
+// Appends a variable to the output, slots are assigned in order of first appearance.
+template <std::size_t N>
+constexpr void staticEmitVariable(StaticProgram<N>& program, char name)
+{
+  std::size_t slot = 0;
+  while(slot < program.variable_count_ && program.variables_[slot] != name)
+    slot++;
+  if(slot == program.variable_count_)
+    program.variables_[program.variable_count_++] = name;
+  Instruction instruction = {OP_VARIABLE, (unsigned int)slot, 0};
+  program.instructions_[program.size_++] = instruction;
+}
+
+// Compile-time version of ShuntingYard::getPostfix() followed by the lowering of ShuntingYard::compile().
+// @param formula The formula in infix notation.
+// @return The instructions, valid_ is false if the formula is invalid.
+template <std::size_t N>
+constexpr StaticProgram<N> staticCompile(const char* formula)
+{
+  StaticProgram<N> program;
+
+  // Remove spaces and collapse chains of signs, like fixOperators()
+  char input[N] = {};
+  std::size_t length = 0;
+  for(std::size_t i = 0; formula[i] != '\0'; i++) {
+    char current = formula[i];
+    if(current == ' ')
+      continue;
+    if((current == '+' || current == '-') && length > 0 && (input[length - 1] == '+' || input[length - 1] == '-')) {
+      input[length - 1] = ((current == '-') != (input[length - 1] == '-')) ? '-' : '+';
+      continue;
+    }
+    input[length++] = current;
+  }
+
+  StaticOperator opstack[N] = {};
+  std::size_t opcount = 0;
+  for(std::size_t i = 0; i < length; i++) {
+    char current = input[i];
+    // Number
+    if(staticIsDigit(current)) {
+      // The digits without the decimal point and their value divided by 10^decimals are exact doubles, so the quotient
+      // is correctly rounded and identical to std::from_chars in the runtime parser. Numbers whose digits exceed 2^53 or
+      // with more than 22 decimals would need a correctly rounded conversion and are rejected.
+      unsigned long long mantissa = 0;
+      double scale = 1;
+      int decimal_point_count = 0;
+      int decimals = 0;
+      bool exact = true;
+      for(; i < length && (staticIsDigit(input[i]) || input[i] == '.'); i++) {
+        if(input[i] == '.') {
+          decimal_point_count++;
+          continue;
+        }
+        if(exact)
+          mantissa = mantissa * 10 + (input[i] - '0');
+        if(mantissa > (1ULL << 53))
+          exact = false;
+        if(decimal_point_count > 0) {
+          decimals++;
+          scale *= 10;
+        }
+      }
+      if(decimal_point_count > 1 || input[i - 1] == '.' || !exact || decimals > 22)
+        return program;
+      double value = (double)mantissa / scale;
+      Instruction instruction = {OP_CONSTANT, 0, value};
+      program.instructions_[program.size_++] = instruction;
+      i--;
+    }
+    // Parentheses
+    else if(current == '(') {
+      StaticOperator parenthesis;
+      parenthesis.symbol_ = '(';
+      opstack[opcount++] = parenthesis;
+    }
+    else if(current == ')') {
+      while(opcount > 0 && opstack[opcount - 1].symbol_ != '(')
+        staticEmit(program, opstack[--opcount]);
+      if(opcount == 0)
+        return program;
+      std::size_t separators = opstack[--opcount].separators_;
+      std::size_t arguments = (input[i - 1] == '(') ? 0 : separators + 1;
+      if(opcount > 0 && opstack[opcount - 1].function_) {
+        if((int)arguments != CompiledExpression::getArity(opstack[opcount - 1].opcode_))
+          return program;
+        staticEmit(program, opstack[--opcount]);
+      }
+    }
+    // Function argument separator
+    else if(current == ',') {
+      while(opcount > 0 && opstack[opcount - 1].symbol_ != '(')
+        staticEmit(program, opstack[--opcount]);
+      if(opcount == 0)
+        return program;
+      opstack[opcount - 1].separators_++;
+    }
+    // Operator
+    else if(!staticIsAlnum(current)) {
+      std::size_t start = i;
+      while(i < length && input[i] != '(' && !staticIsAlnum(input[i]))
+        i++;
+      if(i - start != 1)
+        return program;
+      i--;
+
+      StaticOperator op;
+      op.symbol_ = current;
+      op.associativity_ = 1;
+      if(current == '+' || current == '-') {
+        op.opcode_ = (current == '+') ? OP_ADD : OP_SUBTRACT;
+        op.precedence_ = 4;
+        if((current == '-' && start == 0) || (start > 0 && input[start - 1] == '(')) {
+          // Unary minus operator
+          op.symbol_ = '#';
+          op.opcode_ = OP_NEGATE;
+          op.precedence_ = 1;
+        }
+      }
+      else if(current == '*' || current == '/') {
+        op.opcode_ = (current == '*') ? OP_MULTIPLY : OP_DIVIDE;
+        op.precedence_ = 3;
+      }
+      else if(current == '^') {
+        op.opcode_ = OP_POWER;
+        op.precedence_ = 2;
+        op.associativity_ = 2;
+      }
+      else if(current == '#') {
+        op.opcode_ = OP_NEGATE;
+        op.precedence_ = 1;
+      }
+      else {
+        return program;
+      }
+
+      while(opcount > 0 && opstack[opcount - 1].symbol_ != '(' && !opstack[opcount - 1].function_ &&
+        ((opstack[opcount - 1].associativity_ == 1 && opstack[opcount - 1].precedence_ <= op.precedence_) ||
+        (opstack[opcount - 1].associativity_ == 2 && opstack[opcount - 1].precedence_ < op.precedence_)))
+        staticEmit(program, opstack[--opcount]);
+      opstack[opcount++] = op;
+    }
+    // Function or variable
+    else {
+      std::size_t start = i;
+      while(i < length && staticIsAlpha(input[i]))
+        i++;
+      std::size_t size = i - start;
+      bool call = i < length && input[i] == '(';
+      i--;
+      if(size == 1) {
+        staticEmitVariable(program, input[start]);
+        continue;
+      }
+      StaticOperator function;
+      function.function_ = true;
+      function.precedence_ = 1;
+      if(call && size == 3 && input[start] == 's' && input[start + 1] == 'i' && input[start + 2] == 'n')
+        function.opcode_ = OP_SIN;
+      else if(call && size == 3 && input[start] == 'c' && input[start + 1] == 'o' && input[start + 2] == 's')
+        function.opcode_ = OP_COS;
+      else if(call && size == 3 && input[start] == 'm' && input[start + 1] == 'a' && input[start + 2] == 'x')
+        function.opcode_ = OP_MAX;
+      else if(call && size == 3 && input[start] == 'm' && input[start + 1] == 'i' && input[start + 2] == 'n')
+        function.opcode_ = OP_MIN;
+      else
+        return program;
+      opstack[opcount++] = function;
+    }
+  }
+
+  while(opcount > 0) {
+    if(opstack[opcount - 1].symbol_ == '(')
+      return program;
+    staticEmit(program, opstack[--opcount]);
+  }
+
+  // Verify the stack effect like ShuntingYard::compile()
+  std::size_t depth = 0;
+  for(std::size_t i = 0; i < program.size_; i++) {
+    std::size_t arity = (std::size_t)CompiledExpression::getArity(program.instructions_[i].opcode_);
+    if(depth < arity)
+      return program;
+    depth = depth - arity + 1;
+  }
+  program.valid_ = (depth == 1);
+  return program;
+}
+
+template <const char* Formula>
+class StaticExpression
+{
+  public:
+    static constexpr std::size_t CAPACITY = staticLength(Formula) + 1;
+    static constexpr StaticProgram<CAPACITY> PROGRAM = staticCompile<CAPACITY>(Formula);
+    static_assert(PROGRAM.valid_, "The formula is not a valid expression.");
+
+    // Evaluates the formula using variable values given in slot order.
+    // @param values An array containing a value for each variable, see getVariable().
+    // @return The result of the formula.
+    static double evaluate(const double* values)
+    {
+      return evaluateNode<PROGRAM.size_ - 1>(values);
+    }
+
+    // Returns the number of variables.
+    // @return The number of variable slots.
+    static constexpr std::size_t getVariableCount()
+    {
+      return PROGRAM.variable_count_;
+    }
+
+    // Returns the name of a variable.
+    // @param slot The slot of the variable.
+    // @return The name of the variable.
+    static constexpr char getVariable(std::size_t slot)
+    {
+      return PROGRAM.variables_[slot];
+    }
+
+  private:
+    // Returns the number of instructions of the subtree whose root is at a given postfix position.
+    static constexpr std::size_t subtreeSize(std::size_t root)
+    {
+      std::size_t needed = 1;
+      std::size_t size = 0;
+      while(needed > 0) {
+        needed = needed - 1 + (std::size_t)CompiledExpression::getArity(PROGRAM.instructions_[root - size].opcode_);
+        size++;
+      }
+      return size;
+    }
+
+    // Checks whether the subtree whose root is at a given postfix position depends on a variable.
+    static constexpr bool dependsOnValues(std::size_t root)
+    {
+      for(std::size_t i = root + 1 - subtreeSize(root); i <= root; i++) {
+        if(PROGRAM.instructions_[i].opcode_ == OP_VARIABLE)
+          return true;
+      }
+      return false;
+    }
+
+    // Evaluates an operand of pow, sin or cos. Operands known at build time are hidden from the optimizer, which would
+    // otherwise calculate e.g. pow(a, 2) as a * a or fold sin(0.5), rounded differently from the math library used by
+    // the runtime evaluators.
+    template <std::size_t I>
+    static double evaluateOperand(const double* values)
+    {
+      if constexpr(dependsOnValues(I)) {
+        return evaluateNode<I>(values);
+      }
+      else {
+        volatile double value = evaluateNode<I>(values);
+        return value;
+      }
+    }
+
+    // Evaluates the subtree whose root is at postfix position I, every node is a separate instantiation.
+    template <std::size_t I>
+    static double evaluateNode(const double* values)
+    {
+      constexpr Instruction instruction = PROGRAM.instructions_[I];
+      if constexpr(instruction.opcode_ == OP_CONSTANT) {
+        return instruction.value_;
+      }
+      else if constexpr(instruction.opcode_ == OP_VARIABLE) {
+        return values[instruction.index_];
+      }
+      else if constexpr(instruction.opcode_ == OP_NEGATE) {
+        return evaluateNode<I - 1>(values) * -1.0;
+      }
+      else if constexpr(instruction.opcode_ == OP_SIN || instruction.opcode_ == OP_COS) {
+        double a = evaluateOperand<I - 1>(values);
+        if constexpr(instruction.opcode_ == OP_SIN)
+          return sin(a);
+        else
+          return cos(a);
+      }
+      else {
+        constexpr std::size_t right = I - 1;
+        constexpr std::size_t left = right - subtreeSize(right);
+        if constexpr(instruction.opcode_ == OP_POWER) {
+          double a = evaluateOperand<left>(values);
+          double b = evaluateOperand<right>(values);
+          return pow(a, b);
+        }
+        double a = evaluateNode<left>(values);
+        double b = evaluateNode<right>(values);
+        if constexpr(instruction.opcode_ == OP_ADD)
+          return a + b;
+        else if constexpr(instruction.opcode_ == OP_SUBTRACT)
+          return a - b;
+        else if constexpr(instruction.opcode_ == OP_MULTIPLY)
+          return a * b;
+        else if constexpr(instruction.opcode_ == OP_DIVIDE)
+          return a / b;
+        else if constexpr(instruction.opcode_ == OP_MAX)
+          return (a > b) ? a : b;
+        else
+          return (a < b) ? a : b;
+      }
+    }
+};
+
+// Evaluates a formula known at build time using variable values given in slot order.
+// @param values An array containing a value for each variable of the formula.
+// @return The result of the formula.
+template <const char* Formula>
+double evaluateStatic(const double* values)
+{
+  return StaticExpression<Formula>::evaluate(values);
+}
+
+#endif /* STATICEXPRESSION_H */
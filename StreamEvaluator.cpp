@@ -0,0 +1,411 @@
+﻿// Includes
+#include "StreamEvaluator.h"
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STREAM_MMAP_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file
+typedef struct MappedFile
+{
+  const char* data_;
+  std::size_t size_;
+} MappedFile;
+
+// Maps a file into memory.
+// @param path The path of the file.
+// @param file Receives the mapping, data_ is 0 for an empty file.
+// @return An error code, 0 = no error.
+static int mapFile(const char* path, MappedFile* file)
+{
+  file->data_ = 0;
+  file->size_ = 0;
+#ifdef STREAM_MMAP_SUPPORTED
+  int fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return -1;
+  struct stat info;
+  if(fstat(fd, &info) == -1) {
+    close(fd);
+    return -1;
+  }
+  file->size_ = info.st_size;
+  if(file->size_ > 0) {
+    void* data = mmap(0, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    madvise(data, file->size_, MADV_SEQUENTIAL);
+    file->data_ = (const char*)data;
+  }
+  close(fd);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+// Releases the pages of a mapped file which have been processed completely.
+// @param file The mapping.
+// @param begin The start of the processed range.
+// @param end The end of the processed range.
+static void releaseFile(const MappedFile& file, std::size_t begin, std::size_t end)
+{
+#ifdef STREAM_MMAP_SUPPORTED
+  std::size_t page = sysconf(_SC_PAGESIZE);
+  begin = (begin + page - 1) / page * page;
+  end = end / page * page;
+  if(begin < end)
+    madvise((void*)(file.data_ + begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+// Unmaps a file.
+// @param file The mapping.
+static void unmapFile(const MappedFile& file)
+{
+#ifdef STREAM_MMAP_SUPPORTED
+  if(file.data_ != 0)
+    munmap((void*)file.data_, file.size_);
+#endif
+}
+
+// Constructor
+// @param compiled The expression to evaluate.
+StreamEvaluator::StreamEvaluator(const CompiledExpression& compiled) : compiled_(compiled)
+{
+  this->columns_.resize(compiled.getVariables().size() * CompiledExpression::BATCH_CHUNK_SIZE);
+  this->results_.resize(CompiledExpression::BATCH_CHUNK_SIZE);
+  this->row_count_ = 0;
+  this->byte_count_ = 0;
+  this->seconds_ = 0;
+  this->setError(ERROR_NONE, 0);
+}
+
+// Destructor
+StreamEvaluator::~StreamEvaluator()
+{
+
+}
+
+// Evaluates the expression for every row of a CSV file.
+// The first line names the columns; every variable of the expression needs a column, other columns are ignored.
+// The output file gets a "result" header and one result per row.
+// @param input_path The path of the CSV file.
+// @param output_path The path of the output file.
+// @return An error code, 0 = no error.
+int StreamEvaluator::evaluateCsv(const char* input_path, const char* output_path)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  this->row_count_ = 0;
+  this->byte_count_ = 0;
+  this->seconds_ = 0;
+  this->setError(ERROR_NONE, 0);
+  if(!this->compiled_.isValid()) {
+    this->error_ = this->compiled_.getError();
+    return -1;
+  }
+
+  MappedFile file;
+  if(mapFile(input_path, &file) == -1) {
+    this->setError(ERROR_FILE, 0);
+    return -1;
+  }
+  const char* data = file.data_;
+  const char* end = data + file.size_;
+
+  // Assign the columns of the header to variable slots
+  const std::vector<std::string>& variables = this->compiled_.getVariables();
+  std::vector<int> field_slots;
+  std::vector<bool> found(variables.size(), false);
+  const char* pos = data;
+  while(pos < end && *pos != '\n') {
+    const char* field_end = pos;
+    while(field_end < end && *field_end != ',' && *field_end != '\n')
+      field_end++;
+    std::string name;
+    for(const char* c = pos; c < field_end; c++) {
+      if(*c != ' ' && *c != '\r')
+        name.push_back(*c);
+    }
+    int slot = -1;
+    for(unsigned int i = 0; i < variables.size(); i++) {
+      if(variables[i] == name && !found[i]) {
+        slot = i;
+        found[i] = true;
+      }
+    }
+    field_slots.push_back(slot);
+    pos = (field_end < end && *field_end == ',') ? field_end + 1 : field_end;
+  }
+  for(unsigned int i = 0; i < variables.size(); i++) {
+    if(!found[i]) {
+      // Error: missing variable definitions
+      this->setError(ERROR_MISSING_VARIABLE, 0);
+      unmapFile(file);
+      return -1;
+    }
+  }
+  if(pos < end)
+    pos++;
+
+  FILE* output = fopen(output_path, "wb");
+  if(output == 0) {
+    this->setError(ERROR_FILE, 0);
+    unmapFile(file);
+    return -1;
+  }
+  fputs("result\n", output);
+
+  unsigned long long line = 1;
+  std::size_t row = 0;
+  const char* chunk_begin = pos;
+  while(pos < end) {
+    line++;
+    if(*pos == '\n' || (*pos == '\r' && pos + 1 < end && pos[1] == '\n')) {
+      // Empty line
+      pos += (*pos == '\r') ? 2 : 1;
+      continue;
+    }
+
+    unsigned int field = 0;
+    unsigned int parsed = 0;
+    while(true) {
+      int slot = (field < field_slots.size()) ? field_slots[field] : -1;
+      while(pos < end && *pos == ' ')
+        pos++;
+      if(slot != -1) {
+        double* value = &this->columns_[slot * CompiledExpression::BATCH_CHUNK_SIZE + row];
+        std::from_chars_result result = std::from_chars(pos, end, *value);
+        const char* rest = result.ptr;
+        while(rest < end && (*rest == ' ' || *rest == '\r'))
+          rest++;
+        if(result.ec != std::errc() || (rest < end && *rest != ',' && *rest != '\n')) {
+          // Error: not a number
+          this->setError(ERROR_INVALID_INPUT, line);
+          fclose(output);
+          unmapFile(file);
+          return -1;
+        }
+        pos = result.ptr;
+        parsed++;
+      }
+      while(pos < end && *pos != ',' && *pos != '\n')
+        pos++;
+      if(pos >= end || *pos == '\n')
+        break;
+      pos++;
+      field++;
+    }
+    if(pos < end)
+      pos++;
+
+    if(parsed != variables.size()) {
+      // Error: missing values
+      this->setError(ERROR_INVALID_INPUT, line);
+      fclose(output);
+      unmapFile(file);
+      return -1;
+    }
+
+    row++;
+    if(row == CompiledExpression::BATCH_CHUNK_SIZE) {
+      if(this->evaluateChunk(row, output, true) == -1) {
+        fclose(output);
+        unmapFile(file);
+        return -1;
+      }
+      releaseFile(file, chunk_begin - data, pos - data);
+      chunk_begin = pos;
+      row = 0;
+    }
+  }
+
+  int ret = (row > 0) ? this->evaluateChunk(row, output, true) : 0;
+  if(fclose(output) != 0 && ret == 0) {
+    this->setError(ERROR_FILE, 0);
+    ret = -1;
+  }
+  unmapFile(file);
+  this->byte_count_ = file.size_;
+  this->seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return ret;
+}
+
+// Evaluates the expression for every row of a raw file of little-endian doubles.
+// Every row holds one value per variable in slot order. The output file gets one little-endian double per row.
+// @param input_path The path of the input file.
+// @param output_path The path of the output file.
+// @return An error code, 0 = no error.
+int StreamEvaluator::evaluateBinary(const char* input_path, const char* output_path)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  this->row_count_ = 0;
+  this->byte_count_ = 0;
+  this->seconds_ = 0;
+  this->setError(ERROR_NONE, 0);
+  if(!this->compiled_.isValid()) {
+    this->error_ = this->compiled_.getError();
+    return -1;
+  }
+  std::size_t variable_count = this->compiled_.getVariables().size();
+  if(variable_count == 0) {
+    // Error: the number of rows is unknown
+    this->setError(ERROR_UNSUPPORTED, 0);
+    return -1;
+  }
+
+  MappedFile file;
+  if(mapFile(input_path, &file) == -1) {
+    this->setError(ERROR_FILE, 0);
+    return -1;
+  }
+  std::size_t row_size = variable_count * sizeof(double);
+  if(file.size_ % row_size != 0) {
+    // Error: incomplete row
+    this->setError(ERROR_INVALID_INPUT, 0);
+    unmapFile(file);
+    return -1;
+  }
+
+  FILE* output = fopen(output_path, "wb");
+  if(output == 0) {
+    this->setError(ERROR_FILE, 0);
+    unmapFile(file);
+    return -1;
+  }
+
+  int ret = 0;
+  std::size_t rows = file.size_ / row_size;
+  for(std::size_t begin = 0; begin < rows && ret == 0; begin += CompiledExpression::BATCH_CHUNK_SIZE) {
+    std::size_t count = (rows - begin < CompiledExpression::BATCH_CHUNK_SIZE) ? rows - begin : CompiledExpression::BATCH_CHUNK_SIZE;
+    const char* chunk = file.data_ + begin * row_size;
+    // Transpose the rows into one column per variable
+    for(std::size_t row = 0; row < count; row++) {
+      for(std::size_t slot = 0; slot < variable_count; slot++) {
+        unsigned char bytes[sizeof(double)];
+        std::memcpy(bytes, chunk + (row * variable_count + slot) * sizeof(double), sizeof(double));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for(unsigned int b = 0; b < sizeof(double) / 2; b++)
+          std::swap(bytes[b], bytes[sizeof(double) - 1 - b]);
+#endif
+        std::memcpy(&this->columns_[slot * CompiledExpression::BATCH_CHUNK_SIZE + row], bytes, sizeof(double));
+      }
+    }
+    ret = this->evaluateChunk(count, output, false);
+    releaseFile(file, begin * row_size, (begin + count) * row_size);
+  }
+
+  if(fclose(output) != 0 && ret == 0) {
+    this->setError(ERROR_FILE, 0);
+    ret = -1;
+  }
+  unmapFile(file);
+  this->byte_count_ = file.size_;
+  this->seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return ret;
+}
+
+// Returns the number of rows evaluated by the last call.
+// @return The number of rows.
+unsigned long long StreamEvaluator::getRowCount() const
+{
+  return this->row_count_;
+}
+
+// Returns the size of the input file of the last call.
+// @return The size in bytes.
+unsigned long long StreamEvaluator::getByteCount() const
+{
+  return this->byte_count_;
+}
+
+// Returns the duration of the last call, including mapping the input and writing the output.
+// @return The duration in seconds.
+double StreamEvaluator::getSeconds() const
+{
+  return this->seconds_;
+}
+
+// Returns the error of the last call of evaluateCsv() or evaluateBinary().
+// @return The error, ERROR_NONE if the call succeeded. Errors of the formula keep their position.
+const ExpressionError& StreamEvaluator::getError() const
+{
+  return this->error_;
+}
+
+// Returns the line of the CSV file causing the error of the last call, for invalid numbers and missing values.
+// @return The line, starting at 1 for the header, or 0 if the error does not belong to a line.
+unsigned long long StreamEvaluator::getErrorLine() const
+{
+  return this->error_line_;
+}
+
+// Evaluates the rows collected in columns_ and writes the results.
+// @param rows The number of rows.
+// @param output The output file.
+// @param text Whether to write the results as text lines or as raw little-endian doubles.
+// @return An error code, 0 = no error.
+int StreamEvaluator::evaluateChunk(std::size_t rows, FILE* output, bool text)
+{
+  std::size_t variable_count = this->compiled_.getVariables().size();
+  const double* columns[CompiledExpression::STACK_SIZE];
+  std::vector<const double*> dynamic_columns;
+  const double** column_pointers = columns;
+  if(variable_count > CompiledExpression::STACK_SIZE) {
+    dynamic_columns.resize(variable_count);
+    column_pointers = &dynamic_columns[0];
+  }
+  for(std::size_t slot = 0; slot < variable_count; slot++)
+    column_pointers[slot] = &this->columns_[slot * CompiledExpression::BATCH_CHUNK_SIZE];
+  this->compiled_.evaluateBatch(column_pointers, &this->results_[0], rows);
+  this->row_count_ += rows;
+
+  std::size_t written;
+  if(text) {
+    std::string buffer;
+    buffer.reserve(rows * 25);
+    char number[32];
+    for(std::size_t row = 0; row < rows; row++) {
+      std::to_chars_result result = std::to_chars(number, number + sizeof(number), this->results_[row]);
+      buffer.append(number, result.ptr);
+      buffer.push_back('\n');
+    }
+    written = fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size() ? rows : 0;
+  }
+  else {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for(std::size_t row = 0; row < rows; row++) {
+      unsigned char* bytes = (unsigned char*)&this->results_[row];
+      for(unsigned int b = 0; b < sizeof(double) / 2; b++)
+        std::swap(bytes[b], bytes[sizeof(double) - 1 - b]);
+    }
+#endif
+    written = fwrite(&this->results_[0], sizeof(double), rows, output);
+  }
+
+  if(written != rows) {
+    this->setError(ERROR_FILE, 0);
+    return -1;
+  }
+  return 0;
+}
+
+// Records an error of the current call.
+// @param kind The kind of the error.
+// @param line The line of the CSV file causing it, 0 if none.
+void StreamEvaluator::setError(ErrorKind kind, unsigned long long line)
+{
+  this->error_.kind_ = kind;
+  this->error_.position_ = ShuntingYard::NO_POSITION;
+  this->error_line_ = line;
+}
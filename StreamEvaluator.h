@@ -0,0 +1,51 @@
+﻿#ifndef STREAMEVALUATOR_H
+#define STREAMEVALUATOR_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Evaluates a compiled expression for every row of a large input file and streams the results to an output file.
+// The input is memory-mapped and processed in chunks of BATCH_CHUNK_SIZE rows, so the memory used does not depend on
+// the size of the file. Supported inputs are CSV files whose header names the variables, and raw files of little-endian
+// doubles
+// with one value per variable and row in slot order (see getVariables()).
+// Nothing is printed on errors; getError() returns the kind of the error of the last call and getErrorLine() the line
+// of the CSV file it occured in.
+class StreamEvaluator
+{
+  public:
+    // Constructor
+    StreamEvaluator(const CompiledExpression&);
+
+    // Destructor
+    ~StreamEvaluator();
+
+    // Methods
+    int evaluateCsv(const char*, const char*);
+    int evaluateBinary(const char*, const char*);
+    unsigned long long getRowCount() const;
+    unsigned long long getByteCount() const;
+    double getSeconds() const;
+    const ExpressionError& getError() const;
+    unsigned long long getErrorLine() const;
+
+  private:
+    CompiledExpression compiled_;
+    std::vector<double> columns_; // One chunk of values per variable
+    std::vector<double> results_;
+    unsigned long long row_count_;
+    unsigned long long byte_count_;
+    double seconds_;
+    ExpressionError error_; // Error of the last call, the position refers to the formula
+    unsigned long long error_line_; // Line of the CSV file causing error_, 0 if none
+
+    int evaluateChunk(std::size_t, FILE*, bool);
+    void setError(ErrorKind, unsigned long long);
+
+};
+
+#endif /* STREAMEVALUATOR_H */
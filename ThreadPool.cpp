@@ -0,0 +1,133 @@
+﻿// Includes
+#include "ThreadPool.h"
+
+// Constructor
+// @param thread_count The number of worker threads, 0 = one per hardware thread.
+ThreadPool::ThreadPool(unsigned int thread_count)
+{
+  if(thread_count == 0)
+    thread_count = std::thread::hardware_concurrency();
+  if(thread_count == 0)
+    thread_count = 1;
+
+  this->task_ = 0;
+  this->remaining_ = 0;
+  this->active_ = 0;
+  this->generation_ = 0;
+  this->stopping_ = false;
+  for(unsigned int i = 0; i < thread_count; i++)
+    this->queues_.push_back(new TaskQueue());
+  for(unsigned int i = 0; i < thread_count; i++)
+    this->threads_.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+// Destructor
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stopping_ = true;
+  }
+  this->work_condition_.notify_all();
+  for(unsigned int i = 0; i < this->threads_.size(); i++)
+    this->threads_[i].join();
+  for(unsigned int i = 0; i < this->queues_.size(); i++)
+    delete this->queues_[i];
+}
+
+// Returns the number of worker threads.
+// @return The number of worker threads.
+unsigned int ThreadPool::getThreadCount() const
+{
+  return this->threads_.size();
+}
+
+// Executes task(0) ... task(task_count - 1) on the worker threads and waits until all of them are finished.
+// Tasks are handed out in contiguous ranges, so neighbouring tasks usually run on the same thread.
+// @param task_count The number of tasks.
+// @param task The function to call with the number of each task, it has to be safe to call concurrently.
+void ThreadPool::run(std::size_t task_count, const std::function<void(std::size_t)>& task)
+{
+  if(task_count == 0)
+    return;
+
+  std::lock_guard<std::mutex> run_lock(this->run_mutex_);
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  // Workers which woke up late for the previous run must not see the new tasks with the old function
+  while(this->active_ != 0)
+    this->done_condition_.wait(lock);
+
+  std::size_t thread_count = this->queues_.size();
+  for(std::size_t i = 0; i < thread_count; i++) {
+    std::lock_guard<std::mutex> queue_lock(this->queues_[i]->mutex_);
+    for(std::size_t t = task_count * i / thread_count; t < task_count * (i + 1) / thread_count; t++)
+      this->queues_[i]->tasks_.push_back(t);
+  }
+  this->task_ = &task;
+  this->remaining_ = task_count;
+  this->generation_++;
+  this->work_condition_.notify_all();
+  while(this->remaining_ != 0 || this->active_ != 0)
+    this->done_condition_.wait(lock);
+  this->task_ = 0;
+}
+
+// Main loop of a worker thread.
+// @param index The index of the worker and its task queue.
+void ThreadPool::work(unsigned int index)
+{
+  unsigned long generation = 0;
+  while(true) {
+    const std::function<void(std::size_t)>* task;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      while(!this->stopping_ && this->generation_ == generation)
+        this->work_condition_.wait(lock);
+      if(this->stopping_)
+        return;
+      generation = this->generation_;
+      task = this->task_;
+      this->active_++;
+    }
+
+    std::size_t task_index;
+    while(task != 0 && this->takeTask(index, &task_index)) {
+      (*task)(task_index);
+      this->remaining_--;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->active_--;
+    if(this->active_ == 0)
+      this->done_condition_.notify_all();
+  }
+}
+
+// Takes the next task from the own queue or steals one from another worker.
+// @param index The index of the worker.
+// @param task_index Receives the number of the task.
+// @return True if a task was found.
+bool ThreadPool::takeTask(unsigned int index, std::size_t* task_index)
+{
+  {
+    TaskQueue* own = this->queues_[index];
+    std::lock_guard<std::mutex> lock(own->mutex_);
+    if(!own->tasks_.empty()) {
+      *task_index = own->tasks_.front();
+      own->tasks_.pop_front();
+      return true;
+    }
+  }
+
+  for(unsigned int i = 1; i < this->queues_.size(); i++) {
+    TaskQueue* victim = this->queues_[(index + i) % this->queues_.size()];
+    std::lock_guard<std::mutex> lock(victim->mutex_);
+    if(!victim->tasks_.empty()) {
+      *task_index = victim->tasks_.back();
+      victim->tasks_.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,53 @@
+﻿#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads executing numbered tasks.
+// Every worker owns a deque of tasks; idle workers steal tasks from the other end of the deques of busy workers.
+class ThreadPool
+{
+  public:
+    // Constructor
+    ThreadPool(unsigned int thread_count = 0);
+
+    // Destructor
+    ~ThreadPool();
+
+    // Methods
+    unsigned int getThreadCount() const;
+    void run(std::size_t, const std::function<void(std::size_t)>&);
+
+  private:
+    typedef struct TaskQueue
+    {
+      std::mutex mutex_;
+      std::deque<std::size_t> tasks_;
+    } TaskQueue;
+
+    std::vector<std::thread> threads_;
+    std::vector<TaskQueue*> queues_;
+    std::mutex mutex_;
+    std::mutex run_mutex_;
+    std::condition_variable work_condition_;
+    std::condition_variable done_condition_;
+    const std::function<void(std::size_t)>* task_;
+    std::atomic<std::size_t> remaining_;
+    unsigned int active_; // Workers currently holding task_
+    unsigned long generation_;
+    bool stopping_;
+
+    void work(unsigned int);
+    bool takeTask(unsigned int, std::size_t*);
+
+};
+
+#endif /* THREADPOOL_H */
@@ -0,0 +1,806 @@
+﻿// Includes
+#include "TypedExpression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// Additionals
+// Flags of the checked operations, collected while evaluating
+static const int ARITHMETIC_OVERFLOW = 1;
+static const int ARITHMETIC_UNDEFINED = 2;
+
+// Intermediate results of fixed-point multiplications and divisions, a GCC and Clang extension on 64-bit targets
+__extension__ typedef __int128 int128_t;
+
+// Operations of a numeric type, with the same semantics as the interpreter for double.
+// Operations which fail set a flag in errors and return 0.
+template<typename T>
+class Arithmetic;
+
+// IEEE types, without checks
+template<typename T>
+class FloatingArithmetic
+{
+  public:
+    static bool supports(OpCode)
+    {
+      return true;
+    }
+
+    static ErrorKind fromConstant(double value, T* result)
+    {
+      *result = (T)value;
+      return ERROR_NONE;
+    }
+
+    static ErrorKind convert(double value, T* result)
+    {
+      *result = (T)value;
+      return ERROR_NONE;
+    }
+
+    static double toDouble(T value)
+    {
+      return value;
+    }
+
+    static T add(T a, T b, int*) { return a + b; }
+    static T subtract(T a, T b, int*) { return a - b; }
+    static T multiply(T a, T b, int*) { return a * b; }
+    static T divide(T a, T b, int*) { return a / b; }
+    static T power(T a, T b, int*) { return std::pow(a, b); }
+    static T negate(T a, int*) { return a * (T)-1; }
+    static T sine(T a, int*) { return std::sin(a); }
+    static T cosine(T a, int*) { return std::cos(a); }
+    static T maximum(T a, T b, int*) { return (a > b) ? a : b; }
+    static T minimum(T a, T b, int*) { return (a < b) ? a : b; }
+
+    static T call(FunctionKernel kernel, const T* arguments, unsigned int count, int*)
+    {
+      double values[CompiledExpression::MAX_CALL_ARGUMENTS];
+      for(unsigned int i = 0; i < count; i++)
+        values[i] = arguments[i];
+      return (T)kernel(values, count);
+    }
+};
+
+template<>
+class Arithmetic<float> : public FloatingArithmetic<float>
+{
+
+};
+
+template<>
+class Arithmetic<double> : public FloatingArithmetic<double>
+{
+
+};
+
+// Checked integers, only operations with integer results are supported
+template<>
+class Arithmetic<std::int64_t>
+{
+  public:
+    static bool supports(OpCode opcode)
+    {
+      return opcode != OP_SIN && opcode != OP_COS && opcode != OP_CALL && opcode != OP_CALL_IMPURE;
+    }
+
+    static ErrorKind fromConstant(double value, std::int64_t* result)
+    {
+      // The parser has read the constant into a double, larger integers may already have been rounded
+      if(value != std::trunc(value) || std::fabs(value) >= 9007199254740992.0)
+        return ERROR_UNSUPPORTED;
+      *result = (std::int64_t)value;
+      return ERROR_NONE;
+    }
+
+    static ErrorKind convert(double value, std::int64_t* result)
+    {
+      *result = 0;
+      if(std::isnan(value))
+        return ERROR_UNDEFINED;
+      double rounded = std::nearbyint(value);
+      if(!(std::fabs(rounded) < 9223372036854775808.0))
+        return ERROR_OVERFLOW;
+      *result = (std::int64_t)rounded;
+      return ERROR_NONE;
+    }
+
+    static double toDouble(std::int64_t value)
+    {
+      return (double)value;
+    }
+
+    static std::int64_t add(std::int64_t a, std::int64_t b, int* errors)
+    {
+      std::int64_t result;
+      if(__builtin_add_overflow(a, b, &result)) {
+        *errors |= ARITHMETIC_OVERFLOW;
+        return 0;
+      }
+      return result;
+    }
+
+    static std::int64_t subtract(std::int64_t a, std::int64_t b, int* errors)
+    {
+      std::int64_t result;
+      if(__builtin_sub_overflow(a, b, &result)) {
+        *errors |= ARITHMETIC_OVERFLOW;
+        return 0;
+      }
+      return result;
+    }
+
+    static std::int64_t multiply(std::int64_t a, std::int64_t b, int* errors)
+    {
+      std::int64_t result;
+      if(__builtin_mul_overflow(a, b, &result)) {
+        *errors |= ARITHMETIC_OVERFLOW;
+        return 0;
+      }
+      return result;
+    }
+
+    static std::int64_t divide(std::int64_t a, std::int64_t b, int* errors)
+    {
+      if(b == 0) {
+        *errors |= ARITHMETIC_UNDEFINED;
+        return 0;
+      }
+      if(a == std::numeric_limits<std::int64_t>::min() && b == -1) {
+        *errors |= ARITHMETIC_OVERFLOW;
+        return 0;
+      }
+      return a / b;
+    }
+
+    static std::int64_t power(std::int64_t a, std::int64_t b, int* errors)
+    {
+      if(b < 0) {
+        // Reciprocals truncated towards 0, like divisions
+        if(a == 0) {
+          *errors |= ARITHMETIC_UNDEFINED;
+          return 0;
+        }
+        if(a == 1 || a == -1)
+          return (a == -1 && (b & 1) != 0) ? -1 : 1;
+        return 0;
+      }
+
+      // Square and multiply; a square which overflows is always needed for the result, so it overflows as well
+      std::int64_t result = 1;
+      while(b != 0) {
+        if((b & 1) != 0)
+          result = multiply(result, a, errors);
+        b >>= 1;
+        if(b != 0)
+          a = multiply(a, a, errors);
+      }
+      return result;
+    }
+
+    static std::int64_t negate(std::int64_t a, int* errors)
+    {
+      if(a == std::numeric_limits<std::int64_t>::min()) {
+        *errors |= ARITHMETIC_OVERFLOW;
+        return 0;
+      }
+      return -a;
+    }
+
+    static std::int64_t sine(std::int64_t, int* errors)
+    {
+      *errors |= ARITHMETIC_UNDEFINED;
+      return 0;
+    }
+
+    static std::int64_t cosine(std::int64_t, int* errors)
+    {
+      *errors |= ARITHMETIC_UNDEFINED;
+      return 0;
+    }
+
+    static std::int64_t maximum(std::int64_t a, std::int64_t b, int*) { return (a > b) ? a : b; }
+    static std::int64_t minimum(std::int64_t a, std::int64_t b, int*) { return (a < b) ? a : b; }
+
+    static std::int64_t call(FunctionKernel, const std::int64_t*, unsigned int, int* errors)
+    {
+      *errors |= ARITHMETIC_UNDEFINED;
+      return 0;
+    }
+};
+
+// Checked fixed-point numbers, the operations without an exact equivalent are calculated in double
+template<>
+class Arithmetic<FixedPoint>
+{
+  public:
+    static bool supports(OpCode)
+    {
+      return true;
+    }
+
+    static ErrorKind fromConstant(double value, FixedPoint* result)
+    {
+      return convert(value, result);
+    }
+
+    static ErrorKind convert(double value, FixedPoint* result)
+    {
+      result->raw_ = 0;
+      if(std::isnan(value))
+        return ERROR_UNDEFINED;
+      double rounded = std::nearbyint(value * ONE);
+      if(!(std::fabs(rounded) < 9223372036854775808.0))
+        return ERROR_OVERFLOW;
+      result->raw_ = (std::int64_t)rounded;
+      return ERROR_NONE;
+    }
+
+    static double toDouble(FixedPoint value)
+    {
+      return value.raw_ / ONE;
+    }
+
+    static FixedPoint add(FixedPoint a, FixedPoint b, int* errors)
+    {
+      return {Arithmetic<std::int64_t>::add(a.raw_, b.raw_, errors)};
+    }
+
+    static FixedPoint subtract(FixedPoint a, FixedPoint b, int* errors)
+    {
+      return {Arithmetic<std::int64_t>::subtract(a.raw_, b.raw_, errors)};
+    }
+
+    static FixedPoint multiply(FixedPoint a, FixedPoint b, int* errors)
+    {
+      // Rounded to the nearest value, halves upwards
+      int128_t product = (int128_t)a.raw_ * b.raw_ + ((int128_t)1 << (FRACTION_BITS - 1));
+      return narrow(product >> FRACTION_BITS, errors);
+    }
+
+    static FixedPoint divide(FixedPoint a, FixedPoint b, int* errors)
+    {
+      if(b.raw_ == 0) {
+        *errors |= ARITHMETIC_UNDEFINED;
+        return {0};
+      }
+      // Rounded to the nearest value, halves away from 0
+      int128_t dividend = (int128_t)a.raw_ * ((int128_t)1 << FRACTION_BITS);
+      int128_t quotient = dividend / b.raw_;
+      int128_t remainder = dividend % b.raw_;
+      int128_t divisor = b.raw_;
+      if(2 * ((remainder < 0) ? -remainder : remainder) >= ((divisor < 0) ? -divisor : divisor))
+        quotient += ((dividend < 0) == (divisor < 0)) ? 1 : -1;
+      return narrow(quotient, errors);
+    }
+
+    static FixedPoint power(FixedPoint a, FixedPoint b, int* errors)
+    {
+      if(a.raw_ == 0 && b.raw_ < 0) {
+        *errors |= ARITHMETIC_UNDEFINED;
+        return {0};
+      }
+      if(b.raw_ < 0 || (b.raw_ & (((std::int64_t)1 << FRACTION_BITS) - 1)) != 0)
+        return fromResult(std::pow(toDouble(a), toDouble(b)), errors);
+
+      // Non-negative integer exponents by square and multiply, as for integers
+      std::int64_t exponent = b.raw_ >> FRACTION_BITS;
+      FixedPoint result = {(std::int64_t)1 << FRACTION_BITS};
+      while(exponent != 0) {
+        if((exponent & 1) != 0)
+          result = multiply(result, a, errors);
+        exponent >>= 1;
+        if(exponent != 0)
+          a = multiply(a, a, errors);
+      }
+      return result;
+    }
+
+    static FixedPoint negate(FixedPoint a, int* errors)
+    {
+      return {Arithmetic<std::int64_t>::negate(a.raw_, errors)};
+    }
+
+    static FixedPoint sine(FixedPoint a, int* errors)
+    {
+      return fromResult(std::sin(toDouble(a)), errors);
+    }
+
+    static FixedPoint cosine(FixedPoint a, int* errors)
+    {
+      return fromResult(std::cos(toDouble(a)), errors);
+    }
+
+    static FixedPoint maximum(FixedPoint a, FixedPoint b, int*) { return (a.raw_ > b.raw_) ? a : b; }
+    static FixedPoint minimum(FixedPoint a, FixedPoint b, int*) { return (a.raw_ < b.raw_) ? a : b; }
+
+    static FixedPoint call(FunctionKernel kernel, const FixedPoint* arguments, unsigned int count, int* errors)
+    {
+      double values[CompiledExpression::MAX_CALL_ARGUMENTS];
+      for(unsigned int i = 0; i < count; i++)
+        values[i] = toDouble(arguments[i]);
+      return fromResult(kernel(values, count), errors);
+    }
+
+  private:
+    static const int FRACTION_BITS = 32;
+    static constexpr double ONE = 4294967296.0;
+
+    static FixedPoint narrow(int128_t raw, int* errors)
+    {
+      if(raw < std::numeric_limits<std::int64_t>::min() || raw > std::numeric_limits<std::int64_t>::max()) {
+        *errors |= ARITHMETIC_OVERFLOW;
+        return {0};
+      }
+      return {(std::int64_t)raw};
+    }
+
+    static FixedPoint fromResult(double value, int* errors)
+    {
+      FixedPoint result;
+      ErrorKind kind = convert(value, &result);
+      if(kind == ERROR_OVERFLOW)
+        *errors |= ARITHMETIC_OVERFLOW;
+      else if(kind == ERROR_UNDEFINED)
+        *errors |= ARITHMETIC_UNDEFINED;
+      return result;
+    }
+};
+
+// Batch kernels
+// Compiled for several instruction sets like the ones of CompiledExpression, the best one is selected once at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_KERNEL_DISPATCH
+#define BATCH_KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define BATCH_KERNEL_INLINE inline
+#endif
+#ifdef __GNUC__
+// Rows are independent, even if the result block is one of the operands
+#define BATCH_LOOP _Pragma("GCC ivdep")
+#else
+#define BATCH_LOOP
+#endif
+
+template<typename T>
+using BlockKernel = int (*)(const TypedInstruction<T>*, const TypedInstruction<T>*, const T* const*, std::size_t, unsigned int, const T**, T*, T*, T*);
+
+// Runs the instructions on one block of rows, see the block interpreter of CompiledExpression.
+// Every operation is calculated for all BATCH_BLOCK_SIZE rows of the block, so the loops have a constant length and
+// are vectorized even by the cheap cost model of -O2; the last block is padded by the caller.
+// @param code The first instruction.
+// @param end The end of the instructions.
+// @param columns The variable columns in slot order.
+// @param offset The first row of the block.
+// @param count The number of rows to write to the output.
+// @param operands Storage for max_depth_ pointers to the blocks on the stack.
+// @param stack Storage for max_depth_ blocks of BATCH_BLOCK_SIZE values.
+// @param temps Storage for temp_count_ blocks of BATCH_BLOCK_SIZE values.
+// @param output The first row of the block in the output column.
+// @return The flags of the operations which failed, 0 if none.
+template<typename T>
+static BATCH_KERNEL_INLINE int executeBlock(const TypedInstruction<T>* code, const TypedInstruction<T>* end, const T* const* columns,
+  std::size_t offset, unsigned int count, const T** operands, T* stack, T* temps, T* output)
+{
+  const T** top = operands - 1;
+  unsigned int depth = 0;
+  int errors = 0;
+
+  for(; code != end; code++) {
+    T* result = 0;
+    const T* a = 0;
+    const T* b = 0;
+    switch(code->opcode_) {
+      case OP_CONSTANT:
+        result = stack + depth * CompiledExpression::BATCH_BLOCK_SIZE;
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = code->value_;
+        *(++top) = result;
+        depth++;
+        continue;
+      case OP_VARIABLE:
+        *(++top) = columns[code->index_] + offset;
+        depth++;
+        continue;
+      case OP_LOAD:
+        *(++top) = temps + code->index_ * CompiledExpression::BATCH_BLOCK_SIZE;
+        depth++;
+        continue;
+      case OP_STORE:
+        std::memcpy(temps + code->index_ * CompiledExpression::BATCH_BLOCK_SIZE, *top, CompiledExpression::BATCH_BLOCK_SIZE * sizeof(T));
+        continue;
+      case OP_CALL:
+      case OP_CALL_IMPURE: {
+        unsigned int argument_count = code->index_;
+        const T** arguments = top + 1 - argument_count;
+        depth = depth + 1 - argument_count;
+        result = stack + (depth - 1) * CompiledExpression::BATCH_BLOCK_SIZE;
+        T values[CompiledExpression::MAX_CALL_ARGUMENTS];
+        for(unsigned int i = 0; i < count; i++) {
+          for(unsigned int a = 0; a < argument_count; a++)
+            values[a] = arguments[a][i];
+          result[i] = Arithmetic<T>::call(code->kernel_, values, argument_count, &errors);
+        }
+        // Registered functions are only called for the actual rows, the padding repeats the last one
+        std::fill(result + count, result + CompiledExpression::BATCH_BLOCK_SIZE, result[count - 1]);
+        top = arguments;
+        *top = result;
+        continue;
+      }
+      default:
+        break;
+    }
+
+    if(code->opcode_ == OP_NEGATE || code->opcode_ == OP_SIN || code->opcode_ == OP_COS) {
+      a = *top;
+    }
+    else {
+      b = *(top--);
+      a = *top;
+      depth--;
+    }
+    result = stack + (depth - 1) * CompiledExpression::BATCH_BLOCK_SIZE;
+
+    switch(code->opcode_) {
+      case OP_ADD:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::add(a[i], b[i], &errors);
+        break;
+      case OP_SUBTRACT:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::subtract(a[i], b[i], &errors);
+        break;
+      case OP_MULTIPLY:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::multiply(a[i], b[i], &errors);
+        break;
+      case OP_DIVIDE:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::divide(a[i], b[i], &errors);
+        break;
+      case OP_POWER:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::power(a[i], b[i], &errors);
+        break;
+      case OP_NEGATE:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::negate(a[i], &errors);
+        break;
+      case OP_SIN:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::sine(a[i], &errors);
+        break;
+      case OP_COS:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::cosine(a[i], &errors);
+        break;
+      case OP_MAX:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::maximum(a[i], b[i], &errors);
+        break;
+      case OP_MIN:
+        BATCH_LOOP
+        for(unsigned int i = 0; i < CompiledExpression::BATCH_BLOCK_SIZE; i++)
+          result[i] = Arithmetic<T>::minimum(a[i], b[i], &errors);
+        break;
+      default:
+        break;
+    }
+    *top = result;
+  }
+
+  std::memcpy(output, operands[0], count * sizeof(T));
+  return errors;
+}
+
+template<typename T>
+static int executeBlockScalar(const TypedInstruction<T>* code, const TypedInstruction<T>* end, const T* const* columns,
+  std::size_t offset, unsigned int count, const T** operands, T* stack, T* temps, T* output)
+{
+  return executeBlock(code, end, columns, offset, count, operands, stack, temps, output);
+}
+
+#ifdef BATCH_KERNEL_DISPATCH
+template<typename T>
+__attribute__((target("avx2")))
+static int executeBlockAVX2(const TypedInstruction<T>* code, const TypedInstruction<T>* end, const T* const* columns,
+  std::size_t offset, unsigned int count, const T** operands, T* stack, T* temps, T* output)
+{
+  return executeBlock(code, end, columns, offset, count, operands, stack, temps, output);
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+static int executeBlockAVX512(const TypedInstruction<T>* code, const TypedInstruction<T>* end, const T* const* columns,
+  std::size_t offset, unsigned int count, const T** operands, T* stack, T* temps, T* output)
+{
+  return executeBlock(code, end, columns, offset, count, operands, stack, temps, output);
+}
+#endif
+
+// Selects the batch kernel for the instruction set of the current CPU.
+// @return The selected kernel.
+template<typename T>
+static BlockKernel<T> selectBlockKernel()
+{
+#ifdef BATCH_KERNEL_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return executeBlockAVX512<T>;
+  if(__builtin_cpu_supports("avx2"))
+    return executeBlockAVX2<T>;
+#endif
+  return executeBlockScalar<T>;
+}
+
+// Constructor
+// Converts the constants into the numeric type.
+// @param expression The compiled expression, it is invalid here if it uses operations or constants the type does not support.
+template<typename T>
+TypedExpression<T>::TypedExpression(const CompiledExpression& expression)
+{
+  this->max_depth_ = expression.max_depth_;
+  this->temp_count_ = expression.temp_count_;
+  this->valid_ = expression.isValid();
+  this->error_ = expression.getError();
+  if(!this->valid_)
+    return;
+
+  this->variables_ = expression.getVariables();
+  this->instructions_.resize(expression.instructions_.size());
+  for(std::size_t i = 0; i < expression.instructions_.size(); i++) {
+    const Instruction& instruction = expression.instructions_[i];
+    TypedInstruction<T>& typed = this->instructions_[i];
+    typed.opcode_ = instruction.opcode_;
+    typed.index_ = instruction.index_;
+    ErrorKind kind = ERROR_NONE;
+    if(!Arithmetic<T>::supports(instruction.opcode_))
+      kind = ERROR_UNSUPPORTED;
+    else if(instruction.opcode_ == OP_CONSTANT)
+      kind = Arithmetic<T>::fromConstant(instruction.value_, &typed.value_);
+    else if(instruction.opcode_ == OP_CALL || instruction.opcode_ == OP_CALL_IMPURE)
+      typed.kernel_ = instruction.kernel_;
+
+    if(kind != ERROR_NONE) {
+      // Error: the instructions do not keep the positions in the formula
+      this->instructions_.clear();
+      this->valid_ = false;
+      this->error_.kind_ = kind;
+      this->error_.position_ = ShuntingYard::NO_POSITION;
+      return;
+    }
+  }
+}
+
+// Destructor
+template<typename T>
+TypedExpression<T>::~TypedExpression()
+{
+
+}
+
+// Checks whether the expression can be evaluated in the numeric type.
+// @return True if the compiled expression has been valid and only uses supported operations and constants.
+template<typename T>
+bool TypedExpression<T>::isValid() const
+{
+  return this->valid_;
+}
+
+// Returns why the expression cannot be evaluated.
+// @return The error of the compiled expression or ERROR_UNSUPPORTED, ERROR_OVERFLOW for constants out of range.
+template<typename T>
+const ExpressionError& TypedExpression<T>::getError() const
+{
+  return this->error_;
+}
+
+// Returns the variables in slot order.
+// @return The variable names.
+template<typename T>
+const std::vector<std::string>& TypedExpression<T>::getVariables() const
+{
+  return this->variables_;
+}
+
+// Evaluates the expression using variable values given in slot order.
+// @param values An array containing a value for each entry of getVariables().
+// @return The result of the formula or 0 if the expression is invalid or an operation failed.
+template<typename T>
+T TypedExpression<T>::evaluate(const T* values) const
+{
+  T result;
+  this->evaluate(values, &result);
+  return result;
+}
+
+// Evaluates the expression using variable values given in slot order, telling failed operations apart from results.
+// @param values An array containing a value for each entry of getVariables().
+// @param result Set to the result of the formula, 0 if an error occured.
+// @return The error, ERROR_OVERFLOW or ERROR_UNDEFINED if an operation failed, ERROR_NONE if the formula has been evaluated.
+template<typename T>
+ExpressionError TypedExpression<T>::evaluate(const T* values, T* result) const
+{
+  *result = T();
+  if(!this->valid_)
+    return this->error_;
+
+  int errors;
+  if(this->max_depth_ + this->temp_count_ <= CompiledExpression::STACK_SIZE) {
+    T stack[CompiledExpression::STACK_SIZE];
+    errors = this->execute(values, stack, stack + this->max_depth_, result);
+  }
+  else {
+    std::vector<T> stack(this->max_depth_ + this->temp_count_);
+    errors = this->execute(values, &stack[0], &stack[0] + this->max_depth_, result);
+  }
+  if(errors != 0)
+    *result = T();
+  return getArithmeticError(errors);
+}
+
+// Evaluates the expression for many rows of variable values at once, see CompiledExpression::evaluateBatch().
+// Evaluation stops at the first block of rows in which an operation fails.
+// @param columns An array containing one column of row values for each entry of getVariables().
+// @param output The column receiving one result per row, all 0 if an error occured.
+// @param rows The number of rows.
+// @return The error, ERROR_OVERFLOW or ERROR_UNDEFINED if an operation failed, ERROR_NONE if all rows have been evaluated.
+template<typename T>
+ExpressionError TypedExpression<T>::evaluateBatch(const T* const* columns, T* output, std::size_t rows) const
+{
+  if(!this->valid_) {
+    std::fill(output, output + rows, T());
+    return this->error_;
+  }
+
+  static const BlockKernel<T> block_kernel = selectBlockKernel<T>();
+  std::vector<const T*> operands(this->max_depth_);
+  std::vector<T> stack((this->max_depth_ + this->temp_count_) * CompiledExpression::BATCH_BLOCK_SIZE);
+  T* temps = &stack[0] + this->max_depth_ * CompiledExpression::BATCH_BLOCK_SIZE;
+  const TypedInstruction<T>* code = this->instructions_.data();
+  const TypedInstruction<T>* code_end = code + this->instructions_.size();
+  int errors = 0;
+  std::size_t offset = 0;
+  for(; offset + CompiledExpression::BATCH_BLOCK_SIZE <= rows && errors == 0; offset += CompiledExpression::BATCH_BLOCK_SIZE)
+    errors = block_kernel(code, code_end, columns, offset, CompiledExpression::BATCH_BLOCK_SIZE, &operands[0], &stack[0], temps, output + offset);
+  if(offset < rows && errors == 0) {
+    // The last rows are copied into a full block, padded with the last row so the padding fails exactly if it does
+    unsigned int count = (unsigned int)(rows - offset);
+    std::vector<T> padded(this->variables_.size() * CompiledExpression::BATCH_BLOCK_SIZE);
+    std::vector<const T*> padded_columns(this->variables_.size());
+    for(std::size_t v = 0; v < this->variables_.size(); v++) {
+      T* column = &padded[v * CompiledExpression::BATCH_BLOCK_SIZE];
+      std::copy(columns[v] + offset, columns[v] + rows, column);
+      std::fill(column + count, column + CompiledExpression::BATCH_BLOCK_SIZE, columns[v][rows - 1]);
+      padded_columns[v] = column;
+    }
+    errors = block_kernel(code, code_end, padded_columns.data(), 0, count, &operands[0], &stack[0], temps, output + offset);
+  }
+  if(errors != 0)
+    std::fill(output, output + rows, T());
+  return getArithmeticError(errors);
+}
+
+// Converts a double into the numeric type, e.g. the values of variables.
+// @param value The value.
+// @param result Set to the nearest value of the type, 0 if an error occured.
+// @return ERROR_OVERFLOW if the value is out of range, ERROR_UNDEFINED for NaN, otherwise ERROR_NONE.
+template<typename T>
+ErrorKind TypedExpression<T>::convert(double value, T* result)
+{
+  return Arithmetic<T>::convert(value, result);
+}
+
+// Converts a value of the numeric type into a double.
+// @param value The value.
+// @return The nearest double.
+template<typename T>
+double TypedExpression<T>::toDouble(T value)
+{
+  return Arithmetic<T>::toDouble(value);
+}
+
+// Runs the instructions on a value stack, see CompiledExpression::execute().
+// @param values The variable values in slot order.
+// @param stack A stack with room for at least max_depth_ values.
+// @param temps Room for temp_count_ stored values.
+// @param result Set to the value remaining on the stack.
+// @return The flags of the operations which failed, 0 if none.
+template<typename T>
+int TypedExpression<T>::execute(const T* values, T* stack, T* temps, T* result) const
+{
+  int errors = 0;
+  T* top = stack - 1;
+  for(typename std::vector<TypedInstruction<T> >::const_iterator code = this->instructions_.begin(); code != this->instructions_.end(); code++) {
+    switch(code->opcode_) {
+      case OP_CONSTANT:
+        *(++top) = code->value_;
+        break;
+      case OP_VARIABLE:
+        *(++top) = values[code->index_];
+        break;
+      case OP_ADD:
+        top--;
+        *top = Arithmetic<T>::add(*top, *(top + 1), &errors);
+        break;
+      case OP_SUBTRACT:
+        top--;
+        *top = Arithmetic<T>::subtract(*top, *(top + 1), &errors);
+        break;
+      case OP_MULTIPLY:
+        top--;
+        *top = Arithmetic<T>::multiply(*top, *(top + 1), &errors);
+        break;
+      case OP_DIVIDE:
+        top--;
+        *top = Arithmetic<T>::divide(*top, *(top + 1), &errors);
+        break;
+      case OP_POWER:
+        top--;
+        *top = Arithmetic<T>::power(*top, *(top + 1), &errors);
+        break;
+      case OP_NEGATE:
+        *top = Arithmetic<T>::negate(*top, &errors);
+        break;
+      case OP_SIN:
+        *top = Arithmetic<T>::sine(*top, &errors);
+        break;
+      case OP_COS:
+        *top = Arithmetic<T>::cosine(*top, &errors);
+        break;
+      case OP_MAX:
+        top--;
+        *top = Arithmetic<T>::maximum(*top, *(top + 1), &errors);
+        break;
+      case OP_MIN:
+        top--;
+        *top = Arithmetic<T>::minimum(*top, *(top + 1), &errors);
+        break;
+      case OP_LOAD:
+        *(++top) = temps[code->index_];
+        break;
+      case OP_STORE:
+        temps[code->index_] = *top;
+        break;
+      case OP_CALL:
+      case OP_CALL_IMPURE:
+        top = top + 1 - code->index_;
+        *top = Arithmetic<T>::call(code->kernel_, top, code->index_, &errors);
+        break;
+    }
+  }
+  *result = *top;
+  return errors;
+}
+
+// Converts the flags of failed operations into an error.
+// Failed operations return 0, which may make later operations undefined, so overflows are reported first.
+// @param errors The flags.
+// @return ERROR_OVERFLOW if any result was out of range, otherwise ERROR_UNDEFINED if any result was undefined.
+template<typename T>
+ExpressionError TypedExpression<T>::getArithmeticError(int errors)
+{
+  ExpressionError error = {ERROR_NONE, ShuntingYard::NO_POSITION};
+  if((errors & ARITHMETIC_OVERFLOW) != 0)
+    error.kind_ = ERROR_OVERFLOW;
+  else if((errors & ARITHMETIC_UNDEFINED) != 0)
+    error.kind_ = ERROR_UNDEFINED;
+  return error;
+}
+
+template class TypedExpression<float>;
+template class TypedExpression<double>;
+template class TypedExpression<std::int64_t>;
+template class TypedExpression<FixedPoint>;
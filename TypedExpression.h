@@ -0,0 +1,79 @@
+﻿#ifndef TYPEDEXPRESSION_H
+#define TYPEDEXPRESSION_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Additionals
+// Signed fixed-point number with 32 integer and 32 fraction bits, i.e. the value raw_ / 2^32
+typedef struct FixedPoint
+{
+  std::int64_t raw_;
+} FixedPoint;
+
+// Instruction of a TypedExpression, with the value of OP_CONSTANT converted into its numeric type
+template<typename T>
+struct TypedInstruction
+{
+  OpCode opcode_;
+  unsigned int index_; // As in Instruction
+  union
+  {
+    T value_;
+    FunctionKernel kernel_;
+  };
+};
+
+// Evaluator which calculates a compiled formula in another numeric type than double.
+// Instantiated for float, double, std::int64_t and FixedPoint. The constants are converted into the type once by the
+// constructor, so the evaluation only works on values of the type; evaluateBatch() processes blocks of rows like
+// CompiledExpression, so float fills twice as many vector lanes as double.
+// float and double follow IEEE semantics without any checks. std::int64_t and FixedPoint check every operation and
+// report ERROR_OVERFLOW if a result does not fit into the type and ERROR_UNDEFINED for divisions by zero and results
+// which are not real numbers. Integer division truncates towards 0, as in C++; integer formulas must not use sin, cos
+// or registered functions, and their constants have to be integers exactly represented by a double. FixedPoint rounds
+// products and quotients to the nearest value and calculates sin, cos, non-integer powers and registered functions in
+// double.
+// All evaluate methods are const, so one instance can be used by any number of threads at the same time.
+template<typename T>
+class TypedExpression
+{
+  public:
+    // Constructor
+    TypedExpression(const CompiledExpression&);
+
+    // Destructor
+    ~TypedExpression();
+
+    // Methods
+    bool isValid() const;
+    const ExpressionError& getError() const;
+    const std::vector<std::string>& getVariables() const;
+    T evaluate(const T*) const;
+    ExpressionError evaluate(const T*, T*) const;
+    ExpressionError evaluateBatch(const T* const*, T*, std::size_t) const;
+    static ErrorKind convert(double, T*);
+    static double toDouble(T);
+
+  private:
+    std::vector<TypedInstruction<T> > instructions_;
+    std::vector<std::string> variables_;
+    unsigned int max_depth_;
+    unsigned int temp_count_;
+    bool valid_;
+    ExpressionError error_; // Why the expression is invalid
+
+    int execute(const T*, T*, T*, T*) const;
+    static ExpressionError getArithmeticError(int);
+
+};
+
+typedef TypedExpression<float> FloatExpression;
+typedef TypedExpression<std::int64_t> Int64Expression;
+typedef TypedExpression<FixedPoint> FixedPointExpression;
+
+#endif /* TYPEDEXPRESSION_H */
@@ -0,0 +1,93 @@
+﻿// Includes
+#include "VariableBinding.h"
+
+// Constructor
+// @param expression The compiled expression whose variables are bound.
+VariableBinding::VariableBinding(const CompiledExpression& expression)
+{
+  this->expression_ = &expression;
+  this->values_.resize(expression.getVariables().size(), 0);
+  this->defined_.resize(expression.getVariables().size(), false);
+}
+
+// Destructor
+VariableBinding::~VariableBinding()
+{
+
+}
+
+// Returns the slot of a variable.
+// @param name The name of the variable.
+// @return The slot or -1 if the expression does not use this variable.
+int VariableBinding::getSlot(std::string_view name) const
+{
+  const std::vector<std::string>& variables = this->expression_->getVariables();
+  for(unsigned int i = 0; i < variables.size(); i++) {
+    if(variables[i] == name)
+      return i;
+  }
+  return -1;
+}
+
+// Sets the value of a variable by slot.
+// @param slot The slot as returned by getSlot().
+// @param value The new value.
+void VariableBinding::set(unsigned int slot, double value)
+{
+  this->values_[slot] = value;
+  this->defined_[slot] = true;
+}
+
+// Sets the value of a variable by name.
+// @param name The name of the variable.
+// @param value The new value.
+// @return An error code, 0 = no error, -1 = unknown variable.
+int VariableBinding::set(std::string_view name, double value)
+{
+  int slot = this->getSlot(name);
+  if(slot == -1) {
+    // Error: unknown variable
+    return -1;
+  }
+  this->set(slot, value);
+  return 0;
+}
+
+// Returns the values in slot order for direct updates, e.g. by CompiledExpression::evaluate() or a JitExpression.
+// Writing to the array directly does not mark the variables as set.
+// @return An array containing a value for each variable of the expression.
+double* VariableBinding::getValues()
+{
+  return this->values_.data();
+}
+
+// Checks whether all variables of the expression have been set.
+// @return True if every variable has a value.
+bool VariableBinding::isComplete() const
+{
+  for(unsigned int i = 0; i < this->defined_.size(); i++) {
+    if(!this->defined_[i])
+      return false;
+  }
+  return true;
+}
+
+// Returns the variables which have not been set yet.
+// @return The names of the missing variables.
+std::vector<std::string> VariableBinding::getMissingVariables() const
+{
+  std::vector<std::string> missing;
+  const std::vector<std::string>& variables = this->expression_->getVariables();
+  for(unsigned int i = 0; i < this->defined_.size(); i++) {
+    if(!this->defined_[i])
+      missing.push_back(variables[i]);
+  }
+  return missing;
+}
+
+// Evaluates the expression with the bound values.
+// @return The result of the formula or 0 if the expression is invalid.
+double VariableBinding::evaluate() const
+{
+  return this->expression_->evaluate(this->values_.data());
+}
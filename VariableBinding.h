@@ -0,0 +1,38 @@
+﻿#ifndef VARIABLEBINDING_H
+#define VARIABLEBINDING_H
+
+// Includes
+#include "CompiledExpression.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Variable values of a compiled expression, stored by slot.
+// Look up the slot of a variable once with getSlot() and then update its value in place before each evaluation.
+// The compiled expression has to outlive the binding.
+class VariableBinding
+{
+  public:
+    // Constructor
+    VariableBinding(const CompiledExpression&);
+
+    // Destructor
+    ~VariableBinding();
+
+    // Methods
+    int getSlot(std::string_view) const;
+    void set(unsigned int, double);
+    int set(std::string_view, double);
+    double* getValues();
+    bool isComplete() const;
+    std::vector<std::string> getMissingVariables() const;
+    double evaluate() const;
+
+  private:
+    const CompiledExpression* expression_;
+    std::vector<double> values_;
+    std::vector<bool> defined_;
+
+};
+
+#endif /* VARIABLEBINDING_H */
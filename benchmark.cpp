@@ -0,0 +1,748 @@
+﻿// Includes
+#include "ShuntingYard.h"
+#include "CompiledExpression.h"
+#include "ExpressionFile.h"
+#include "ExpressionGenerator.h"
+#include "GradientExpression.h"
+#include "IncrementalExpression.h"
+#include "IntervalExpression.h"
+#include "JitExpression.h"
+#include "MultiExpression.h"
+#include "ThreadPool.h"
+#include "TypedExpression.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Additionals
+// Measured loop of a benchmark, runs the given number of iterations
+typedef std::function<void(std::size_t)> BenchmarkFunction;
+
+typedef struct BenchmarkRun
+{
+  BenchmarkFunction function_;
+  double items_per_iteration_; // Formulas, evaluations or rows, 0 if not reported
+  double bytes_per_iteration_; // Bytes of input, 0 if not reported
+} BenchmarkRun;
+
+typedef struct Benchmark
+{
+  std::string name_;
+  std::function<BenchmarkRun()> setup_; // Prepares the input, only called if the benchmark is selected
+} Benchmark;
+
+typedef struct BenchmarkResult
+{
+  std::string name_;
+  std::string run_name_;
+  std::string aggregate_name_; // Empty for single repetitions
+  std::size_t iterations_;
+  double real_time_; // Nanoseconds per iteration
+  double cpu_time_;
+  double items_per_second_;
+  double bytes_per_second_;
+} BenchmarkResult;
+
+typedef struct BenchmarkOptions
+{
+  std::string filter_;
+  std::string format_;
+  std::string out_;
+  double min_time_;
+  unsigned int repetitions_;
+  unsigned int seed_;
+} BenchmarkOptions;
+
+// File written by the setup of a benchmark, removed with the last copy of the measured loop
+typedef struct TemporaryFile
+{
+  std::string path_;
+  ~TemporaryFile()
+  {
+    std::remove(this->path_.c_str());
+  }
+} TemporaryFile;
+
+// Written by every benchmark so that the compiler cannot drop the measured work
+static volatile double benchmark_sink;
+
+// Compiles a generated formula, which is always valid unless the generator is broken.
+// @param formula The formula.
+// @return The compiled formula.
+static CompiledExpression compileGenerated(const std::string& formula)
+{
+  ShuntingYard sy;
+  CompiledExpression compiled = sy.compile(formula);
+  if(!compiled.isValid()) {
+    std::cout << "[ERROR] Generated an invalid formula: " << formula << std::endl;
+    std::exit(1);
+  }
+  return compiled;
+}
+
+// Generates random variable values in slot order.
+// @param count The number of values.
+// @param seed The seed of the values.
+// @return The values, between 0.5 and 2.
+static std::vector<double> generateValues(std::size_t count, unsigned int seed)
+{
+  std::mt19937 random(seed);
+  std::vector<double> values(count);
+  for(std::size_t i = 0; i < count; i++)
+    values[i] = 0.5 + 1.5 * (random() / 4294967296.0);
+  return values;
+}
+
+// Parses formulas of growing length into the string-based postfix tokens and into compiled expressions.
+// The parser is linear, so the bytes per second should stay about the same from the smallest to the largest formulas.
+// @param benchmarks The list to add to.
+// @param seed The seed of the formulas.
+static void addParseBenchmarks(std::vector<Benchmark>* benchmarks, unsigned int seed)
+{
+  for(unsigned int operators : {16, 64, 256, 1024, 4096, 65536}) {
+    benchmarks->push_back({"getPostfix/operators:" + std::to_string(operators), [operators, seed]() {
+      std::shared_ptr<std::string> formula = std::make_shared<std::string>(ExpressionGenerator(seed).generate(operators, 5));
+      std::shared_ptr<ShuntingYard> sy = std::make_shared<ShuntingYard>();
+      return BenchmarkRun{[formula, sy](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = sy->getPostfix(*formula).size();
+      }, 1, (double)formula->size()};
+    }});
+  }
+  for(unsigned int operators : {16, 64, 256, 1024, 4096, 65536, 1048576}) {
+    benchmarks->push_back({"compile/operators:" + std::to_string(operators), [operators, seed]() {
+      std::shared_ptr<std::string> formula = std::make_shared<std::string>(ExpressionGenerator(seed).generate(operators, 5));
+      std::shared_ptr<ShuntingYard> sy = std::make_shared<ShuntingYard>();
+      return BenchmarkRun{[formula, sy](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = sy->compile(*formula).getVariables().size();
+      }, 1, (double)formula->size()};
+    }});
+  }
+  for(unsigned int depth : {4, 16, 64, 256, 4096, 65536}) {
+    benchmarks->push_back({"compile/depth:" + std::to_string(depth), [depth, seed]() {
+      std::shared_ptr<std::string> formula = std::make_shared<std::string>(ExpressionGenerator(seed).generateNested(depth, 5));
+      std::shared_ptr<ShuntingYard> sy = std::make_shared<ShuntingYard>();
+      return BenchmarkRun{[formula, sy](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = sy->compile(*formula).getVariables().size();
+      }, 1, (double)formula->size()};
+    }});
+  }
+  // Chains of signs are collapsed while reading the operators, length 1 is the baseline without chains
+  for(unsigned int chain_length : {1, 2, 8, 32, 1024}) {
+    benchmarks->push_back({"compile/sign_chain:" + std::to_string(chain_length), [chain_length, seed]() {
+      std::shared_ptr<std::string> formula = std::make_shared<std::string>(ExpressionGenerator(seed).generateSignChains(256, chain_length, 5));
+      std::shared_ptr<ShuntingYard> sy = std::make_shared<ShuntingYard>();
+      return BenchmarkRun{[formula, sy](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = sy->compile(*formula).getVariables().size();
+      }, 1, (double)formula->size()};
+    }});
+  }
+}
+
+// Measures the latency of a single evaluation with the different evaluators.
+// @param benchmarks The list to add to.
+// @param seed The seed of the formulas.
+static void addEvaluateBenchmarks(std::vector<Benchmark>* benchmarks, unsigned int seed)
+{
+  static const unsigned int OPERATORS = 128;
+  for(unsigned int variables : {0, 5, 50}) {
+    std::string suffix = "/variables:" + std::to_string(variables);
+    // Parses the formula on every evaluation, the variables are looked up by name
+    benchmarks->push_back({"ShuntingYard::evaluate" + suffix, [variables, seed]() {
+      std::shared_ptr<std::string> formula = std::make_shared<std::string>(ExpressionGenerator(seed).generate(OPERATORS, variables));
+      std::shared_ptr<ShuntingYard> sy = std::make_shared<ShuntingYard>();
+      std::shared_ptr<std::map<std::string, double> > definitions = std::make_shared<std::map<std::string, double> >();
+      std::vector<double> values = generateValues(variables, seed);
+      for(unsigned int i = 0; i < variables; i++)
+        (*definitions)[std::string(1, ExpressionGenerator::getVariable(i))] = values[i];
+      return BenchmarkRun{[formula, sy, definitions](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = sy->evaluate(*formula, *definitions);
+      }, 1, 0};
+    }});
+    benchmarks->push_back({"evaluate" + suffix, [variables, seed]() {
+      std::shared_ptr<CompiledExpression> compiled = std::make_shared<CompiledExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, variables)));
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(variables + 1, seed));
+      return BenchmarkRun{[compiled, values](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = compiled->evaluate(values->data());
+      }, 1, 0};
+    }});
+    benchmarks->push_back({"JitExpression::evaluate" + suffix, [variables, seed]() {
+      std::shared_ptr<JitExpression> jit = std::make_shared<JitExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, variables)));
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(variables + 1, seed));
+      return BenchmarkRun{[jit, values](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = jit->evaluate(values->data());
+      }, 1, 0};
+    }});
+  }
+
+  // Partial re-evaluation after changing some of 50 variables, compare with evaluate/variables:50
+  for(unsigned int changed : {1, 5, 50}) {
+    benchmarks->push_back({"IncrementalExpression::evaluate/changed:" + std::to_string(changed), [changed, seed]() {
+      std::shared_ptr<IncrementalExpression> incremental = std::make_shared<IncrementalExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, 50)));
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(50, seed));
+      incremental->update(values->data());
+      incremental->evaluate();
+      std::shared_ptr<std::size_t> counter = std::make_shared<std::size_t>(0);
+      return BenchmarkRun{[incremental, values, changed, counter](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++) {
+          for(unsigned int k = 0; k < changed; k++) {
+            std::size_t slot = (*counter)++ % 50;
+            (*values)[slot] = 2.5 - (*values)[slot];
+            incremental->set(slot, (*values)[slot]);
+          }
+          benchmark_sink = incremental->evaluate();
+        }
+      }, 1, 0};
+    }});
+  }
+
+  // Value and gradient, central differences need 2 evaluations per variable
+  for(unsigned int variables : {5, 50}) {
+    std::string suffix = "/variables:" + std::to_string(variables);
+    benchmarks->push_back({"gradient/finite_differences" + suffix, [variables, seed]() {
+      std::shared_ptr<CompiledExpression> compiled = std::make_shared<CompiledExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, variables)));
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(variables, seed));
+      std::shared_ptr<std::vector<double> > gradient = std::make_shared<std::vector<double> >(variables);
+      return BenchmarkRun{[compiled, values, gradient](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++) {
+          benchmark_sink = compiled->evaluate(values->data());
+          for(std::size_t v = 0; v < values->size(); v++) {
+            double value = (*values)[v];
+            (*values)[v] = value + 1e-6;
+            double upper = compiled->evaluate(values->data());
+            (*values)[v] = value - 1e-6;
+            double lower = compiled->evaluate(values->data());
+            (*values)[v] = value;
+            (*gradient)[v] = (upper - lower) / 2e-6;
+          }
+        }
+        benchmark_sink = (*gradient)[0];
+      }, 1, 0};
+    }});
+    benchmarks->push_back({"GradientExpression::evaluateForward" + suffix, [variables, seed]() {
+      std::shared_ptr<GradientExpression> gradient_expression = std::make_shared<GradientExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, variables)));
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(variables, seed));
+      std::shared_ptr<std::vector<double> > gradient = std::make_shared<std::vector<double> >(variables);
+      return BenchmarkRun{[gradient_expression, values, gradient](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = gradient_expression->evaluateForward(values->data(), gradient->data());
+      }, 1, 0};
+    }});
+    benchmarks->push_back({"GradientExpression::evaluateReverse" + suffix, [variables, seed]() {
+      std::shared_ptr<GradientExpression> gradient_expression = std::make_shared<GradientExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, variables)));
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(variables, seed));
+      std::shared_ptr<std::vector<double> > gradient = std::make_shared<std::vector<double> >(variables);
+      return BenchmarkRun{[gradient_expression, values, gradient](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++)
+          benchmark_sink = gradient_expression->evaluateReverse(values->data(), gradient->data());
+      }, 1, 0};
+    }});
+  }
+}
+
+// Measures the throughput of the column-wise evaluation.
+// @param benchmarks The list to add to.
+// @param seed The seed of the formulas.
+static void addBatchBenchmarks(std::vector<Benchmark>* benchmarks, unsigned int seed)
+{
+  static const unsigned int OPERATORS = 64;
+  static const unsigned int VARIABLES = 5;
+  for(std::size_t rows : {1024, 65536, 1048576}) {
+    benchmarks->push_back({"evaluateBatch/rows:" + std::to_string(rows), [rows, seed]() {
+      std::shared_ptr<CompiledExpression> compiled = std::make_shared<CompiledExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, VARIABLES)));
+      std::shared_ptr<std::vector<double> > data = std::make_shared<std::vector<double> >(generateValues((VARIABLES + 1) * rows, seed));
+      return BenchmarkRun{[compiled, data, rows](std::size_t iterations) {
+        const double* columns[VARIABLES];
+        for(unsigned int v = 0; v < VARIABLES; v++)
+          columns[v] = data->data() + v * rows;
+        double* results = data->data() + VARIABLES * rows;
+        for(std::size_t i = 0; i < iterations; i++)
+          compiled->evaluateBatch(columns, results, rows);
+        benchmark_sink = results[0];
+      }, (double)rows, (double)((VARIABLES + 1) * rows * sizeof(double))};
+    }});
+  }
+
+  // Scaling of the parallel evaluation with the number of threads
+  std::vector<unsigned int> thread_counts = {1, 2, 4};
+  unsigned int hardware_threads = std::thread::hardware_concurrency();
+  if(hardware_threads > 4)
+    thread_counts.push_back(hardware_threads);
+  for(unsigned int threads : thread_counts) {
+    benchmarks->push_back({"evaluateBatch/rows:1048576/threads:" + std::to_string(threads), [threads, seed]() {
+      static const std::size_t ROWS = 1048576;
+      std::shared_ptr<CompiledExpression> compiled = std::make_shared<CompiledExpression>(compileGenerated(ExpressionGenerator(seed).generate(OPERATORS, VARIABLES)));
+      std::shared_ptr<std::vector<double> > data = std::make_shared<std::vector<double> >(generateValues((VARIABLES + 1) * ROWS, seed));
+      std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(threads);
+      return BenchmarkRun{[compiled, data, pool](std::size_t iterations) {
+        const double* columns[VARIABLES];
+        for(unsigned int v = 0; v < VARIABLES; v++)
+          columns[v] = data->data() + v * ROWS;
+        double* results = data->data() + VARIABLES * ROWS;
+        for(std::size_t i = 0; i < iterations; i++)
+          compiled->evaluateBatch(columns, results, ROWS, pool.get());
+        benchmark_sink = results[0];
+      }, (double)ROWS, (double)((VARIABLES + 1) * ROWS * sizeof(double))};
+    }});
+  }
+
+  // Formulas built from a common set of terms, evaluated merged and one after another
+  for(unsigned int formula_count : {4, 16}) {
+    std::string suffix = "/formulas:" + std::to_string(formula_count);
+    std::function<std::vector<std::string>()> generateFormulas = [formula_count, seed]() {
+      ExpressionGenerator generator(seed);
+      std::vector<std::string> terms;
+      for(unsigned int i = 0; i < 8; i++)
+        terms.push_back(generator.generate(8, VARIABLES));
+      std::mt19937 random(seed);
+      std::vector<std::string> formulas;
+      for(unsigned int i = 0; i < formula_count; i++) {
+        std::string formula;
+        for(unsigned int k = 0; k < 4; k++)
+          formula += (k ? ")+(" : "(") + terms[random() % terms.size()];
+        formulas.push_back(formula + ")");
+      }
+      return formulas;
+    };
+    benchmarks->push_back({"MultiExpression::evaluateBatch" + suffix, [formula_count, generateFormulas, seed]() {
+      static const std::size_t ROWS = 65536;
+      std::shared_ptr<MultiExpression> multi = std::make_shared<MultiExpression>();
+      multi->compile(generateFormulas());
+      std::shared_ptr<std::vector<double> > data = std::make_shared<std::vector<double> >(generateValues((multi->getVariables().size() + formula_count) * ROWS, seed));
+      return BenchmarkRun{[multi, data, formula_count](std::size_t iterations) {
+        std::vector<const double*> columns;
+        for(std::size_t v = 0; v < multi->getVariables().size(); v++)
+          columns.push_back(data->data() + v * ROWS);
+        std::vector<double*> results;
+        for(unsigned int f = 0; f < formula_count; f++)
+          results.push_back(data->data() + (columns.size() + f) * ROWS);
+        for(std::size_t i = 0; i < iterations; i++)
+          multi->evaluateBatch(columns.data(), results.data(), ROWS);
+        benchmark_sink = results[0][0];
+      }, (double)ROWS, 0};
+    }});
+    benchmarks->push_back({"evaluateBatch/separate" + suffix, [formula_count, generateFormulas, seed]() {
+      static const std::size_t ROWS = 65536;
+      std::vector<std::string> formulas = generateFormulas();
+      std::shared_ptr<std::vector<CompiledExpression> > compiled = std::make_shared<std::vector<CompiledExpression> >();
+      for(unsigned int f = 0; f < formula_count; f++)
+        compiled->push_back(compileGenerated(formulas[f]));
+      std::shared_ptr<std::vector<double> > data = std::make_shared<std::vector<double> >(generateValues((VARIABLES + formula_count) * ROWS, seed));
+      return BenchmarkRun{[compiled, data, formula_count](std::size_t iterations) {
+        // Every formula gets the columns of its own variables
+        std::vector<std::vector<const double*> > columns(formula_count);
+        for(unsigned int f = 0; f < formula_count; f++) {
+          for(const std::string& variable : (*compiled)[f].getVariables())
+            columns[f].push_back(data->data() + (variable[0] - 'a') * ROWS);
+        }
+        for(std::size_t i = 0; i < iterations; i++) {
+          for(unsigned int f = 0; f < formula_count; f++)
+            (*compiled)[f].evaluateBatch(columns[f].data(), data->data() + (VARIABLES + f) * ROWS, ROWS);
+        }
+        benchmark_sink = (*data)[VARIABLES * ROWS];
+      }, (double)ROWS, 0};
+    }});
+  }
+
+  // Counting the rows outside of limits, the pruned version skips the blocks whose range is proven to be inside. The
+  // variables drift slowly like time series, so the blocks cover narrow ranges.
+  for(bool pruned : {false, true}) {
+    benchmarks->push_back({pruned ? "limits/pruned" : "limits/evaluateBatch", [pruned, seed]() {
+      static const std::size_t ROWS = 1048576;
+      static const std::size_t BLOCK = 1024;
+      std::shared_ptr<CompiledExpression> compiled = std::make_shared<CompiledExpression>(compileGenerated(ExpressionGenerator(seed).generate(16, VARIABLES)));
+      std::shared_ptr<IntervalExpression> interval = std::make_shared<IntervalExpression>(*compiled);
+      std::shared_ptr<std::vector<double> > data = std::make_shared<std::vector<double> >((VARIABLES + 1) * ROWS);
+      std::vector<double> steps = generateValues(VARIABLES * ROWS, seed);
+      for(unsigned int v = 0; v < VARIABLES; v++) {
+        double value = 1.25;
+        for(std::size_t row = 0; row < ROWS; row++) {
+          value = std::min(2.0, std::max(0.5, value + (steps[v * ROWS + row] - 1.25) * 0.001));
+          (*data)[v * ROWS + row] = value;
+        }
+      }
+
+      // Limits a little outside of the actual results, so that only the enclosures decide about pruning
+      const double* all_columns[VARIABLES];
+      for(unsigned int v = 0; v < VARIABLES; v++)
+        all_columns[v] = data->data() + v * ROWS;
+      compiled->evaluateBatch(all_columns, data->data() + VARIABLES * ROWS, ROWS);
+      std::pair<double*, double*> extremes = std::minmax_element(data->data() + VARIABLES * ROWS, data->data() + data->size());
+      double margin = (*extremes.second - *extremes.first) * 0.05;
+      std::shared_ptr<std::pair<double, double> > limits = std::make_shared<std::pair<double, double> >(*extremes.first - margin, *extremes.second + margin);
+      return BenchmarkRun{[compiled, interval, data, limits, pruned](std::size_t iterations) {
+        std::size_t outside = 0;
+        for(std::size_t i = 0; i < iterations; i++) {
+          for(std::size_t begin = 0; begin < ROWS; begin += BLOCK) {
+            const double* columns[VARIABLES];
+            for(unsigned int v = 0; v < VARIABLES; v++)
+              columns[v] = data->data() + v * ROWS + begin;
+            if(pruned && IntervalExpression::isWithin(interval->evaluateBatch(columns, BLOCK), limits->first, limits->second))
+              continue;
+            double* results = data->data() + VARIABLES * ROWS + begin;
+            compiled->evaluateBatch(columns, results, BLOCK);
+            for(std::size_t row = 0; row < BLOCK; row++)
+              outside += results[row] < limits->first || results[row] > limits->second;
+          }
+        }
+        benchmark_sink = outside;
+      }, (double)ROWS, 0};
+    }});
+  }
+}
+
+// Measures the batch evaluation of an arithmetic formula in a numeric type.
+// @param benchmarks The list to add to.
+// @param type_name The name of the type in the benchmark name.
+// @param seed The seed of the variable values.
+template<typename T>
+static void addTypedBenchmark(std::vector<Benchmark>* benchmarks, const std::string& type_name, unsigned int seed)
+{
+  static const std::size_t ROWS = 65536;
+  static const unsigned int VARIABLES = 5;
+  benchmarks->push_back({"TypedExpression<" + type_name + ">::evaluateBatch/rows:" + std::to_string(ROWS), [seed]() {
+    // Only operations every type supports, with values from 50 to 200 which cannot overflow
+    std::shared_ptr<TypedExpression<T> > expression = std::make_shared<TypedExpression<T> >(compileGenerated("(a*b + c*d - e*(a - b)) / (max(c, d) + 3) - min(a, e) * 2"));
+    std::vector<double> values = generateValues(VARIABLES * ROWS, seed);
+    std::shared_ptr<std::vector<T> > data = std::make_shared<std::vector<T> >((VARIABLES + 1) * ROWS);
+    for(std::size_t i = 0; i < values.size(); i++)
+      TypedExpression<T>::convert(std::round(values[i] * 100), &(*data)[i]);
+    return BenchmarkRun{[expression, data](std::size_t iterations) {
+      const T* columns[VARIABLES];
+      for(unsigned int v = 0; v < VARIABLES; v++)
+        columns[v] = data->data() + v * ROWS;
+      T* results = data->data() + VARIABLES * ROWS;
+      for(std::size_t i = 0; i < iterations; i++)
+        expression->evaluateBatch(columns, results, ROWS);
+      benchmark_sink = TypedExpression<T>::toDouble(results[0]);
+    }, (double)ROWS, (double)((VARIABLES + 1) * ROWS * sizeof(T))};
+  }});
+}
+
+// Compares the batch evaluation in the numeric types; float fills twice as many vector lanes as double.
+// @param benchmarks The list to add to.
+// @param seed The seed of the variable values.
+static void addTypedBenchmarks(std::vector<Benchmark>* benchmarks, unsigned int seed)
+{
+  addTypedBenchmark<double>(benchmarks, "double", seed);
+  addTypedBenchmark<float>(benchmarks, "float", seed);
+  addTypedBenchmark<std::int64_t>(benchmarks, "int64", seed);
+  addTypedBenchmark<FixedPoint>(benchmarks, "FixedPoint", seed);
+}
+
+// Measures how long a program takes until it can evaluate a set of formulas, parsing a text file against opening a
+// file written by ExpressionFile.
+// @param benchmarks The list to add to.
+// @param seed The seed of the formulas.
+static void addStartupBenchmarks(std::vector<Benchmark>* benchmarks, unsigned int seed)
+{
+  static const unsigned int OPERATORS = 16;
+  static const unsigned int VARIABLES = 5;
+  for(unsigned int formula_count : {1000, 50000}) {
+    std::string suffix = "/formulas:" + std::to_string(formula_count);
+    std::string path = (std::filesystem::temp_directory_path() / ("benchmark_startup_" + std::to_string(seed))).string();
+    benchmarks->push_back({"startup/parse" + suffix, [formula_count, path, seed]() {
+      std::shared_ptr<TemporaryFile> file = std::make_shared<TemporaryFile>(TemporaryFile{path + ".txt"});
+      std::ofstream out(file->path_);
+      ExpressionGenerator generator(seed);
+      std::size_t bytes = 0;
+      for(unsigned int i = 0; i < formula_count; i++) {
+        std::string formula = generator.generate(OPERATORS, VARIABLES);
+        out << formula << '\n';
+        bytes += formula.size() + 1;
+      }
+      out.close();
+      return BenchmarkRun{[file](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++) {
+          std::ifstream in(file->path_);
+          ShuntingYard sy;
+          std::vector<CompiledExpression> expressions;
+          std::string line;
+          while(std::getline(in, line))
+            expressions.push_back(sy.compile(line));
+          benchmark_sink = expressions.size();
+        }
+      }, (double)formula_count, (double)bytes};
+    }});
+    benchmarks->push_back({"startup/mmap" + suffix, [formula_count, path, seed]() {
+      std::shared_ptr<TemporaryFile> file = std::make_shared<TemporaryFile>(TemporaryFile{path + ".bin"});
+      ExpressionGenerator generator(seed);
+      std::vector<CompiledExpression> expressions;
+      for(unsigned int i = 0; i < formula_count; i++)
+        expressions.push_back(compileGenerated(generator.generate(OPERATORS, VARIABLES)));
+      if(ExpressionFile::write(file->path_.c_str(), expressions) != 0)
+        std::exit(1);
+      std::shared_ptr<std::vector<double> > values = std::make_shared<std::vector<double> >(generateValues(VARIABLES, seed));
+      return BenchmarkRun{[file, values, formula_count](std::size_t iterations) {
+        for(std::size_t i = 0; i < iterations; i++) {
+          ExpressionFile expressions;
+          expressions.open(file->path_.c_str());
+          benchmark_sink = expressions.evaluate(formula_count - 1, values->data());
+        }
+      }, (double)formula_count, (double)std::filesystem::file_size(file->path_)};
+    }});
+  }
+}
+
+// Runs the measured loop of a benchmark once.
+// @param run The benchmark.
+// @param iterations The number of iterations.
+// @param real_time Set to the elapsed wall-clock time in seconds.
+// @param cpu_time Set to the CPU time of the process in seconds, which includes all threads.
+static void measure(const BenchmarkRun& run, std::size_t iterations, double* real_time, double* cpu_time)
+{
+  std::clock_t cpu_start = std::clock();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  run.function_(iterations);
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  std::clock_t cpu_end = std::clock();
+  *real_time = std::chrono::duration<double>(end - start).count();
+  *cpu_time = (double)(cpu_end - cpu_start) / CLOCKS_PER_SEC;
+}
+
+// Runs a benchmark with enough iterations to take at least the minimum time per repetition.
+// @param benchmark The benchmark.
+// @param options The options.
+// @param results The list to add the results to, one per repetition and the mean, median and standard deviation if
+// there are several repetitions.
+static void runBenchmark(const Benchmark& benchmark, const BenchmarkOptions& options, std::vector<BenchmarkResult>* results)
+{
+  BenchmarkRun run = benchmark.setup_();
+
+  // Grow the number of iterations until a run takes long enough, which also warms up caches and branch predictors
+  std::size_t iterations = 1;
+  double real_time = 0;
+  double cpu_time = 0;
+  while(true) {
+    measure(run, iterations, &real_time, &cpu_time);
+    if(real_time >= options.min_time_ || iterations >= 1000000000)
+      break;
+    double factor = (real_time > 0) ? 1.4 * options.min_time_ / real_time : 10;
+    iterations = (std::size_t)(iterations * std::min(std::max(factor, 2.0), 10.0));
+  }
+
+  std::vector<BenchmarkResult> repetitions;
+  for(unsigned int r = 0; r < options.repetitions_; r++) {
+    measure(run, iterations, &real_time, &cpu_time);
+    BenchmarkResult result = {benchmark.name_, benchmark.name_, "", iterations, real_time * 1e9 / iterations, cpu_time * 1e9 / iterations,
+      run.items_per_iteration_ * iterations / real_time, run.bytes_per_iteration_ * iterations / real_time};
+    repetitions.push_back(result);
+    results->push_back(result);
+  }
+  if(options.repetitions_ < 2)
+    return;
+
+  // Aggregates over the repetitions
+  std::vector<BenchmarkResult> aggregates(3, repetitions[0]);
+  const char* names[] = {"mean", "median", "stddev"};
+  double BenchmarkResult::* fields[] = {&BenchmarkResult::real_time_, &BenchmarkResult::cpu_time_, &BenchmarkResult::items_per_second_, &BenchmarkResult::bytes_per_second_};
+  for(unsigned int a = 0; a < 3; a++) {
+    aggregates[a].name_ = benchmark.name_ + "_" + names[a];
+    aggregates[a].aggregate_name_ = names[a];
+    aggregates[a].iterations_ = repetitions.size();
+  }
+  for(double BenchmarkResult::* field : fields) {
+    std::vector<double> values;
+    for(const BenchmarkResult& repetition : repetitions)
+      values.push_back(repetition.*field);
+    double mean = 0;
+    for(double value : values)
+      mean += value / values.size();
+    double variance = 0;
+    for(double value : values)
+      variance += (value - mean) * (value - mean) / (values.size() - 1);
+    std::sort(values.begin(), values.end());
+    std::size_t middle = values.size() / 2;
+    aggregates[0].*field = mean;
+    aggregates[1].*field = (values.size() % 2) ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+    aggregates[2].*field = std::sqrt(variance);
+  }
+  results->insert(results->end(), aggregates.begin(), aggregates.end());
+}
+
+// Escapes a string for JSON.
+// @param value The string.
+// @return The quoted string.
+static std::string quoteJson(const std::string& value)
+{
+  std::string quoted = "\"";
+  for(char current : value) {
+    if(current == '"' || current == '\\') {
+      quoted.push_back('\\');
+      quoted.push_back(current);
+    }
+    else if((unsigned char)current < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", current);
+      quoted += escaped;
+    }
+    else {
+      quoted.push_back(current);
+    }
+  }
+  return quoted + "\"";
+}
+
+// Writes the results in the JSON format of Google Benchmark, so runs can be compared with its tools.
+// @param stream The stream to write to.
+// @param results The results.
+// @param options The options, recorded in the context.
+// @param executable The path of the program.
+static void writeJson(std::ostream& stream, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options, const std::string& executable)
+{
+  char date[32];
+  std::time_t now = std::time(0);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+#ifdef NDEBUG
+  const char* build_type = "release";
+#else
+  const char* build_type = "debug";
+#endif
+
+  stream << std::setprecision(10);
+  stream << "{" << std::endl;
+  stream << "  \"context\": {" << std::endl;
+  stream << "    \"date\": " << quoteJson(date) << "," << std::endl;
+  stream << "    \"executable\": " << quoteJson(executable) << "," << std::endl;
+  stream << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "," << std::endl;
+  stream << "    \"library_build_type\": \"" << build_type << "\"," << std::endl;
+  stream << "    \"batch_kernel\": " << quoteJson(CompiledExpression::getBatchKernelName()) << "," << std::endl;
+  stream << "    \"seed\": " << options.seed_ << "," << std::endl;
+  stream << "    \"min_time\": " << options.min_time_ << "," << std::endl;
+  stream << "    \"repetitions\": " << options.repetitions_ << std::endl;
+  stream << "  }," << std::endl;
+  stream << "  \"benchmarks\": [";
+  for(std::size_t i = 0; i < results.size(); i++) {
+    const BenchmarkResult& result = results[i];
+    stream << (i ? "," : "") << std::endl << "    {" << std::endl;
+    stream << "      \"name\": " << quoteJson(result.name_) << "," << std::endl;
+    stream << "      \"run_name\": " << quoteJson(result.run_name_) << "," << std::endl;
+    stream << "      \"run_type\": \"" << (result.aggregate_name_.empty() ? "iteration" : "aggregate") << "\"," << std::endl;
+    if(!result.aggregate_name_.empty())
+      stream << "      \"aggregate_name\": " << quoteJson(result.aggregate_name_) << "," << std::endl;
+    stream << "      \"repetitions\": " << options.repetitions_ << "," << std::endl;
+    stream << "      \"iterations\": " << result.iterations_ << "," << std::endl;
+    stream << "      \"real_time\": " << result.real_time_ << "," << std::endl;
+    stream << "      \"cpu_time\": " << result.cpu_time_ << "," << std::endl;
+    stream << "      \"time_unit\": \"ns\"";
+    if(result.items_per_second_ > 0)
+      stream << "," << std::endl << "      \"items_per_second\": " << result.items_per_second_;
+    if(result.bytes_per_second_ > 0)
+      stream << "," << std::endl << "      \"bytes_per_second\": " << result.bytes_per_second_;
+    stream << std::endl << "    }";
+  }
+  stream << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+// Prints a result as a line of the console table.
+// @param result The result.
+static void printResult(const BenchmarkResult& result)
+{
+  std::cout << std::left << std::setw(56) << result.name_ << std::right << std::fixed << std::setprecision(1)
+    << std::setw(14) << result.real_time_ << " ns" << std::setw(14) << result.cpu_time_ << " ns"
+    << std::setw(12) << result.iterations_;
+  if(result.items_per_second_ > 0)
+    std::cout << "  items/s=" << std::scientific << std::setprecision(3) << result.items_per_second_;
+  if(result.bytes_per_second_ > 0)
+    std::cout << "  MB/s=" << std::fixed << std::setprecision(1) << result.bytes_per_second_ / 1e6;
+  std::cout << std::defaultfloat << std::endl;
+}
+
+// Benchmarks of the parser and the evaluators, see README.md.
+// Accepts --benchmark_filter=<regex>, --benchmark_format=<console|json>, --benchmark_out=<file>,
+// --benchmark_min_time=<seconds>, --benchmark_repetitions=<n>, --benchmark_list_tests and --seed=<n>.
+int main(int argc, char** argv)
+{
+  BenchmarkOptions options = {".", "console", "", 0.5, 1, 42};
+  bool list = false;
+  for(int i = 1; i < argc; i++) {
+    std::string argument(argv[i]);
+    std::string value = argument.substr(argument.find('=') + 1);
+    if(argument.rfind("--benchmark_filter=", 0) == 0)
+      options.filter_ = value;
+    else if(argument.rfind("--benchmark_format=", 0) == 0 && (value == "console" || value == "json"))
+      options.format_ = value;
+    else if(argument.rfind("--benchmark_out=", 0) == 0)
+      options.out_ = value;
+    else if(argument.rfind("--benchmark_min_time=", 0) == 0)
+      options.min_time_ = std::atof(value.c_str());
+    else if(argument.rfind("--benchmark_repetitions=", 0) == 0)
+      options.repetitions_ = std::max(1, std::atoi(value.c_str()));
+    else if(argument == "--benchmark_list_tests")
+      list = true;
+    else if(argument.rfind("--seed=", 0) == 0)
+      options.seed_ = std::strtoul(value.c_str(), 0, 10);
+    else {
+      std::cout << "[ERROR] Unknown argument " << argument << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Benchmark> benchmarks;
+  addParseBenchmarks(&benchmarks, options.seed_);
+  addEvaluateBenchmarks(&benchmarks, options.seed_);
+  addBatchBenchmarks(&benchmarks, options.seed_);
+  addTypedBenchmarks(&benchmarks, options.seed_);
+  addStartupBenchmarks(&benchmarks, options.seed_);
+
+  std::regex filter;
+  try {
+    filter = std::regex(options.filter_);
+  }
+  catch(const std::regex_error&) {
+    std::cout << "[ERROR] Invalid filter " << options.filter_ << std::endl;
+    return 1;
+  }
+
+  bool console = options.format_ == "console";
+  if(console && !list)
+    std::cout << "Batch kernel: " << CompiledExpression::getBatchKernelName() << ", seed: " << options.seed_ << std::endl;
+  std::vector<BenchmarkResult> results;
+  for(const Benchmark& benchmark : benchmarks) {
+    if(!std::regex_search(benchmark.name_, filter))
+      continue;
+    if(list) {
+      std::cout << benchmark.name_ << std::endl;
+      continue;
+    }
+    std::size_t first = results.size();
+    runBenchmark(benchmark, options, &results);
+    for(std::size_t i = first; console && i < results.size(); i++)
+      printResult(results[i]);
+  }
+  if(list)
+    return 0;
+
+  if(!console)
+    writeJson(std::cout, results, options, argv[0]);
+  if(!options.out_.empty()) {
+    std::ofstream out(options.out_);
+    if(!out) {
+      std::cout << "[ERROR] Cannot write " << options.out_ << std::endl;
+      return 1;
+    }
+    writeJson(out, results, options, argv[0]);
+  }
+  return 0;
+}
@@ -0,0 +1,208 @@
+﻿// Includes
+#include "CompiledExpression.h"
+#include "EvaluationService.h"
+#include "ExpressionCache.h"
+#include "ExpressionGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Additionals
+typedef struct LoadOptions
+{
+  unsigned int clients_; // Threads submitting requests
+  unsigned int requests_; // Requests per client
+  unsigned int window_; // Requests a client has outstanding at most
+  unsigned int formulas_; // Distinct formulas of the requests
+  unsigned int operators_; // Operators per formula
+  std::size_t batch_size_;
+  unsigned int delay_; // Maximum delay of a batch in microseconds
+  unsigned int threads_; // Worker threads of the service
+  unsigned int seed_;
+} LoadOptions;
+
+typedef struct LoadResult
+{
+  double seconds_;
+  std::vector<double> latencies_; // Microseconds per request
+} LoadResult;
+
+static const unsigned int VARIABLES = 5;
+static const unsigned int DEFINITION_COUNT = 64; // Variable definitions per client, used in turn
+
+// Generates the formulas and the variable definitions of every client.
+// @param options The options.
+// @param formulas Receives the formulas.
+// @param definitions Receives DEFINITION_COUNT definitions per client.
+static void generateRequests(const LoadOptions& options, std::vector<std::string>* formulas, std::vector<std::map<std::string, double> >* definitions)
+{
+  ExpressionGenerator generator(options.seed_);
+  for(unsigned int i = 0; i < options.formulas_; i++)
+    formulas->push_back(generator.generate(options.operators_, VARIABLES));
+
+  std::mt19937 random(options.seed_);
+  definitions->resize(options.clients_ * DEFINITION_COUNT);
+  for(std::size_t i = 0; i < definitions->size(); i++) {
+    for(unsigned int v = 0; v < VARIABLES; v++)
+      (*definitions)[i][std::string(1, ExpressionGenerator::getVariable(v))] = 0.5 + 1.5 * (random() / 4294967296.0);
+  }
+}
+
+// Runs the clients, every client evaluates its requests one at a time with the cached compiled expressions.
+// @param options The options.
+// @return The duration and the latency of every request.
+static LoadResult runDirect(const LoadOptions& options)
+{
+  std::vector<std::string> formulas;
+  std::vector<std::map<std::string, double> > definitions;
+  generateRequests(options, &formulas, &definitions);
+  ExpressionCache cache(1024);
+  std::vector<std::vector<double> > latencies(options.clients_);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for(unsigned int c = 0; c < options.clients_; c++) {
+    clients.push_back(std::thread([&options, &formulas, &definitions, &cache, &latencies, c]() {
+      std::mt19937 random(options.seed_ + c);
+      for(unsigned int r = 0; r < options.requests_; r++) {
+        const std::string& formula = formulas[random() % formulas.size()];
+        const std::map<std::string, double>& definition = definitions[c * DEFINITION_COUNT + r % DEFINITION_COUNT];
+        std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+        double result = 0;
+        cache.get(formula)->evaluate(definition, &result);
+        latencies[c].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitted).count());
+      }
+    }));
+  }
+  for(unsigned int c = 0; c < options.clients_; c++)
+    clients[c].join();
+
+  LoadResult result;
+  result.seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for(unsigned int c = 0; c < options.clients_; c++)
+    result.latencies_.insert(result.latencies_.end(), latencies[c].begin(), latencies[c].end());
+  return result;
+}
+
+// Runs the clients against an EvaluationService. Every client keeps up to window_ requests outstanding, like a server
+// handling several connections; the latency of a request lasts until its client has received the result.
+// @param options The options.
+// @param batch_size The maximum batch size of the service, 1 for no batching.
+// @param delay The maximum delay of the service in microseconds.
+// @param batches Receives the number of batches evaluated.
+// @return The duration and the latency of every request.
+static LoadResult runService(const LoadOptions& options, std::size_t batch_size, unsigned int delay, unsigned long long* batches)
+{
+  std::vector<std::string> formulas;
+  std::vector<std::map<std::string, double> > definitions;
+  generateRequests(options, &formulas, &definitions);
+  std::vector<std::vector<double> > latencies(options.clients_);
+
+  EvaluationService service(batch_size, delay, options.threads_);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for(unsigned int c = 0; c < options.clients_; c++) {
+    clients.push_back(std::thread([&options, &formulas, &definitions, &service, &latencies, c]() {
+      typedef std::pair<std::future<EvaluationResult>, std::chrono::steady_clock::time_point> Outstanding;
+      std::deque<Outstanding> outstanding;
+      std::mt19937 random(options.seed_ + c);
+      for(unsigned int r = 0; r < options.requests_ || !outstanding.empty(); r++) {
+        if(outstanding.size() >= options.window_ || (r >= options.requests_ && !outstanding.empty())) {
+          outstanding.front().first.get();
+          latencies[c].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - outstanding.front().second).count());
+          outstanding.pop_front();
+        }
+        if(r < options.requests_) {
+          const std::string& formula = formulas[random() % formulas.size()];
+          const std::map<std::string, double>& definition = definitions[c * DEFINITION_COUNT + r % DEFINITION_COUNT];
+          std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+          outstanding.push_back(Outstanding(service.submit(formula, definition), submitted));
+        }
+      }
+    }));
+  }
+  for(unsigned int c = 0; c < options.clients_; c++)
+    clients[c].join();
+
+  LoadResult result;
+  result.seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for(unsigned int c = 0; c < options.clients_; c++)
+    result.latencies_.insert(result.latencies_.end(), latencies[c].begin(), latencies[c].end());
+  *batches = service.getBatchCount();
+  return result;
+}
+
+// Prints the throughput and latency percentiles of a run.
+// @param name The name of the run.
+// @param result The result, its latencies are sorted.
+// @param batches The number of batches, 0 if not batched.
+static void printResult(const std::string& name, LoadResult* result, unsigned long long batches)
+{
+  std::sort(result->latencies_.begin(), result->latencies_.end());
+  std::size_t count = result->latencies_.size();
+  double p50 = result->latencies_[count / 2];
+  double p99 = result->latencies_[std::min(count - 1, count * 99 / 100)];
+  std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+    << std::setw(12) << count / result->seconds_ << " requests/s"
+    << std::setw(10) << p50 << " us p50"
+    << std::setw(10) << p99 << " us p99";
+  if(batches > 0)
+    std::cout << std::setw(8) << (double)count / batches << " per batch";
+  std::cout << std::endl;
+}
+
+// Load generator comparing EvaluationService with and without batching against evaluating every request directly.
+// Accepts --clients=<n>, --requests=<n> (per client), --window=<n>, --formulas=<n>, --operators=<n>, --batch=<n>,
+// --delay=<microseconds>, --threads=<n> and --seed=<n>.
+int main(int argc, char** argv)
+{
+  LoadOptions options = {4, 50000, 64, 8, 32, 256, 100, 1, 42};
+  for(int i = 1; i < argc; i++) {
+    std::string argument(argv[i]);
+    std::size_t separator = argument.find('=');
+    std::string name = argument.substr(0, separator);
+    unsigned long value = (separator != std::string::npos) ? std::strtoul(argument.c_str() + separator + 1, 0, 10) : 0;
+    if(name == "--clients" && value > 0)
+      options.clients_ = value;
+    else if(name == "--requests" && value > 0)
+      options.requests_ = value;
+    else if(name == "--window" && value > 0)
+      options.window_ = value;
+    else if(name == "--formulas" && value > 0)
+      options.formulas_ = value;
+    else if(name == "--operators" && value > 0)
+      options.operators_ = value;
+    else if(name == "--batch" && value > 0)
+      options.batch_size_ = value;
+    else if(name == "--delay" && separator != std::string::npos)
+      options.delay_ = value;
+    else if(name == "--threads" && value > 0)
+      options.threads_ = value;
+    else if(name == "--seed" && separator != std::string::npos)
+      options.seed_ = value;
+    else {
+      std::cout << "Usage: ./loadgen [--clients=<n>] [--requests=<n>] [--window=<n>] [--formulas=<n>] [--operators=<n>] [--batch=<n>] [--delay=<microseconds>] [--threads=<n>] [--seed=<n>]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "Clients: " << options.clients_ << ", requests: " << options.requests_ << " per client, window: " << options.window_
+    << ", formulas: " << options.formulas_ << ", worker threads: " << options.threads_ << std::endl;
+  LoadResult direct = runDirect(options);
+  printResult("direct", &direct, 0);
+  unsigned long long batches = 0;
+  LoadResult unbatched = runService(options, 1, 0, &batches);
+  printResult("service/batch:1", &unbatched, batches);
+  LoadResult batched = runService(options, options.batch_size_, options.delay_, &batches);
+  printResult("service/batch:" + std::to_string(options.batch_size_) + "/delay:" + std::to_string(options.delay_), &batched, batches);
+  return 0;
+}
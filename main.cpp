@@ -1,26 +1,94 @@
-﻿// Includes
-#include "ShuntingYard.h"
-#include <iostream>
-#include <map>
-#include <string>
-#include <deque>
-
-int main(int argc, char** argv)
-{
-  if(argc != 2) {
-    std::cout << "Usage: ./program <formula in infix notation>" << std::endl;
-    std::cout << "Example: ./program \"sin ( 3 + 4 * 2 / ( 1 - 5 ) ^ 2 ^ 3 )\"" << std::endl;
-    return 1;
-  }
-  
-  ShuntingYard* sy = new ShuntingYard();
-  std::string infix(argv[1]);
-  std::deque<Token> postfix = sy->getPostfix(infix);
-  sy->printPostfix(postfix);
-  std::map<std::string, double> definitions = {}; // No definitions for variables, otherwise e.g. { {"x", 1}, {"y", 2}, {"z", 3} }
-  std::cout << "Result: " << sy->evaluate(infix, definitions) << std::endl;
-
-  delete sy;
-
-  return 0;
-}
+﻿// Includes
+#include "ShuntingYard.h"
+#include "CompiledExpression.h"
+#include "ExpressionDag.h"
+#include "StreamEvaluator.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <deque>
+
+// Prints an error of the parser or of an evaluation.
+// @param error The error.
+// @param line The line of the input file causing the error, 0 if none.
+static void printError(const ExpressionError& error, unsigned long long line = 0)
+{
+  std::cout << "[ERROR] " << ShuntingYard::getErrorMessage(error.kind_);
+  if(error.position_ != ShuntingYard::NO_POSITION)
+    std::cout << " (position " << error.position_ << ")";
+  if(line != 0)
+    std::cout << " (line " << line << ")";
+  std::cout << std::endl;
+}
+
+// Evaluates a formula for every row of an input file and prints the throughput.
+// @param infix The formula in infix notation.
+// @param input_path The input file, CSV if its name ends with .csv, raw doubles otherwise.
+// @param output_path The output file.
+// @return The exit code.
+static int evaluateFile(const std::string& infix, const std::string& input_path, const std::string& output_path)
+{
+  ShuntingYard sy;
+  CompiledExpression compiled = sy.compile(infix);
+  if(!compiled.isValid()) {
+    printError(compiled.getError());
+    return 1;
+  }
+
+  StreamEvaluator stream(compiled);
+  bool csv = input_path.size() >= 4 && input_path.compare(input_path.size() - 4, 4, ".csv") == 0;
+  int ret = csv ? stream.evaluateCsv(input_path.c_str(), output_path.c_str()) : stream.evaluateBinary(input_path.c_str(), output_path.c_str());
+  if(ret != 0) {
+    printError(stream.getError(), stream.getErrorLine());
+    return 1;
+  }
+
+  double seconds = (stream.getSeconds() > 0) ? stream.getSeconds() : 1e-9;
+  std::cout << "Rows: " << stream.getRowCount() << std::endl;
+  std::cout << "Time: " << stream.getSeconds() << " s" << std::endl;
+  std::cout << "Throughput: " << stream.getRowCount() / seconds << " rows/s, " << stream.getByteCount() / seconds / 1e6 << " MB/s" << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc == 4)
+    return evaluateFile(argv[1], argv[2], argv[3]);
+
+  if(argc != 2) {
+    std::cout << "Usage: ./program <formula in infix notation>" << std::endl;
+    std::cout << "       ./program <formula in infix notation> <input file> <output file>" << std::endl;
+    std::cout << "Example: ./program \"sin ( 3 + 4 * 2 / ( 1 - 5 ) ^ 2 ^ 3 )\"" << std::endl;
+    std::cout << "Example: ./program \"x * y + z\" input.csv output.csv" << std::endl;
+    return 1;
+  }
+  
+  ShuntingYard* sy = new ShuntingYard();
+  std::string infix(argv[1]);
+  std::deque<Token> postfix = sy->getPostfix(infix);
+  sy->printPostfix(postfix);
+  std::map<std::string, double> definitions = {}; // No definitions for variables, otherwise e.g. { {"x", 1}, {"y", 2}, {"z", 3} }
+  double result = 0;
+  ExpressionError error = sy->evaluate(infix, definitions, &result);
+  if(error.kind_ != ERROR_NONE)
+    printError(error);
+  std::cout << "Result: " << result << std::endl;
+
+  // Formulas which are evaluated many times should be compiled once
+  CompiledExpression compiled = sy->compile(infix);
+  if(compiled.isValid()) {
+    // Shared subexpressions are calculated only once
+    ExpressionDag dag;
+    dag.build(compiled);
+    dag.printDag();
+    dag.eliminateCommonSubexpressions(&compiled);
+    error = compiled.evaluate(definitions, &result);
+    if(error.kind_ != ERROR_NONE)
+      printError(error);
+    std::cout << "Result (compiled): " << result << std::endl;
+  }
+
+  delete sy;
+
+  return 0;
+}
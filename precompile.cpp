@@ -0,0 +1,66 @@
+﻿// Includes
+#include "ShuntingYard.h"
+#include "CompiledExpression.h"
+#include "ExpressionDag.h"
+#include "ExpressionFile.h"
+#include "ExpressionOptimizer.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Compiles a file of formulas, one per line, into a file which ExpressionFile can map. The expression at index i is
+// the formula on line i + 1, so every line has to contain a valid formula.
+int main(int argc, char** argv)
+{
+  bool optimize = argc == 4 && std::string(argv[3]) == "--optimize";
+  if(argc != 3 && !optimize) {
+    std::cout << "Usage: ./precompile <formula file> <output file> [--optimize]" << std::endl;
+    std::cout << "Example: ./precompile formulas.txt formulas.bin" << std::endl;
+    return 1;
+  }
+
+  std::ifstream in(argv[1]);
+  if(!in) {
+    std::cout << "[ERROR] Could not open the file \"" << argv[1] << "\"." << std::endl;
+    return 1;
+  }
+
+  ShuntingYard sy;
+  ExpressionOptimizer optimizer;
+  optimizer.setExactOnly(true);
+  std::vector<CompiledExpression> expressions;
+  std::string line;
+  unsigned int errors = 0;
+  while(std::getline(in, line)) {
+    if(!line.empty() && line.back() == '\r')
+      line.pop_back();
+    CompiledExpression compiled = sy.compile(line);
+    if(!compiled.isValid()) {
+      const ExpressionError& error = compiled.getError();
+      std::cout << "[ERROR] Line " << expressions.size() + 1 << ": " << ShuntingYard::getErrorMessage(error.kind_);
+      if(error.position_ != ShuntingYard::NO_POSITION)
+        std::cout << " (position " << error.position_ << ")";
+      std::cout << std::endl;
+      errors++;
+    }
+    else if(optimize) {
+      // Only IEEE-exact rewrites, the file has to give the same results as the formulas
+      optimizer.optimize(&compiled);
+      ExpressionDag dag;
+      if(dag.build(compiled))
+        dag.eliminateCommonSubexpressions(&compiled);
+    }
+    expressions.push_back(compiled);
+  }
+  if(errors > 0)
+    return 1;
+
+  ErrorKind error = ExpressionFile::write(argv[2], expressions);
+  if(error != ERROR_NONE) {
+    std::cout << "[ERROR] " << ShuntingYard::getErrorMessage(error) << " (\"" << argv[2] << "\")" << std::endl;
+    return 1;
+  }
+  std::cout << "Expressions: " << expressions.size() << std::endl;
+  return 0;
+}
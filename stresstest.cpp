@@ -0,0 +1,1024 @@
+﻿// Includes
+#include "ShuntingYard.h"
+#include "CompiledExpression.h"
+#include "ExpressionDag.h"
+#include "ExpressionGenerator.h"
+#include "GradientExpression.h"
+#include "IntervalExpression.h"
+#include "JitExpression.h"
+#include "OperatorRegistry.h"
+#include "StaticExpression.h"
+#include "TypedExpression.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Additionals
+// Part of the stress test, returns the number of failed checks
+typedef struct StressSection
+{
+  std::string name_;
+  std::function<unsigned int()> run_;
+} StressSection;
+
+// Generated formula with its expected postfix output
+typedef struct PostfixCase
+{
+  const char* kind_; // "long", "nested" or "signs", see generateFormula()
+  unsigned int size_; // Operators or nesting depth
+  unsigned int chain_length_; // Signs per + and - of "signs"
+  unsigned int seed_;
+  std::size_t token_count_;
+  std::uint64_t hash_; // hashPostfix() of the output
+} PostfixCase;
+
+// Recorded with the original parser, which is quadratic in the length, so the largest cases took it seconds each
+static const PostfixCase POSTFIX_CASES[] = {
+  {"long", 1000, 0, 1, 1807, 0x54f9ca1353237ea0ULL},
+  {"long", 10000, 0, 2, 18097, 0x8617ddf96ac61358ULL},
+  {"long", 100000, 0, 3, 179955, 0xb3023382847ae51eULL},
+  {"long", 100000, 0, 11, 180162, 0xd770bcff4f32e554ULL},
+  {"nested", 1000, 0, 4, 1732, 0x88d18b44e1ba8ff6ULL},
+  {"nested", 10000, 0, 5, 17508, 0xf494c3ee8547a4d1ULL},
+  {"nested", 65536, 0, 9, 114740, 0x7c98194bef55bc61ULL},
+  {"signs", 1000, 2, 6, 1803, 0xbd238a02a007529dULL},
+  {"signs", 1000, 16, 7, 1816, 0x9ccb21cda59cc50fULL},
+  {"signs", 10000, 64, 8, 17996, 0xa91d0e039d26e6d4ULL},
+  {"signs", 1000, 1024, 10, 1794, 0xf3c70c0167f84bd0ULL}
+};
+
+// The time per byte of the largest input may be at most this factor above the smallest one; a quadratic parser
+// exceeds it by far, timing noise does not
+static const double MAX_SCALING_FACTOR = 3.0;
+// Every input of the scaling check is parsed for at least this time, the fastest run counts
+static const double MIN_SCALING_SECONDS = 0.05;
+
+// Formulas and rows of the JIT cross-check
+static const unsigned int JIT_FORMULAS = 200;
+static const unsigned int JIT_ROWS = 32;
+
+// Formulas and rows of the typed cross-check
+static const unsigned int TYPED_FORMULAS = 200;
+static const unsigned int TYPED_ROWS = 32;
+// Largest deviation of float and FixedPoint results from double, relative to the result or absolute below 1, plus
+// SENSITIVITY_FACTOR times the sensitivity of the row to its values, measured with SENSITIVITY_TRIALS moved rows
+static const double FLOAT_TOLERANCE = 1e-3;
+static const double FIXED_POINT_TOLERANCE = 1e-6;
+static const double SENSITIVITY_FACTOR = 100;
+static const unsigned int SENSITIVITY_TRIALS = 4;
+// Share of results which may exceed the tolerance; FixedPoint rounds intermediate results absolutely, which is not
+// covered by the sensitivity if e.g. a tiny denominator is cubed
+static const double MAX_OUTLIERS = 0.001;
+
+// Wide enough for every intermediate result of the int64 reference, so its overflows can be detected afterwards
+__extension__ typedef __int128 int128_t;
+
+// Flags of the reference operations, as in TypedExpression
+static const int REFERENCE_OVERFLOW = 1;
+static const int REFERENCE_UNDEFINED = 2;
+
+// Formulas parsed by the compiler and by ShuntingYard in the static cross-check; unary minus becomes '#' in both
+static constexpr char STATIC_SIGNS[] = "-a+b*c--d+-+e";
+static constexpr char STATIC_UNARY[] = "-a*(-(b-c))-(-2)^(-d)+(-(-(-e)))";
+static constexpr char STATIC_POWERS[] = "a^b^c+2^3^2-(a^2)^e-a^2";
+static constexpr char STATIC_FUNCTIONS[] = "sin(cos(a)*max(b,min(c,d)))+cos(sin(cos(sin(e))))";
+static constexpr char STATIC_MIN_MAX[] = "max(min(a,b),(-c))/(d-(-e))+min(max(a,2.5),max(b,c))";
+static constexpr char STATIC_DECIMALS[] = "0.125*a+1000000*b-0.1/c+3.14159265358979*d";
+static constexpr char STATIC_NAMES[] = "x*(1+r)^y-f*max(0,x-k)";
+static constexpr char STATIC_NESTED[] = "((a+(b*(c-(d/(e+1))))))^2-(((a)))";
+static constexpr char STATIC_CONSTANTS[] = "sin(0.5)*cos(3*0.7)+2^0.5-a^2+b^(-1)+c^3+10^d+e^0.5";
+
+typedef struct StaticCase
+{
+  const char* formula_;
+  double (*evaluate_)(const double*);
+} StaticCase;
+
+// Rows of the static cross-check
+static const unsigned int STATIC_ROWS = 256;
+
+// Formulas and rows of the gradient cross-check
+static const unsigned int GRADIENT_FORMULAS = 200;
+static const unsigned int GRADIENT_ROWS = 32;
+// Largest difference between reverse and forward mode, relative to the derivative or absolute below 1
+static const double MODE_TOLERANCE = 1e-9;
+// Largest difference from central differences, relative to the derivative or absolute below 1, plus their truncation
+// and rounding error
+static const double DIFFERENCE_TOLERANCE = 1e-6;
+// Share of derivatives which may be skipped because central differences cannot resolve them
+static const double MAX_SKIPPED = 0.05;
+
+// Formula with two variables a and b at a point where max() or min() is tied, or with a special case of '^'; the
+// gradient is exact
+typedef struct GradientTie
+{
+  const char* formula_;
+  double values_[2];
+  double value_;
+  double gradient_[2];
+} GradientTie;
+
+// Formulas, ranges of the variables per formula and points sampled per range of the interval check
+static const unsigned int INTERVAL_FORMULAS = 200;
+static const unsigned int INTERVAL_RANGES = 16;
+static const unsigned int INTERVAL_POINTS = 32;
+
+// Kernels of the functions registered for the JIT cross-check
+static double hypotKernel(const double* arguments, unsigned int)
+{
+  return std::hypot(arguments[0], arguments[1]);
+}
+
+static double meanKernel(const double* arguments, unsigned int count)
+{
+  double sum = 0;
+  for(unsigned int i = 0; i < count; i++)
+    sum += arguments[i];
+  return (count > 0) ? sum / count : 0;
+}
+
+// Generates a formula of a stress test case.
+// @param kind "long" for generate(), "nested" for generateNested() or "signs" for generateSignChains().
+// @param size The number of operators, or the depth of "nested".
+// @param chain_length The number of signs of "signs".
+// @param seed The seed of the formula.
+// @return The formula in infix notation.
+static std::string generateFormula(const std::string& kind, unsigned int size, unsigned int chain_length, unsigned int seed)
+{
+  ExpressionGenerator generator(seed);
+  if(kind == "nested")
+    return generator.generateNested(size, 5);
+  if(kind == "signs")
+    return generator.generateSignChains(size, chain_length, 5);
+  return generator.generate(size, 5);
+}
+
+// Hashes postfix tokens by their type and content (64-bit FNV-1a).
+// @param postfix The tokens.
+// @return The hash.
+static std::uint64_t hashPostfix(const std::deque<Token>& postfix)
+{
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for(std::deque<Token>::const_iterator it = postfix.begin(); it != postfix.end(); it++) {
+    std::string bytes = std::to_string(it->type_) + it->content_ + " ";
+    for(std::size_t i = 0; i < bytes.size(); i++) {
+      hash ^= (unsigned char)bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+// Prints the outcome of a check.
+// @param passed Whether the check passed.
+// @param name The name of the check.
+// @param details Measurements or the reason of a failure.
+// @return 0 if the check passed, 1 otherwise.
+static unsigned int report(bool passed, const std::string& name, const std::string& details)
+{
+  std::cout << (passed ? "[PASS] " : "[FAIL] ") << std::left << std::setw(40) << name << std::right << details << std::endl;
+  return passed ? 0 : 1;
+}
+
+// Compares the postfix output for large generated formulas against the output recorded with the original parser.
+// @return The number of failed checks.
+static unsigned int checkPostfix()
+{
+  unsigned int failures = 0;
+  ShuntingYard sy;
+  for(const PostfixCase& test : POSTFIX_CASES) {
+    std::string formula = generateFormula(test.kind_, test.size_, test.chain_length_, test.seed_);
+    std::deque<Token> postfix = sy.getPostfix(formula);
+    std::uint64_t hash = hashPostfix(postfix);
+    std::string name = "postfix/" + std::string(test.kind_) + ":" + std::to_string(test.size_) +
+      (test.chain_length_ > 0 ? "/chain:" + std::to_string(test.chain_length_) : "") + "/seed:" + std::to_string(test.seed_);
+    std::ostringstream details;
+    details << formula.size() << " bytes, " << postfix.size() << " tokens";
+    if(postfix.size() != test.token_count_ || hash != test.hash_)
+      details << ", expected " << test.token_count_ << " tokens with hash " << std::hex << test.hash_ << ", got hash " << hash;
+    failures += report(postfix.size() == test.token_count_ && hash == test.hash_, name, details.str());
+  }
+  return failures;
+}
+
+// Measures the time per byte of compiling a formula.
+// @param formula The formula.
+// @return The time of the fastest run in nanoseconds per byte.
+static double measureParse(const std::string& formula)
+{
+  ShuntingYard sy;
+  double best = 0;
+  double total = 0;
+  for(unsigned int run = 0; run < 3 || total < MIN_SCALING_SECONDS; run++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CompiledExpression compiled = sy.compile(formula);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(!compiled.isValid())
+      return -1;
+    total += seconds;
+    if(run == 0 || seconds < best)
+      best = seconds;
+  }
+  return best * 1e9 / formula.size();
+}
+
+// Checks that the parser is linear: the time per byte may not grow with the length, nesting depth or sign chains.
+// @return The number of failed checks.
+static unsigned int checkScaling()
+{
+  typedef struct ScalingCase
+  {
+    const char* kind_;
+    std::vector<unsigned int> sizes_; // Operators, depths or chain lengths, growing by 4
+  } ScalingCase;
+  const ScalingCase cases[] = {
+    {"long", {4096, 16384, 65536, 262144, 1048576}},
+    {"nested", {1024, 4096, 16384, 65536, 262144}},
+    {"signs", {16, 64, 256, 1024, 4096}}
+  };
+
+  unsigned int failures = 0;
+  for(const ScalingCase& test : cases) {
+    std::ostringstream details;
+    double smallest = 0;
+    double largest = 0;
+    bool valid = true;
+    for(std::size_t i = 0; i < test.sizes_.size(); i++) {
+      // Sign chains grow with a fixed number of operators
+      std::string kind = test.kind_;
+      std::string formula = (kind == "signs") ? generateFormula(kind, 256, test.sizes_[i], 42) : generateFormula(kind, test.sizes_[i], 0, 42);
+      double nanoseconds = measureParse(formula);
+      valid = valid && nanoseconds > 0;
+      if(i == 0)
+        smallest = nanoseconds;
+      largest = nanoseconds;
+      details << (i ? ", " : "") << formula.size() / 1024 << " KB: " << std::fixed << std::setprecision(2) << nanoseconds << " ns/B";
+    }
+    failures += report(valid && largest <= smallest * MAX_SCALING_FACTOR, "scaling/" + std::string(test.kind_), details.str());
+  }
+  return failures;
+}
+
+// Generates variable values in slot order, mostly random with both signs, some rows hit zero, tiny and huge values.
+// @param row The row, the values only depend on it.
+// @return The values of 5 variables.
+static std::vector<double> generateRow(unsigned int row)
+{
+  static const double specials[] = {0.0, -0.0, 1.0, -1.0, 1e-300, -1e300, 0.5};
+  std::mt19937 random(row);
+  std::vector<double> values(5);
+  for(std::size_t v = 0; v < values.size(); v++) {
+    values[v] = -4.0 + 8.0 * (random() / 4294967296.0);
+    if(row % 4 == 3 && random() % 3 == 0)
+      values[v] = specials[random() % (sizeof(specials) / sizeof(specials[0]))];
+  }
+  return values;
+}
+
+// Compares the JIT against the interpreter on JIT_ROWS rows, results have to be bit-identical (NaN matches any NaN).
+// @param compiled The compiled expression.
+// @param native Incremented if the JIT generated native code.
+// @param mismatch Receives the first mismatch.
+// @return Whether all results matched.
+static bool compareJit(const CompiledExpression& compiled, unsigned int* native, std::string* mismatch)
+{
+  JitExpression jit(compiled);
+  if(jit.isNative())
+    (*native)++;
+  for(unsigned int row = 0; row < JIT_ROWS; row++) {
+    std::vector<double> values = generateRow(row);
+    double expected = compiled.evaluate(values.data());
+    double result = jit.evaluate(values.data());
+    if(std::memcmp(&expected, &result, sizeof(double)) != 0 && !(std::isnan(expected) && std::isnan(result))) {
+      std::ostringstream details;
+      details << std::setprecision(17) << "row " << row << ": expected " << expected << ", got " << result;
+      *mismatch = details.str();
+      return false;
+    }
+  }
+  return true;
+}
+
+// Cross-checks JitExpression against CompiledExpression::evaluate() with fixed-seed generated formulas: plain, nested,
+// with sign chains, with registered functions, and with shared subexpressions stored in temporaries by ExpressionDag.
+// @return The number of failed checks.
+static unsigned int checkJit()
+{
+  OperatorRegistry registry;
+  registry.registerFunction("hyp", 2, true, hypotKernel);
+  // Declared impure to cover calls which are neither folded nor shared
+  registry.registerFunction("mean", OperatorRegistry::VARIADIC, false, meanKernel);
+  ShuntingYard builtin;
+  ShuntingYard registered(&registry);
+
+  const char* kinds[] = {"long", "nested", "signs", "functions", "temps"};
+  unsigned int failures = 0;
+  for(const char* kind : kinds) {
+    std::string name = kind;
+    unsigned int native = 0;
+    unsigned int shared = 0;
+    std::string mismatch;
+    bool passed = true;
+    for(unsigned int seed = 1; seed <= JIT_FORMULAS && passed; seed++) {
+      ExpressionGenerator generator(seed);
+      std::string formula;
+      if(name == "long") {
+        formula = generator.generate(1 + seed % 64, 5);
+      }
+      else if(name == "nested") {
+        formula = generator.generateNested(1 + seed % 48, 5);
+      }
+      else if(name == "signs") {
+        formula = generator.generateSignChains(1 + seed % 32, 1 + seed % 5, 5);
+      }
+      else {
+        std::string a = generator.generate(1 + seed % 12, 5);
+        std::string b = generator.generate(1 + seed % 7, 5);
+        std::string c = generator.generate(1 + seed % 5, 5);
+        if(name == "functions")
+          formula = "hyp(" + a + "," + b + ")-mean(" + c + ")*mean(" + a + "," + c + "," + b + ")";
+        else
+          formula = "(" + a + ")*hyp(" + b + "," + c + ")-sin(" + a + ")/hyp(" + b + "," + c + ")+(" + a + ")";
+      }
+
+      CompiledExpression compiled = (name == "functions" || name == "temps") ? registered.compile(formula) : builtin.compile(formula);
+      if(!compiled.isValid()) {
+        mismatch = "invalid formula " + formula;
+        passed = false;
+        break;
+      }
+      if(name == "temps") {
+        ExpressionDag dag;
+        dag.build(compiled);
+        shared += dag.getSharedNodeCount();
+        dag.eliminateCommonSubexpressions(&compiled);
+      }
+      passed = compareJit(compiled, &native, &mismatch);
+      if(!passed)
+        mismatch = "seed " + std::to_string(seed) + ", " + mismatch + " for " + formula;
+    }
+
+    std::ostringstream details;
+    details << JIT_FORMULAS << " formulas, " << native << " native";
+    if(name == "temps")
+      details << ", " << shared << " shared nodes";
+    if(!passed)
+      details << ", " << mismatch;
+    // Without shared nodes the temporaries would not be tested
+    failures += report(passed && (name != "temps" || shared > 0), "jit/" + name, details.str());
+  }
+  return failures;
+}
+
+// Narrows an exact result of the int64 reference, like the checked operations of Int64Expression.
+// @param value The exact result.
+// @param errors Receives REFERENCE_OVERFLOW if the result does not fit into std::int64_t.
+// @return The result, 0 on overflow.
+static int128_t narrowReference(int128_t value, int* errors)
+{
+  if(value < std::numeric_limits<std::int64_t>::min() || value > std::numeric_limits<std::int64_t>::max()) {
+    *errors |= REFERENCE_OVERFLOW;
+    return 0;
+  }
+  return value;
+}
+
+// Generates a random integer formula and calculates its result exactly. Failed operations return 0 and set a flag, so
+// the flags and the result have to match Int64Expression.
+// @param random The random numbers.
+// @param depth The maximum depth of the operations.
+// @param values The value of every variable, by ExpressionGenerator::getVariable() slot.
+// @param result Receives the result.
+// @param errors Receives the flags of the failed operations.
+// @return The formula in infix notation.
+static std::string generateIntegerFormula(std::mt19937* random, unsigned int depth, const std::vector<std::int64_t>& values, int128_t* result, int* errors)
+{
+  if(depth == 0 || (*random)() % 5 == 0) {
+    if((*random)() % 3 == 0) {
+      *result = (*random)() % 10;
+      return std::to_string((int)*result);
+    }
+    unsigned int slot = (*random)() % values.size();
+    *result = values[slot];
+    return std::string(1, ExpressionGenerator::getVariable(slot));
+  }
+
+  unsigned int operation = (*random)() % 8;
+  int128_t a = 0;
+  int128_t b = 0;
+  std::string left = generateIntegerFormula(random, depth - 1, values, &a, errors);
+  if(operation == 0) {
+    *result = narrowReference(-a, errors);
+    return "(-" + left + ")";
+  }
+  if(operation == 1) {
+    // Constant exponents, powers of generated operands would nearly always overflow
+    unsigned int exponent = (*random)() % 4;
+    *result = 1;
+    for(unsigned int i = 0; i < exponent; i++)
+      *result = narrowReference(*result * a, errors);
+    return "(" + left + "^" + std::to_string(exponent) + ")";
+  }
+
+  std::string right = generateIntegerFormula(random, depth - 1, values, &b, errors);
+  switch(operation) {
+    case 2:
+      *result = narrowReference(a + b, errors);
+      return "(" + left + "+" + right + ")";
+    case 3:
+      *result = narrowReference(a - b, errors);
+      return "(" + left + "-" + right + ")";
+    case 4:
+      *result = narrowReference(a * b, errors);
+      return "(" + left + "*" + right + ")";
+    case 5:
+      // Truncated towards 0 like int128_t
+      if(b == 0) {
+        *errors |= REFERENCE_UNDEFINED;
+        *result = 0;
+      }
+      else {
+        *result = narrowReference(a / b, errors);
+      }
+      return "(" + left + "/" + right + ")";
+    case 6:
+      *result = std::max(a, b);
+      return "max(" + left + "," + right + ")";
+    default:
+      *result = std::min(a, b);
+      return "min(" + left + "," + right + ")";
+  }
+}
+
+// Generates integer variable values by slot, mostly small, some rows close to the limits of std::int64_t.
+// @param row The row, the values only depend on it.
+// @return The values of 5 variables.
+static std::vector<std::int64_t> generateIntegerRow(unsigned int row)
+{
+  std::mt19937 random(row);
+  std::vector<std::int64_t> values(5);
+  for(std::size_t v = 0; v < values.size(); v++) {
+    values[v] = (std::int64_t)(random() % 201) - 100;
+    if(row % 4 == 3 && random() % 2 == 0)
+      values[v] = (random() % 2 == 0) ? std::numeric_limits<std::int64_t>::min() + random() % 3 : ((std::int64_t)1 << (20 + random() % 43)) - 1;
+  }
+  return values;
+}
+
+// Compares Int64Expression against the exact reference: results and errors have to be identical.
+// @param mismatch Receives the first mismatch.
+// @param overflows Receives the number of rows which overflowed.
+// @param undefined Receives the number of rows which divided by zero without overflowing.
+// @return Whether all rows matched.
+static bool checkInt64(std::string* mismatch, unsigned int* overflows, unsigned int* undefined)
+{
+  ShuntingYard sy;
+  for(unsigned int seed = 1; seed <= TYPED_FORMULAS; seed++) {
+    for(unsigned int row = 0; row < TYPED_ROWS; row++) {
+      // The formula is the same for every row, only the values differ
+      std::mt19937 random(seed);
+      std::vector<std::int64_t> values = generateIntegerRow(seed * TYPED_ROWS + row);
+      int128_t expected = 0;
+      int errors = 0;
+      std::string formula = generateIntegerFormula(&random, 1 + seed % 8, values, &expected, &errors);
+      ErrorKind expected_kind = ((errors & REFERENCE_OVERFLOW) != 0) ? ERROR_OVERFLOW : ((errors & REFERENCE_UNDEFINED) != 0) ? ERROR_UNDEFINED : ERROR_NONE;
+      if(expected_kind != ERROR_NONE)
+        expected = 0;
+      if(expected_kind == ERROR_OVERFLOW)
+        (*overflows)++;
+      if(expected_kind == ERROR_UNDEFINED)
+        (*undefined)++;
+
+      Int64Expression typed(sy.compile(formula));
+      std::vector<std::int64_t> slots;
+      for(const std::string& variable : typed.getVariables()) {
+        unsigned int slot = 0;
+        while(ExpressionGenerator::getVariable(slot) != variable[0])
+          slot++;
+        slots.push_back(values[slot]);
+      }
+      std::int64_t result = 0;
+      ExpressionError error = typed.isValid() ? typed.evaluate(slots.data(), &result) : typed.getError();
+      if(error.kind_ != expected_kind || result != (std::int64_t)expected) {
+        std::ostringstream details;
+        details << "seed " << seed << ", row " << row << ": expected " << (std::int64_t)expected << " (" << ShuntingYard::getErrorMessage(expected_kind)
+          << "), got " << result << " (" << ShuntingYard::getErrorMessage(error.kind_) << ") for " << formula;
+        *mismatch = details.str();
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Compares a TypedExpression for float or FixedPoint against the double interpreter within a tolerance.
+// Values are rounded so that both types represent them exactly, results which do not fit into the type are skipped.
+// The tolerance grows with the sensitivity of the row, i.e. how far the double result moves if every value is moved
+// by the precision of the type, so that e.g. sin(100*a) does not need a looser tolerance for every formula.
+// @param relative_precision The precision of the type relative to a value.
+// @param absolute_precision The precision of the type independent of a value.
+// @param tolerance The largest deviation of a row without sensitivity, relative to the result or absolute below 1.
+// @param deviation Receives the largest deviation, relative to the tolerance of its row.
+// @param outliers Receives the number of results beyond the tolerance.
+// @return The number of compared results.
+template<typename T>
+static unsigned int compareTyped(double relative_precision, double absolute_precision, double tolerance, double* deviation, unsigned int* outliers)
+{
+  ShuntingYard sy;
+  unsigned int compared = 0;
+  for(unsigned int seed = 1; seed <= TYPED_FORMULAS; seed++) {
+    std::string formula = ExpressionGenerator(seed).generate(1 + seed % 32, 5);
+    CompiledExpression compiled = sy.compile(formula);
+    TypedExpression<T> typed(compiled);
+    std::mt19937 random(seed);
+    for(unsigned int row = 0; row < TYPED_ROWS; row++) {
+      std::vector<double> values(compiled.getVariables().size());
+      std::vector<T> typed_values(values.size());
+      for(std::size_t v = 0; v < values.size(); v++) {
+        values[v] = std::round((0.5 + 1.5 * (random() / 4294967296.0)) * 1024) / 1024;
+        TypedExpression<T>::convert(values[v], &typed_values[v]);
+      }
+      double expected = compiled.evaluate(values.data());
+      T result;
+      if(!std::isfinite(expected) || std::fabs(expected) > 1e9 || typed.evaluate(typed_values.data(), &result).kind_ != ERROR_NONE)
+        continue;
+
+      double sensitivity = 0;
+      for(unsigned int trial = 0; trial < SENSITIVITY_TRIALS; trial++) {
+        std::vector<double> moved(values);
+        for(std::size_t v = 0; v < moved.size(); v++)
+          moved[v] += ((random() % 2 == 0) ? 1 : -1) * (std::fabs(moved[v]) * relative_precision + absolute_precision);
+        sensitivity = std::max(sensitivity, std::fabs(compiled.evaluate(moved.data()) - expected));
+      }
+      if(!std::isfinite(sensitivity))
+        continue;
+
+      double allowed = tolerance * std::max(1.0, std::fabs(expected)) + SENSITIVITY_FACTOR * sensitivity;
+      double difference = std::fabs(TypedExpression<T>::toDouble(result) - expected);
+      compared++;
+      if(difference > allowed)
+        (*outliers)++;
+      *deviation = std::max(*deviation, difference / allowed);
+    }
+  }
+  return compared;
+}
+
+// Cross-checks TypedExpression against the double interpreter with fixed-seed generated formulas: double has to be
+// bit-identical, float and FixedPoint within tolerances, std::int64_t identical to an exact int128_t reference,
+// including its overflow and division by zero errors.
+// @return The number of failed checks.
+static unsigned int checkTyped()
+{
+  unsigned int failures = 0;
+  ShuntingYard sy;
+
+  std::string mismatch;
+  bool passed = true;
+  for(unsigned int seed = 1; seed <= TYPED_FORMULAS && passed; seed++) {
+    std::string formula = ExpressionGenerator(seed).generate(1 + seed % 64, 5);
+    CompiledExpression compiled = sy.compile(formula);
+    TypedExpression<double> typed(compiled);
+    for(unsigned int row = 0; row < TYPED_ROWS && passed; row++) {
+      std::vector<double> values = generateRow(row);
+      double expected = compiled.evaluate(values.data());
+      double result = typed.evaluate(values.data());
+      if(std::memcmp(&expected, &result, sizeof(double)) != 0 && !(std::isnan(expected) && std::isnan(result))) {
+        std::ostringstream details;
+        details << std::setprecision(17) << "seed " << seed << ", row " << row << ": expected " << expected << ", got " << result << " for " << formula;
+        mismatch = details.str();
+        passed = false;
+      }
+    }
+  }
+  failures += report(passed, "typed/double", std::to_string(TYPED_FORMULAS) + " formulas, bit-identical" + (passed ? "" : ", " + mismatch));
+
+  const char* names[] = {"typed/float", "typed/FixedPoint"};
+  double deviations[] = {0, 0};
+  unsigned int outliers[] = {0, 0};
+  unsigned int compared[] = {
+    compareTyped<float>(1.0 / 16777216, 0, FLOAT_TOLERANCE, &deviations[0], &outliers[0]),
+    compareTyped<FixedPoint>(0, 1.0 / 4294967296.0, FIXED_POINT_TOLERANCE, &deviations[1], &outliers[1])
+  };
+  for(unsigned int i = 0; i < 2; i++) {
+    std::ostringstream details;
+    details << compared[i] << " results, " << outliers[i] << " beyond the tolerance, largest deviation " << std::fixed << std::setprecision(2)
+      << deviations[i] << " of the tolerance";
+    failures += report(compared[i] > 0 && outliers[i] <= compared[i] * MAX_OUTLIERS, names[i], details.str());
+  }
+
+  // Without errors in some rows the checks of the operations would not be tested
+  unsigned int overflows = 0;
+  unsigned int undefined = 0;
+  passed = checkInt64(&mismatch, &overflows, &undefined);
+  failures += report(passed && overflows > 0 && undefined > 0, "typed/int64", std::to_string(TYPED_FORMULAS) + " formulas, " +
+    std::to_string(overflows) + " overflows, " + std::to_string(undefined) + " divisions by zero" + (passed ? "" : ", " + mismatch));
+  return failures;
+}
+
+// Cross-checks the constexpr parser of StaticExpression.h against ShuntingYard::compile(): both get the same variable
+// values in slot order and have to return bit-identical results (NaN matches any NaN).
+// @return The number of failed checks.
+static unsigned int checkStatic()
+{
+  const StaticCase cases[] = {
+    {STATIC_SIGNS, evaluateStatic<STATIC_SIGNS>},
+    {STATIC_UNARY, evaluateStatic<STATIC_UNARY>},
+    {STATIC_POWERS, evaluateStatic<STATIC_POWERS>},
+    {STATIC_FUNCTIONS, evaluateStatic<STATIC_FUNCTIONS>},
+    {STATIC_MIN_MAX, evaluateStatic<STATIC_MIN_MAX>},
+    {STATIC_DECIMALS, evaluateStatic<STATIC_DECIMALS>},
+    {STATIC_NAMES, evaluateStatic<STATIC_NAMES>},
+    {STATIC_NESTED, evaluateStatic<STATIC_NESTED>},
+    {STATIC_CONSTANTS, evaluateStatic<STATIC_CONSTANTS>}
+  };
+
+  unsigned int failures = 0;
+  ShuntingYard sy;
+  for(std::size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const StaticCase& test = cases[i];
+    CompiledExpression compiled = sy.compile(test.formula_);
+    std::string mismatch = compiled.isValid() ? "" : ", invalid at runtime";
+    for(unsigned int row = 0; row < STATIC_ROWS && mismatch.empty(); row++) {
+      std::vector<double> values = generateRow(row);
+      double expected = compiled.evaluate(values.data());
+      double result = test.evaluate_(values.data());
+      if(std::memcmp(&expected, &result, sizeof(double)) != 0 && !(std::isnan(expected) && std::isnan(result))) {
+        std::ostringstream details;
+        details << std::setprecision(17) << ", row " << row << ": expected " << expected << ", got " << result;
+        mismatch = details.str();
+      }
+    }
+    failures += report(mismatch.empty(), "static/formula:" + std::to_string(i + 1), std::string(test.formula_) + ", " + std::to_string(STATIC_ROWS) + " rows" + mismatch);
+  }
+  return failures;
+}
+
+// Checks whether two results are bit-identical, NaN matches any NaN.
+// @param expected The expected result.
+// @param result The result.
+// @return Whether the results match.
+static bool isIdentical(double expected, double result)
+{
+  return std::memcmp(&expected, &result, sizeof(double)) == 0 || (std::isnan(expected) && std::isnan(result));
+}
+
+// Approximates a derivative of the interpreter with central differences.
+// @param compiled The compiled expression.
+// @param values The values in slot order.
+// @param slot The slot of the variable.
+// @param scale The step relative to the one GradientExpression uses for registered functions.
+// @return The approximated derivative.
+static double centralDifference(const CompiledExpression& compiled, std::vector<double> values, std::size_t slot, double scale)
+{
+  double value = values[slot];
+  double step = std::cbrt(DBL_EPSILON) * std::max(std::fabs(value), 1.0) * scale;
+  values[slot] = value + step;
+  double upper = compiled.evaluate(values.data());
+  values[slot] = value - step;
+  double lower = compiled.evaluate(values.data());
+  return (upper - lower) / ((value + step) - (value - step));
+}
+
+// Compares both modes of GradientExpression against the interpreter on GRADIENT_ROWS rows with values in [0.5, 2]:
+// values have to be bit-identical, the gradients of both modes have to agree within MODE_TOLERANCE and with central
+// differences within DIFFERENCE_TOLERANCE. Derivatives which central differences cannot resolve are skipped.
+// @param compiled The compiled expression.
+// @param seed The seed of the values.
+// @param compared Incremented for every derivative compared with central differences.
+// @param skipped Incremented for every derivative which has been skipped.
+// @param deviation Receives the largest deviation from central differences, relative to the tolerance of its row.
+// @param mismatch Receives the first mismatch.
+// @return Whether all rows matched.
+static bool compareGradient(const CompiledExpression& compiled, unsigned int seed, unsigned int* compared, unsigned int* skipped, double* deviation, std::string* mismatch)
+{
+  GradientExpression gradient(compiled);
+  std::vector<double> values(compiled.getVariables().size());
+  std::vector<double> reverse(values.size());
+  std::vector<double> forward(values.size());
+  std::mt19937 random(seed);
+  for(unsigned int row = 0; row < GRADIENT_ROWS; row++) {
+    for(std::size_t v = 0; v < values.size(); v++)
+      values[v] = 0.5 + 1.5 * (random() / 4294967296.0);
+    double expected = compiled.evaluate(values.data());
+    double reverse_value = gradient.evaluateReverse(values.data(), reverse.data());
+    double forward_value = gradient.evaluateForward(values.data(), forward.data());
+    std::ostringstream details;
+    details << std::setprecision(17) << "row " << row << ": ";
+    if(!isIdentical(expected, reverse_value) || !isIdentical(expected, forward_value)) {
+      details << "expected " << expected << ", got " << reverse_value << " (reverse), " << forward_value << " (forward)";
+      *mismatch = details.str();
+      return false;
+    }
+    if(!std::isfinite(expected)) {
+      *skipped += values.size();
+      continue;
+    }
+
+    for(std::size_t slot = 0; slot < values.size(); slot++) {
+      double difference = std::fabs(reverse[slot] - forward[slot]);
+      if(!isIdentical(reverse[slot], forward[slot]) && !(difference <= MODE_TOLERANCE * std::max(1.0, std::fabs(reverse[slot])))) {
+        details << "d/d" << compiled.getVariables()[slot] << " is " << reverse[slot] << " (reverse), " << forward[slot] << " (forward)";
+        *mismatch = details.str();
+        return false;
+      }
+
+      // Steps of 1, 1/2 and 1/4 times the one of GradientExpression; the truncation error of the smallest step is at
+      // most the difference of the last two, the rounding error grows with the result
+      double coarse = centralDifference(compiled, values, slot, 1);
+      double medium = centralDifference(compiled, values, slot, 0.5);
+      double fine = centralDifference(compiled, values, slot, 0.25);
+      double step = std::cbrt(DBL_EPSILON) * std::max(std::fabs(values[slot]), 1.0) * 0.25;
+      double rounding = 8 * DBL_EPSILON * std::fabs(expected) / step;
+      // Not resolvable if the formula changes by far more than its result within a step, e.g. sin() of a huge
+      // argument, or if the differences do not converge
+      if(!std::isfinite(reverse[slot]) || !std::isfinite(coarse) || !std::isfinite(medium) || !std::isfinite(fine) ||
+        std::fabs(reverse[slot]) * step > 1e3 * std::max(1.0, std::fabs(expected)) ||
+        std::fabs(medium - fine) > 0.5 * std::fabs(coarse - medium) + rounding + MODE_TOLERANCE * std::max(1.0, std::fabs(fine))) {
+        (*skipped)++;
+        continue;
+      }
+
+      double allowed = DIFFERENCE_TOLERANCE * std::max(1.0, std::fabs(fine)) + std::fabs(medium - fine) + rounding;
+      difference = std::fabs(reverse[slot] - fine);
+      (*compared)++;
+      *deviation = std::max(*deviation, difference / allowed);
+      if(difference > allowed) {
+        details << "d/d" << compiled.getVariables()[slot] << " is " << reverse[slot] << ", central differences " << fine;
+        *mismatch = details.str();
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Cross-checks both modes of GradientExpression against the interpreter and central differences with fixed-seed
+// generated formulas: plain, with registered functions (OP_CALL), and with shared subexpressions stored in temporaries
+// by ExpressionDag (OP_STORE, OP_LOAD). Ties of max() and min() and special cases of '^' are checked exactly.
+// @return The number of failed checks.
+static unsigned int checkGradient()
+{
+  OperatorRegistry registry;
+  registry.registerFunction("hyp", 2, true, hypotKernel);
+  ShuntingYard builtin;
+  ShuntingYard registered(&registry);
+
+  const char* kinds[] = {"generated", "functions", "temps"};
+  unsigned int failures = 0;
+  for(const char* kind : kinds) {
+    std::string name = kind;
+    unsigned int compared = 0;
+    unsigned int skipped = 0;
+    unsigned int shared = 0;
+    double deviation = 0;
+    std::string mismatch;
+    bool passed = true;
+    for(unsigned int seed = 1; seed <= GRADIENT_FORMULAS && passed; seed++) {
+      // Larger generated formulas nest e.g. sin() of huge powers, which central differences cannot resolve anymore
+      ExpressionGenerator generator(seed);
+      std::string formula;
+      if(name == "generated") {
+        formula = generator.generate(1 + seed % 12, 5);
+      }
+      else {
+        std::string a = generator.generate(1 + seed % 8, 5);
+        std::string b = generator.generate(1 + seed % 5, 5);
+        std::string c = generator.generate(1 + seed % 4, 5);
+        if(name == "functions")
+          formula = "hyp(" + a + "," + b + ")*(" + c + ")-hyp(" + c + "," + a + ")";
+        else
+          formula = "(" + a + ")*(" + b + ")-sin(" + a + ")/(" + b + ")+((" + a + "))^2";
+      }
+
+      CompiledExpression compiled = (name == "functions") ? registered.compile(formula) : builtin.compile(formula);
+      if(!compiled.isValid()) {
+        mismatch = "invalid formula " + formula;
+        passed = false;
+        break;
+      }
+      if(name == "temps") {
+        ExpressionDag dag;
+        dag.build(compiled);
+        shared += dag.getSharedNodeCount();
+        dag.eliminateCommonSubexpressions(&compiled);
+      }
+      passed = compareGradient(compiled, seed, &compared, &skipped, &deviation, &mismatch);
+      if(!passed)
+        mismatch = "seed " + std::to_string(seed) + ", " + mismatch + " for " + formula;
+    }
+
+    std::ostringstream details;
+    details << GRADIENT_FORMULAS << " formulas, " << compared << " derivatives, " << skipped << " skipped, largest deviation "
+      << std::fixed << std::setprecision(2) << deviation << " of the tolerance";
+    if(name == "temps")
+      details << ", " << shared << " shared nodes";
+    if(!passed)
+      details << ", " << mismatch;
+    // A broken gradient may look unresolvable, so most derivatives have to be compared
+    passed = passed && compared > 0 && skipped <= (compared + skipped) * MAX_SKIPPED;
+    failures += report(passed && (name != "temps" || shared > 0), "gradient/" + name, details.str());
+  }
+
+  // The derivative of a tied max() or min() goes to the second operand, x^0 and 0^y have no derivative in x or y
+  const GradientTie ties[] = {
+    {"max(a,b)", {1, 1}, 1, {0, 1}},
+    {"min(a,b)", {1, 1}, 1, {0, 1}},
+    {"max(a,b)-min(b,a)", {1, 1}, 0, {-1, 1}},
+    {"max(a,b)*a", {2, 2}, 4, {2, 2}},
+    {"min(a,b)^2", {3, 3}, 9, {0, 6}},
+    {"a^b", {2, 0}, 1, {0, std::log(2.0)}},
+    {"a^b", {0, 2}, 0, {0, 0}}
+  };
+  std::string mismatch;
+  for(const GradientTie& tie : ties) {
+    CompiledExpression compiled = builtin.compile(tie.formula_);
+    GradientExpression gradient(compiled);
+    double reverse[2] = {0, 0};
+    double forward[2] = {0, 0};
+    double expected = compiled.evaluate(tie.values_);
+    double reverse_value = gradient.evaluateReverse(tie.values_, reverse);
+    double forward_value = gradient.evaluateForward(tie.values_, forward);
+    if(mismatch.empty() && (!isIdentical(tie.value_, expected) || !isIdentical(expected, reverse_value) || !isIdentical(expected, forward_value) ||
+      reverse[0] != tie.gradient_[0] || reverse[1] != tie.gradient_[1] || forward[0] != tie.gradient_[0] || forward[1] != tie.gradient_[1])) {
+      std::ostringstream details;
+      details << ", " << tie.formula_ << " at (" << tie.values_[0] << ", " << tie.values_[1] << "): gradient (" << reverse[0] << ", "
+        << reverse[1] << ") (reverse), (" << forward[0] << ", " << forward[1] << ") (forward), expected (" << tie.gradient_[0] << ", "
+        << tie.gradient_[1] << ")";
+      mismatch = details.str();
+    }
+  }
+  failures += report(mismatch.empty(), "gradient/ties", std::to_string(sizeof(ties) / sizeof(ties[0])) + " formulas, exact" + mismatch);
+  return failures;
+}
+
+// Generates a range of every variable: single points, tiny, narrow and wide ranges, often containing 0.
+// @param random The random numbers.
+// @param count The number of variables.
+// @return The ranges in slot order.
+static std::vector<Interval> generateRanges(std::mt19937* random, std::size_t count)
+{
+  const double widths[] = {0, 1e-6, 1, 8};
+  std::vector<Interval> ranges(count);
+  for(Interval& range : ranges) {
+    range.lower_ = -4 + 8 * ((*random)() / 4294967296.0);
+    range.upper_ = range.lower_ + widths[(*random)() % 4] * ((*random)() / 4294967296.0);
+    range.undefined_ = false;
+  }
+  return ranges;
+}
+
+// Checks IntervalExpression against the interpreter with fixed-seed generated formulas: for random ranges of the
+// variables, the interpreter is evaluated at points inside them, every variable at the lower end, the upper end or in
+// between. Every result has to lie within the interval of evaluate() and of evaluateBatch() over the points, and NaN is
+// only allowed if the interval is marked as undefined.
+// @return The number of failed checks.
+static unsigned int checkInterval()
+{
+  OperatorRegistry registry;
+  registry.registerFunction("hyp", 2, true, hypotKernel);
+  ShuntingYard builtin;
+  ShuntingYard registered(&registry);
+
+  const char* kinds[] = {"long", "nested", "signs", "functions", "temps"};
+  unsigned int failures = 0;
+  for(const char* kind : kinds) {
+    std::string name = kind;
+    unsigned int results = 0;
+    unsigned int undefined = 0;
+    unsigned int shared = 0;
+    std::string mismatch;
+    for(unsigned int seed = 1; seed <= INTERVAL_FORMULAS && mismatch.empty(); seed++) {
+      ExpressionGenerator generator(seed);
+      std::string formula;
+      if(name == "long") {
+        formula = generator.generate(1 + seed % 32, 5);
+      }
+      else if(name == "nested") {
+        formula = generator.generateNested(1 + seed % 24, 5);
+      }
+      else if(name == "signs") {
+        formula = generator.generateSignChains(1 + seed % 16, 1 + seed % 5, 5);
+      }
+      else {
+        std::string a = generator.generate(1 + seed % 8, 5);
+        std::string b = generator.generate(1 + seed % 5, 5);
+        if(name == "functions")
+          formula = "hyp(" + a + "," + b + ")*(" + b + ")";
+        else
+          // Negative bases with generated exponents make many results NaN
+          formula = "(" + a + ")/(" + b + ")-sin(" + a + ")^(" + b + ")+cos(" + a + ")";
+      }
+
+      CompiledExpression compiled = (name == "functions") ? registered.compile(formula) : builtin.compile(formula);
+      if(!compiled.isValid()) {
+        mismatch = "invalid formula " + formula;
+        break;
+      }
+      if(name == "temps") {
+        ExpressionDag dag;
+        dag.build(compiled);
+        shared += dag.getSharedNodeCount();
+        dag.eliminateCommonSubexpressions(&compiled);
+      }
+      IntervalExpression interval(compiled);
+      std::size_t count = compiled.getVariables().size();
+      std::mt19937 random(seed);
+      for(unsigned int r = 0; r < INTERVAL_RANGES && mismatch.empty(); r++) {
+        std::vector<Interval> ranges = generateRanges(&random, count);
+        std::vector<std::vector<double> > columns(count, std::vector<double>(INTERVAL_POINTS));
+        std::vector<double> values(count);
+        std::vector<double> expected(INTERVAL_POINTS);
+        for(unsigned int point = 0; point < INTERVAL_POINTS; point++) {
+          for(std::size_t v = 0; v < count; v++) {
+            unsigned int position = random() % 4;
+            double inner = ranges[v].lower_ + (ranges[v].upper_ - ranges[v].lower_) * (random() / 4294967296.0);
+            values[v] = (position == 0) ? ranges[v].lower_ : (position == 1) ? ranges[v].upper_ : std::min(inner, ranges[v].upper_);
+            columns[v][point] = values[v];
+          }
+          expected[point] = compiled.evaluate(values.data());
+        }
+
+        std::vector<const double*> pointers(count);
+        for(std::size_t v = 0; v < count; v++)
+          pointers[v] = columns[v].data();
+        const Interval enclosures[] = {interval.evaluate(ranges.data()), interval.evaluateBatch(pointers.data(), INTERVAL_POINTS)};
+        const char* methods[] = {"evaluate()", "evaluateBatch()"};
+        for(unsigned int point = 0; point < INTERVAL_POINTS && mismatch.empty(); point++) {
+          results++;
+          if(std::isnan(expected[point]))
+            undefined++;
+          for(unsigned int m = 0; m < 2 && mismatch.empty(); m++) {
+            const Interval& enclosure = enclosures[m];
+            if(std::isnan(expected[point]) ? enclosure.undefined_ : (enclosure.lower_ <= expected[point] && expected[point] <= enclosure.upper_))
+              continue;
+            std::ostringstream details;
+            details << std::setprecision(17) << "seed " << seed << ", range " << r << ": " << expected[point] << " outside of " << methods[m] << " ["
+              << enclosure.lower_ << ", " << enclosure.upper_ << "]" << (enclosure.undefined_ ? " or NaN" : "") << " at";
+            for(std::size_t v = 0; v < count; v++)
+              details << " " << compiled.getVariables()[v] << "=" << columns[v][point] << " in [" << ranges[v].lower_ << ", " << ranges[v].upper_ << "]";
+            details << " for " << formula;
+            mismatch = details.str();
+          }
+        }
+      }
+    }
+
+    std::ostringstream details;
+    details << INTERVAL_FORMULAS << " formulas, " << results << " results, " << undefined << " NaN";
+    if(name == "temps")
+      details << ", " << shared << " shared nodes";
+    if(!mismatch.empty())
+      details << ", " << mismatch;
+    // Without shared nodes the temporaries would not be tested, without NaN results the undefined flag
+    failures += report(mismatch.empty() && (name != "temps" || (shared > 0 && undefined > 0)), "interval/" + name, details.str());
+  }
+  return failures;
+}
+
+// Stress test of the parser and the evaluators with large generated inputs, see README.md.
+// Runs all sections, or only the ones named as arguments (postfix, scaling, jit, typed, static, gradient,
+// interval), and fails if any check fails.
+int main(int argc, char** argv)
+{
+  const StressSection sections[] = {
+    {"postfix", checkPostfix},
+    {"scaling", checkScaling},
+    {"jit", checkJit},
+    {"typed", checkTyped},
+    {"static", checkStatic},
+    {"gradient", checkGradient},
+    {"interval", checkInterval}
+  };
+
+  std::vector<std::string> selected(argv + 1, argv + argc);
+  for(const std::string& name : selected) {
+    bool known = false;
+    for(const StressSection& section : sections)
+      known = known || section.name_ == name;
+    if(!known) {
+      std::cout << "[ERROR] Unknown section " << name << std::endl;
+      return 1;
+    }
+  }
+
+  unsigned int failures = 0;
+  for(const StressSection& section : sections) {
+    if(selected.empty() || std::find(selected.begin(), selected.end(), section.name_) != selected.end())
+      failures += section.run_();
+  }
+  std::cout << (failures == 0 ? "All checks passed." : std::to_string(failures) + " checks failed.") << std::endl;
+  return (failures == 0) ? 0 : 1;
+}